@@ -0,0 +1,168 @@
+// SlabAllocator和malloc(operator new/delete)在线程池分配模式下的对比，结果以JSON输出到标准输出
+// 每次"提交"分配三个对象，大小和一次post/submitTask实际分配的相同：任务(连同shared_ptr控制块)、结果的共享状态、放不下内联缓冲区的函数对象
+// - local：同一个线程分配、释放(工作线程提交给自己的任务)
+// - cross：生产者线程分配，经过无锁队列交给消费者线程释放(外部线程提交、工作线程执行完毕释放)，这是malloc最慢的情况
+// 两种分配器走完全相同的队列，差值就是分配和释放本身省下的时间
+// 用法：alloc_bench [--ops N] [--producers N] [--consumers N]
+
+#include "mpmcqueue.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// 一次提交分配的对象大小
+struct SubmitShape {
+    // 和post()中的任务对象一样大：函数对象放在任务内部，加上shared_ptr的控制块
+    struct FakeTask : Task {
+        Any run() override {
+            return Any();
+        }
+        MoveOnlyFunction<void()> func;
+    };
+    static constexpr size_t SIZES[3] = {
+        sizeof(FakeTask) + 2 * sizeof(void*),
+        sizeof(SharedState<Any>),
+        96, // 捕获了几个指针和一个std::string的lambda，超过MoveOnlyFunction的内联缓冲区
+    };
+};
+
+struct MallocAlloc {
+    static void* allocate(size_t size) {
+        return ::operator new(size);
+    }
+    static void deallocate(void *ptr, size_t size) {
+        ::operator delete(ptr, size);
+    }
+};
+
+struct SlabAlloc {
+    static void* allocate(size_t size) {
+        return SlabAllocator::allocate(size);
+    }
+    static void deallocate(void *ptr, size_t size) {
+        SlabAllocator::deallocate(ptr, size);
+    }
+};
+
+struct Submit {
+    void *ptrs[3];
+};
+
+// 分配之后写一下内存，和真实的对象构造一样会碰到这些缓存行
+template<typename Alloc>
+static Submit allocateSubmit() {
+    Submit s;
+    for (int i = 0; i < 3; i ++) {
+        s.ptrs[i] = Alloc::allocate(SubmitShape::SIZES[i]);
+        std::memset(s.ptrs[i], 0, 16);
+    }
+    return s;
+}
+
+template<typename Alloc>
+static void freeSubmit(Submit &s) {
+    for (int i = 0; i < 3; i ++) {
+        Alloc::deallocate(s.ptrs[i], SubmitShape::SIZES[i]);
+    }
+}
+
+// 每次分配一批再整批释放，模拟本地队列里积压了一些任务
+template<typename Alloc>
+static double runLocal(size_t ops) {
+    constexpr size_t BATCH = 64;
+    std::vector<Submit> batch(BATCH);
+    size_t done = 0;
+    auto begin = Clock::now();
+    for (; done < ops; done += BATCH) {
+        for (auto &s : batch) {
+            s = allocateSubmit<Alloc>();
+        }
+        for (auto &s : batch) {
+            freeSubmit<Alloc>(s);
+        }
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / done;
+}
+
+template<typename Alloc>
+static double runCross(size_t ops, size_t producers, size_t consumers) {
+    BoundedMPMCQueue<Submit> queue(4096);
+    std::atomic<size_t> consumed {0};
+    size_t perProducer = ops / producers;
+    size_t total = perProducer * producers;
+
+    auto begin = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; p ++) {
+        threads.emplace_back([&]() {
+            for (size_t i = 0; i < perProducer; i ++) {
+                Submit s = allocateSubmit<Alloc>();
+                while (!queue.tryPush(s)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (size_t c = 0; c < consumers; c ++) {
+        threads.emplace_back([&]() {
+            Submit s;
+            while (consumed.load(std::memory_order_relaxed) < total) {
+                if (queue.tryPop(s)) {
+                    freeSubmit<Alloc>(s);
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / total;
+}
+
+int main(int argc, char **argv) {
+    size_t ops = 2000000;
+    size_t producers = 2;
+    size_t consumers = 2;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--ops") == 0) {
+            ops = std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--producers") == 0) {
+            producers = std::max<size_t>(std::strtoul(argv[i + 1], nullptr, 10), 1);
+        } else if (std::strcmp(argv[i], "--consumers") == 0) {
+            consumers = std::max<size_t>(std::strtoul(argv[i + 1], nullptr, 10), 1);
+        } else {
+            std::fprintf(stderr, "usage: %s [--ops N] [--producers N] [--consumers N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 先各跑一轮热身，让两种分配器都已经申请好内存
+    runLocal<MallocAlloc>(ops / 10);
+    runLocal<SlabAlloc>(ops / 10);
+    runCross<MallocAlloc>(ops / 10, producers, consumers);
+    runCross<SlabAlloc>(ops / 10, producers, consumers);
+
+    double localMalloc = runLocal<MallocAlloc>(ops);
+    double localSlab = runLocal<SlabAlloc>(ops);
+    double crossMalloc = runCross<MallocAlloc>(ops, producers, consumers);
+    double crossSlab = runCross<SlabAlloc>(ops, producers, consumers);
+
+    std::printf("{\"ops\": %zu, \"producers\": %zu, \"consumers\": %zu, \"bytes_per_submit\": %zu,\n",
+                ops, producers, consumers, SubmitShape::SIZES[0] + SubmitShape::SIZES[1] + SubmitShape::SIZES[2]);
+    std::printf(" \"local\": {\"malloc_ns\": %.1f, \"slab_ns\": %.1f, \"saved_ns\": %.1f},\n",
+                localMalloc, localSlab, localMalloc - localSlab);
+    std::printf(" \"cross\": {\"malloc_ns\": %.1f, \"slab_ns\": %.1f, \"saved_ns\": %.1f},\n",
+                crossMalloc, crossSlab, crossMalloc - crossSlab);
+    std::printf(" \"slab_reserved_bytes\": %zu}\n", SlabAllocator::reservedBytes());
+}
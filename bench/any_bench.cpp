@@ -0,0 +1,90 @@
+// Any的微基准测试：对比改造前(unique_ptr<Derive<T>> + dynamic_cast)和现在的小对象优化版本
+// 每次迭代模拟一个任务返回值的完整生命周期：构造Any -> 移动给Result -> cast_取值 -> 析构
+
+#include "threadpool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// 改造前的Any实现，原样保留用于对比
+class LegacyAny {
+public:
+    LegacyAny() = default;
+    ~LegacyAny() = default;
+    LegacyAny(const LegacyAny&) = delete;
+    LegacyAny& operator=(const LegacyAny&) = delete;
+    LegacyAny(LegacyAny&&) = default;
+    LegacyAny& operator=(LegacyAny&&) = default;
+
+    template<typename T>
+    LegacyAny(T data) : base_(std::make_unique<Derive<T>>(data)) {}
+
+    template<typename T>
+    T cast_() {
+        Derive<T> *ptr = dynamic_cast<Derive<T>*>(base_.get());
+        if (ptr == nullptr) {
+            throw "type unmatch!";
+        }
+        return ptr->data_;
+    }
+
+private:
+    class Base {
+    public:
+        virtual ~Base() = default;
+    };
+
+    template<typename T>
+    class Derive : public Base {
+    public:
+        Derive(T data) : data_(data) {}
+        T data_;
+    };
+
+    std::unique_ptr<Base> base_;
+};
+
+// 阻止编译器把整个循环优化掉
+template<typename T>
+static void doNotOptimize(T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template<typename AnyType, typename T, typename Make>
+static double run(size_t iterations, Make make) {
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i ++) {
+        AnyType any(make(i));
+        AnyType moved(std::move(any));
+        T value = moved.template cast_<T>();
+        doNotOptimize(value);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+}
+
+struct Large {
+    long long data[8];
+};
+
+int main() {
+    const size_t iterations = 10000000;
+
+    auto makeLong = [](size_t i) -> long long { return static_cast<long long>(i); };
+    auto makeString = [](size_t i) -> std::string { return i % 2 ? "short" : "odd"; };
+    auto makeLarge = [](size_t i) -> Large { Large l{}; l.data[0] = static_cast<long long>(i); return l; };
+
+    std::printf("%-12s %14s %14s\n", "type", "LegacyAny ns", "Any ns");
+    std::printf("%-12s %14.2f %14.2f\n", "long long",
+                run<LegacyAny, long long>(iterations, makeLong),
+                run<Any, long long>(iterations, makeLong));
+    std::printf("%-12s %14.2f %14.2f\n", "std::string",
+                run<LegacyAny, std::string>(iterations, makeString),
+                run<Any, std::string>(iterations, makeString));
+    std::printf("%-12s %14.2f %14.2f\n", "Large(64B)",
+                run<LegacyAny, Large>(iterations, makeLarge),
+                run<Any, Large>(iterations, makeLarge));
+    return 0;
+}
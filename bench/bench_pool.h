@@ -0,0 +1,39 @@
+#ifndef BENCH_POOL_H
+#define BENCH_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "function.h"
+
+// 基准测试用的线程池适配层：每种线程池都通过自己原生的提交接口和结果类型实现下面几个操作，
+// 同一套负载就可以在不同的线程池之间对比
+class BenchPool {
+public:
+    using Fn = MoveOnlyFunction<void()>;
+
+    virtual ~BenchPool() = default;
+
+    virtual const std::string& name() const = 0;
+
+    // 逐个提交fns中的函数并等待全部执行完毕，每个任务都带结果句柄(Result或std::future)
+    // submitNs不为空时，记录每次提交调用本身的耗时，单位：纳秒
+    virtual void submitAll(std::vector<Fn> &fns, std::vector<uint64_t> *submitNs) = 0;
+
+    // 提交一个不需要结果的函数，工作线程内部也可以调用
+    virtual void post(Fn fn) = 0;
+};
+
+// 按名字创建线程池，每个负载只创建一个线程池，不同的线程池不会同时运行、互相争抢CPU
+struct BenchPoolFactory {
+    std::string name;
+    std::unique_ptr<BenchPool> (*make)(size_t threads);
+};
+
+// 线程池项目-最终版.h中的线程池，在单独的编译单元(final_pool.cpp)中实现，这里不需要包含最终版的头文件
+std::vector<BenchPoolFactory> finalPoolFactories();
+
+#endif
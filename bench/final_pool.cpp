@@ -0,0 +1,68 @@
+// 线程池项目-最终版.h的基准测试适配
+// 最终版的类都在命名空间final_version中，和threadpool.h同名的ThreadPool、Thread等类不会冲突
+
+#include "线程池项目-最终版.h"
+#include "bench_pool.h"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+class FinalPool : public BenchPool {
+public:
+    FinalPool(std::string name, final_version::PoolMode mode, size_t threads)
+        : name_(std::move(name)),
+          pool_(std::make_unique<final_version::ThreadPool>())
+    {
+        pool_->setMode(mode);
+        // 默认的任务队列上限只有2，基准测试需要能放下一整轮任务
+        pool_->setTaskQueMaxThreshHold(1 << 20);
+        pool_->setThreadSizeThreshHold(static_cast<int>(threads * 4));
+        pool_->start(static_cast<int>(threads));
+    }
+
+    const std::string& name() const override {
+        return name_;
+    }
+
+    void submitAll(std::vector<Fn> &fns, std::vector<uint64_t> *submitNs) override {
+        std::vector<std::future<void>> futures;
+        futures.reserve(fns.size());
+        for (Fn &fn : fns) {
+            auto begin = std::chrono::steady_clock::now();
+            futures.push_back(pool_->submitTask(std::move(fn)));
+            if (submitNs != nullptr) {
+                submitNs->push_back(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count()));
+            }
+        }
+        for (auto &future : futures) {
+            future.get();
+        }
+    }
+
+    void post(Fn fn) override {
+        pool_->post(std::move(fn));
+    }
+
+private:
+    std::string name_;
+    std::unique_ptr<final_version::ThreadPool> pool_;
+};
+
+}
+
+std::vector<BenchPoolFactory> finalPoolFactories() {
+    return {
+        { "final/fixed", [](size_t threads) -> std::unique_ptr<BenchPool> {
+            return std::make_unique<FinalPool>("final/fixed", final_version::PoolMode::MODE_FIXED, threads);
+        } },
+        { "final/cached", [](size_t threads) -> std::unique_ptr<BenchPool> {
+            return std::make_unique<FinalPool>("final/cached", final_version::PoolMode::MODE_CACHED, threads);
+        } },
+    };
+}
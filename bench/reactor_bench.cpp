@@ -0,0 +1,164 @@
+// IoReactor在本机回环上的压测，结果以JSON输出到标准输出
+// 服务端：IoReactor + ThreadPool，echo模式原样返回收到的数据，http模式对每个完整的请求头返回一个固定的响应
+// 客户端：每个连接一个线程，阻塞式地发送一个请求、读完整个响应再发下一个(闭环)，统计每个请求的往返延迟
+// 用法：reactor_bench [--mode echo|http] [--threads N] [--reactors N] [--connections N] [--seconds S] [--size BYTES]
+
+#include "reactor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static const char HTTP_REQUEST[] = "GET / HTTP/1.1\r\nHost: localhost\r\nUser-Agent: reactor_bench\r\n\r\n";
+static const char HTTP_RESPONSE[] = "HTTP/1.1 200 OK\r\nContent-Length: 13\r\nContent-Type: text/plain\r\n\r\nHello, world!";
+
+// 服务端处理函数：一次数据到达可能包含多个请求，也可能只有半个
+static void echoHandler(Connection &conn) {
+    conn.send(conn.input());
+    conn.consume(conn.input().size());
+}
+
+static void httpHandler(Connection &conn) {
+    for (;;) {
+        std::string_view in = conn.input();
+        size_t end = in.find("\r\n\r\n");
+        if (end == std::string_view::npos) {
+            return;
+        }
+        conn.send(std::string_view(HTTP_RESPONSE, sizeof(HTTP_RESPONSE) - 1));
+        conn.consume(end + 4);
+    }
+}
+
+static int connectTo(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::perror("connect");
+        std::exit(1);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static bool sendAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool recvAll(int fd, char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::recv(fd, data, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::string mode = "echo";
+    size_t threads = std::max(std::thread::hardware_concurrency(), 2u);
+    size_t reactors = 1;
+    size_t connections = 4;
+    double seconds = 2.0;
+    size_t size = 64;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--mode") == 0) {
+            mode = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            threads = std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--reactors") == 0) {
+            reactors = std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--connections") == 0) {
+            connections = std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--seconds") == 0) {
+            seconds = std::atof(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--size") == 0) {
+            size = std::strtoul(argv[i + 1], nullptr, 10);
+        } else {
+            std::fprintf(stderr, "usage: %s [--mode echo|http] [--threads N] [--reactors N] [--connections N] "
+                                 "[--seconds S] [--size BYTES]\n", argv[0]);
+            return 1;
+        }
+    }
+    bool http = mode == "http";
+
+    ThreadPool pool;
+    pool.start(threads);
+    IoReactor reactor(pool, reactors);
+    uint16_t port = reactor.listen(0, http ? IoReactor::Handler(httpHandler) : IoReactor::Handler(echoHandler));
+    reactor.start();
+
+    std::string request = http ? std::string(HTTP_REQUEST) : std::string(size, 'x');
+    size_t responseSize = http ? sizeof(HTTP_RESPONSE) - 1 : size;
+
+    std::atomic_bool stop {false};
+    std::vector<LatencyHistogram> histograms(connections);
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < connections; c ++) {
+        clients.emplace_back([&, c]() {
+            int fd = connectTo(port);
+            std::vector<char> response(responseSize);
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto begin = Clock::now();
+                if (!sendAll(fd, request.data(), request.size()) || !recvAll(fd, response.data(), response.size())) {
+                    std::fprintf(stderr, "connection %zu failed\n", c);
+                    break;
+                }
+                histograms[c].record(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count()));
+            }
+            ::close(fd);
+        });
+    }
+
+    auto begin = Clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &t : clients) {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    reactor.stop();
+
+    LatencyHistogram total;
+    for (auto &h : histograms) {
+        total.merge(h);
+    }
+    std::printf("{\"mode\": \"%s\", \"threads\": %zu, \"reactors\": %zu, \"connections\": %zu, \"request_bytes\": %zu, "
+                "\"seconds\": %.3f, \"requests\": %llu, \"requests_per_sec\": %.1f, \"mean_ns\": %.1f, "
+                "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}\n",
+                mode.c_str(), threads, reactors, connections, request.size(), elapsed,
+                static_cast<unsigned long long>(total.count()), total.count() / elapsed, total.mean(),
+                static_cast<unsigned long long>(total.percentile(0.5)),
+                static_cast<unsigned long long>(total.percentile(0.99)),
+                static_cast<unsigned long long>(total.percentile(0.999)),
+                static_cast<unsigned long long>(total.max()));
+}
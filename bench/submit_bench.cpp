@@ -0,0 +1,131 @@
+// 可变参submitTask的吞吐量基准测试(线程池项目-最终版.h)
+// 对比三种提交方式，统计每秒处理的任务数和每个任务平均的堆分配次数：
+//   legacy     : 改造前的做法，shared_ptr<packaged_task> + bind + std::function
+//   submitTask : 现在的submitTask，函数和参数内联存放，promise共享状态从SlabAllocator分配
+//   post       : 不需要返回值的提交，小任务没有任何堆分配
+
+#include "线程池项目-最终版.h"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace final_version;
+
+// 统计全局operator new的调用次数
+static std::atomic<size_t> g_allocations {0};
+
+void* operator new(size_t size)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::aligned_alloc(static_cast<size_t>(align), (size + static_cast<size_t>(align) - 1) & ~(static_cast<size_t>(align) - 1)))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+static int add(int a, int b)
+{
+	return a + b;
+}
+
+struct Report
+{
+	double tasksPerSec;
+	double allocsPerTask;
+};
+
+template<typename Body>
+static Report measure(int tasks, Body body)
+{
+	size_t allocs = g_allocations.load();
+	auto begin = std::chrono::steady_clock::now();
+	body();
+	auto end = std::chrono::steady_clock::now();
+	double sec = std::chrono::duration<double>(end - begin).count();
+	return { tasks / sec, double(g_allocations.load() - allocs) / tasks };
+}
+
+int main()
+{
+	const int rounds = 20;
+	const int batch = 10000;
+	const int tasks = rounds * batch;
+
+	ThreadPool pool;
+	pool.setTaskQueMaxThreshHold(INT_MAX);
+	pool.start(std::max(2u, std::thread::hardware_concurrency()));
+
+	std::vector<std::future<int>> futures;
+	futures.reserve(batch);
+
+	// 预热，让队列和缓存扩容到稳定的大小
+	for (int i = 0; i < batch; i++)
+		futures.emplace_back(pool.submitTask(add, i, 1));
+	for (auto& f : futures)
+		f.get();
+	futures.clear();
+
+	Report legacy = measure(tasks, [&]()
+	{
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < batch; i++)
+			{
+				auto task = std::make_shared<std::packaged_task<int()>>(std::bind(add, i, 1));
+				futures.emplace_back(task->get_future());
+				std::function<void()> wrapper = [task]() { (*task)(); };
+				pool.post(std::move(wrapper));
+			}
+			for (auto& f : futures)
+				f.get();
+			futures.clear();
+		}
+	});
+
+	Report submit = measure(tasks, [&]()
+	{
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < batch; i++)
+				futures.emplace_back(pool.submitTask(add, i, 1));
+			for (auto& f : futures)
+				f.get();
+			futures.clear();
+		}
+	});
+
+	std::atomic<int> done {0};
+	Report post = measure(tasks, [&]()
+	{
+		for (int r = 0; r < rounds; r++)
+		{
+			for (int i = 0; i < batch; i++)
+				pool.post([&done](int a, int b) { done.fetch_add(add(a, b) > 0 ? 1 : 1, std::memory_order_relaxed); }, i, 1);
+			while (done.load(std::memory_order_acquire) < (r + 1) * batch)
+				std::this_thread::yield();
+		}
+	});
+
+	std::printf("%-12s %14s %16s\n", "path", "tasks/sec", "allocs/task");
+	std::printf("%-12s %14.0f %16.2f\n", "legacy", legacy.tasksPerSec, legacy.allocsPerTask);
+	std::printf("%-12s %14.0f %16.2f\n", "submitTask", submit.tasksPerSec, submit.allocsPerTask);
+	std::printf("%-12s %14.0f %16.2f\n", "post", post.tasksPerSec, post.allocsPerTask);
+	return 0;
+}
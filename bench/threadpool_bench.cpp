@@ -0,0 +1,401 @@
+// 线程池基准测试套件，结果以JSON输出到标准输出，进度输出到标准错误，便于保存下来跟踪性能回归
+// 负载：
+//   empty_post   : 单个提交者post空任务的吞吐量，延迟为每次post调用的耗时
+//   submit_1p    : 单个提交者逐个submitTask空任务(带Result/future)再全部get，延迟为每次提交调用的耗时
+//   submit_4p    : 4个提交者同时做submit_1p，观察提交路径上的竞争
+//   fan_out_in   : 每轮提交64个约2us的任务并等待全部完成，延迟为每轮的耗时
+//   fork_join    : 递归的fib(n)任务树，每个节点post两个子节点，最后完成的子节点接着完成父节点，延迟为整棵树的耗时
+//   mixed_short / mixed_long : 5%的长任务(500us)和95%的短任务(5us)混在一起提交，
+//                  分别统计两类任务从提交到执行完毕的延迟，观察短任务被长任务阻塞的程度
+//   mixed_io     : 20%的任务在ThreadPool::blocking中睡眠1ms(模拟阻塞的系统调用)，其余的任务计算20us，
+//                  吞吐量是每秒完成的任务数量；其他线程池上ThreadPool::blocking什么也不做，对比的就是阻塞补偿的效果
+// 用法：threadpool_bench [--threads N] [--scale X] [--pool 子串] [--workload 子串]
+
+#include "threadpool.h"
+#include "bench_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t nanosSince(Clock::time_point begin) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+}
+
+// 忙等一段时间，模拟计算型任务
+static void spinFor(std::chrono::nanoseconds duration) {
+    auto end = Clock::now() + duration;
+    while (Clock::now() < end) {
+        cpuRelax();
+    }
+}
+
+// --------- threadpool.h中的线程池
+class FnTask : public Task {
+public:
+    explicit FnTask(BenchPool::Fn fn)
+        : fn_(std::move(fn))
+    {}
+
+    Any run() override {
+        fn_();
+        return Any();
+    }
+
+private:
+    BenchPool::Fn fn_;
+};
+
+class NativePool : public BenchPool {
+public:
+    NativePool(std::string name, PoolMode mode, QueueType queue, size_t threads)
+        : name_(std::move(name))
+    {
+        pool_.setMode(mode);
+        pool_.setQueueType(queue);
+        pool_.setTaskQueMaxThreshHold(1 << 16);
+        pool_.setThreadThreshHold(threads * 4);
+        pool_.start(threads);
+    }
+
+    const std::string& name() const override {
+        return name_;
+    }
+
+    void submitAll(std::vector<Fn> &fns, std::vector<uint64_t> *submitNs) override {
+        std::vector<Result> results;
+        results.reserve(fns.size());
+        for (Fn &fn : fns) {
+            auto begin = Clock::now();
+            results.push_back(pool_.submitTask(std::make_shared<FnTask>(std::move(fn))));
+            if (submitNs != nullptr) {
+                submitNs->push_back(nanosSince(begin));
+            }
+        }
+        for (Result &result : results) {
+            result.get();
+        }
+    }
+
+    void post(Fn fn) override {
+        pool_.post(std::move(fn));
+    }
+
+private:
+    std::string name_;
+    ThreadPool pool_;
+};
+
+static std::vector<BenchPoolFactory> poolFactories() {
+    std::vector<BenchPoolFactory> factories = {
+        { "threadpool/fixed-mutex", [](size_t threads) -> std::unique_ptr<BenchPool> {
+            return std::make_unique<NativePool>("threadpool/fixed-mutex", PoolMode::MODE_FIXED, QueueType::QUEUE_MUTEX, threads);
+        } },
+        { "threadpool/fixed-ring", [](size_t threads) -> std::unique_ptr<BenchPool> {
+            return std::make_unique<NativePool>("threadpool/fixed-ring", PoolMode::MODE_FIXED, QueueType::QUEUE_LOCK_FREE_RING, threads);
+        } },
+        { "threadpool/stealing-mutex", [](size_t threads) -> std::unique_ptr<BenchPool> {
+            return std::make_unique<NativePool>("threadpool/stealing-mutex", PoolMode::MODE_WORK_STEALING, QueueType::QUEUE_MUTEX, threads);
+        } },
+        { "threadpool/stealing-ring", [](size_t threads) -> std::unique_ptr<BenchPool> {
+            return std::make_unique<NativePool>("threadpool/stealing-ring", PoolMode::MODE_WORK_STEALING, QueueType::QUEUE_LOCK_FREE_RING, threads);
+        } },
+        { "threadpool/cached-mutex", [](size_t threads) -> std::unique_ptr<BenchPool> {
+            return std::make_unique<NativePool>("threadpool/cached-mutex", PoolMode::MODE_CACHED, QueueType::QUEUE_MUTEX, threads);
+        } },
+    };
+    for (auto &factory : finalPoolFactories()) {
+        factories.push_back(factory);
+    }
+    return factories;
+}
+
+// --------- 负载
+struct Measurement {
+    std::string latency;       // 延迟统计的是什么
+    uint64_t ops = 0;          // 完成的操作数量(任务、轮次或者任务树)
+    double seconds = 0;        // 总耗时
+    LatencyHistogram histogram;
+};
+
+static Measurement emptyPost(BenchPool &pool, double scale) {
+    uint32_t n = static_cast<uint32_t>(100000 * scale);
+    Measurement m;
+    m.latency = "post_call";
+    BatchLatch latch(n);
+    auto begin = Clock::now();
+    for (uint32_t i = 0; i < n; i ++) {
+        auto t = Clock::now();
+        pool.post([&latch]() { latch.countDown(); });
+        m.histogram.record(nanosSince(t));
+    }
+    latch.wait();
+    m.seconds = nanosSince(begin) / 1e9;
+    m.ops = n;
+    return m;
+}
+
+// 每个提交者做rounds轮，每轮逐个提交batch个空任务再全部等待
+static Measurement submitFrom(BenchPool &pool, size_t producers, double scale) {
+    size_t rounds = std::max<size_t>(static_cast<size_t>(100 * scale / producers), 1);
+    const size_t batch = 1000;
+    Measurement m;
+    m.latency = "submit_call";
+
+    std::vector<std::vector<uint64_t>> samples(producers);
+    auto produce = [&](size_t id) {
+        samples[id].reserve(rounds * batch);
+        for (size_t r = 0; r < rounds; r ++) {
+            std::vector<BenchPool::Fn> fns;
+            fns.reserve(batch);
+            for (size_t i = 0; i < batch; i ++) {
+                fns.emplace_back([]() {});
+            }
+            pool.submitAll(fns, &samples[id]);
+        }
+    };
+
+    auto begin = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t p = 1; p < producers; p ++) {
+        threads.emplace_back(produce, p);
+    }
+    produce(0);
+    for (auto &t : threads) {
+        t.join();
+    }
+    m.seconds = nanosSince(begin) / 1e9;
+
+    for (auto &s : samples) {
+        for (uint64_t ns : s) {
+            m.histogram.record(ns);
+        }
+    }
+    m.ops = m.histogram.count();
+    return m;
+}
+
+static Measurement fanOutIn(BenchPool &pool, double scale) {
+    size_t rounds = static_cast<size_t>(500 * scale);
+    const size_t width = 64;
+    Measurement m;
+    m.latency = "round";
+    auto begin = Clock::now();
+    for (size_t r = 0; r < rounds; r ++) {
+        std::vector<BenchPool::Fn> fns;
+        fns.reserve(width);
+        for (size_t i = 0; i < width; i ++) {
+            fns.emplace_back([]() { spinFor(std::chrono::microseconds(2)); });
+        }
+        auto t = Clock::now();
+        pool.submitAll(fns, nullptr);
+        m.histogram.record(nanosSince(t));
+    }
+    m.seconds = nanosSince(begin) / 1e9;
+    m.ops = rounds;
+    return m;
+}
+
+// fib任务树：每个内部节点等两个子节点都完成后，由最后完成的子节点接着完成它，工作线程从不阻塞等待
+struct FibNode {
+    FibNode *parent;
+    std::atomic<int> pending {2};
+    std::atomic<uint64_t> sum {0};
+};
+
+struct FibRoot {
+    uint64_t value = 0;
+    BatchLatch done { 1 };
+};
+
+static void completeFib(FibNode *node, uint64_t value, FibRoot *root) {
+    while (node != nullptr) {
+        node->sum.fetch_add(value, std::memory_order_relaxed);
+        if (node->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        value = node->sum.load(std::memory_order_relaxed);
+        FibNode *parent = node->parent;
+        delete node;
+        node = parent;
+    }
+    root->value = value;
+    root->done.countDown();
+}
+
+static void spawnFib(BenchPool &pool, int n, FibNode *parent, FibRoot *root) {
+    if (n < 2) {
+        completeFib(parent, static_cast<uint64_t>(n), root);
+        return;
+    }
+    FibNode *node = new FibNode { parent };
+    pool.post([&pool, n, node, root]() { spawnFib(pool, n - 1, node, root); });
+    pool.post([&pool, n, node, root]() { spawnFib(pool, n - 2, node, root); });
+}
+
+static Measurement forkJoin(BenchPool &pool, double scale) {
+    size_t runs = std::max<size_t>(static_cast<size_t>(20 * scale), 1);
+    const int n = 18;
+    Measurement m;
+    m.latency = "tree";
+    auto begin = Clock::now();
+    for (size_t r = 0; r < runs; r ++) {
+        FibRoot root;
+        auto t = Clock::now();
+        spawnFib(pool, n, nullptr, &root);
+        root.done.wait();
+        m.histogram.record(nanosSince(t));
+        if (root.value != 2584) {
+            std::fprintf(stderr, "fork_join: wrong result %llu\n", static_cast<unsigned long long>(root.value));
+            std::exit(1);
+        }
+    }
+    m.seconds = nanosSince(begin) / 1e9;
+    m.ops = runs;
+    return m;
+}
+
+// 返回短任务和长任务两组结果
+static std::vector<Measurement> mixed(BenchPool &pool, double scale) {
+    uint32_t n = static_cast<uint32_t>(2000 * scale);
+    std::vector<uint64_t> sojourn(n);
+    BatchLatch latch(n);
+
+    auto begin = Clock::now();
+    for (uint32_t i = 0; i < n; i ++) {
+        bool isLong = i % 20 == 0;
+        auto submitted = Clock::now();
+        pool.post([&, i, isLong, submitted]() {
+            spinFor(isLong ? std::chrono::microseconds(500) : std::chrono::microseconds(5));
+            sojourn[i] = nanosSince(submitted);
+            latch.countDown();
+        });
+    }
+    latch.wait();
+    double seconds = nanosSince(begin) / 1e9;
+
+    std::vector<Measurement> ms(2);
+    for (uint32_t i = 0; i < n; i ++) {
+        ms[i % 20 == 0 ? 1 : 0].histogram.record(sojourn[i]);
+    }
+    for (auto &m : ms) {
+        m.latency = "submit_to_done";
+        m.seconds = seconds;
+        m.ops = m.histogram.count();
+    }
+    return ms;
+}
+
+static Measurement mixedIo(BenchPool &pool, double scale) {
+    uint32_t n = static_cast<uint32_t>(5000 * scale);
+    std::vector<uint64_t> sojourn(n);
+    BatchLatch latch(n);
+
+    auto begin = Clock::now();
+    for (uint32_t i = 0; i < n; i ++) {
+        bool io = i % 5 == 0;
+        auto submitted = Clock::now();
+        pool.post([&, i, io, submitted]() {
+            if (io) {
+                ThreadPool::blocking([]() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+            } else {
+                spinFor(std::chrono::microseconds(20));
+            }
+            sojourn[i] = nanosSince(submitted);
+            latch.countDown();
+        });
+    }
+    latch.wait();
+
+    Measurement m;
+    m.latency = "submit_to_done";
+    m.seconds = nanosSince(begin) / 1e9;
+    for (uint64_t ns : sojourn) {
+        m.histogram.record(ns);
+    }
+    m.ops = n;
+    return m;
+}
+
+// --------- 输出
+static void printRow(bool &first, const std::string &pool, const std::string &workload, const Measurement &m) {
+    const LatencyHistogram &h = m.histogram;
+    std::printf("%s\n    {\"pool\": \"%s\", \"workload\": \"%s\", \"latency\": \"%s\", \"ops\": %llu, "
+                "\"seconds\": %.6f, \"ops_per_sec\": %.1f, \"mean_ns\": %.1f, "
+                "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                first ? "" : ",", pool.c_str(), workload.c_str(), m.latency.c_str(),
+                static_cast<unsigned long long>(m.ops), m.seconds, m.seconds > 0 ? m.ops / m.seconds : 0.0, h.mean(),
+                static_cast<unsigned long long>(h.percentile(0.5)), static_cast<unsigned long long>(h.percentile(0.99)),
+                static_cast<unsigned long long>(h.percentile(0.999)), static_cast<unsigned long long>(h.max()));
+    first = false;
+}
+
+int main(int argc, char **argv) {
+    size_t threads = std::max(std::thread::hardware_concurrency(), 4u);
+    double scale = 1.0;
+    std::string poolFilter, workloadFilter;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--threads") == 0) {
+            threads = std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--scale") == 0) {
+            scale = std::atof(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--pool") == 0) {
+            poolFilter = argv[i + 1];
+        } else if (std::strcmp(argv[i], "--workload") == 0) {
+            workloadFilter = argv[i + 1];
+        } else {
+            std::fprintf(stderr, "usage: %s [--threads N] [--scale X] [--pool substr] [--workload substr]\n", argv[0]);
+            return 1;
+        }
+    }
+    auto selected = [&](const std::string &workload) {
+        return workloadFilter.empty() || workload.find(workloadFilter) != std::string::npos;
+    };
+
+    std::printf("{\n  \"threads\": %zu,\n  \"hardware_concurrency\": %u,\n  \"scale\": %g,\n  \"metrics\": %d,\n  \"results\": [",
+                threads, std::thread::hardware_concurrency(), scale, THREADPOOL_METRICS);
+    bool first = true;
+    for (auto &factory : poolFactories()) {
+        if (!poolFilter.empty() && factory.name.find(poolFilter) == std::string::npos) {
+            continue;
+        }
+        std::fprintf(stderr, "%s\n", factory.name.c_str());
+        std::unique_ptr<BenchPool> pool = factory.make(threads);
+        // 预热：让所有线程都跑起来，缓存和分配器进入稳定状态
+        emptyPost(*pool, 0.05);
+
+        if (selected("empty_post")) {
+            printRow(first, pool->name(), "empty_post", emptyPost(*pool, scale));
+        }
+        if (selected("submit_1p")) {
+            printRow(first, pool->name(), "submit_1p", submitFrom(*pool, 1, scale));
+        }
+        if (selected("submit_4p")) {
+            printRow(first, pool->name(), "submit_4p", submitFrom(*pool, 4, scale));
+        }
+        if (selected("fan_out_in")) {
+            printRow(first, pool->name(), "fan_out_in", fanOutIn(*pool, scale));
+        }
+        if (selected("fork_join")) {
+            printRow(first, pool->name(), "fork_join", forkJoin(*pool, scale));
+        }
+        if (selected("mixed")) {
+            auto ms = mixed(*pool, scale);
+            printRow(first, pool->name(), "mixed_short", ms[0]);
+            printRow(first, pool->name(), "mixed_long", ms[1]);
+        }
+        if (selected("mixed_io")) {
+            printRow(first, pool->name(), "mixed_io", mixedIo(*pool, scale));
+        }
+        std::fflush(stdout);
+    }
+    std::printf("\n  ]\n}\n");
+}
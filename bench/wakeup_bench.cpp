@@ -0,0 +1,93 @@
+// 线程池唤醒开销的基准测试(threadpool.h)
+// 每一轮提交少量小任务并等待它们完成，然后提交者休眠一小段时间让线程重新进入空闲状态，
+// 统计整个进程的上下文切换次数(getrusage)和每轮的平均耗时：
+//   voluntary   : 主动让出CPU(阻塞在锁、条件变量、futex上)
+//   involuntary : 被调度器抢占
+// 唤醒策略越精准，每轮被无谓叫醒又睡回去的线程越少，上下文切换次数越低
+
+#include "threadpool.h"
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class NopTask : public Task {
+public:
+    Any run() override {
+        return 0;
+    }
+};
+
+struct Config {
+    const char *name;
+    PoolMode mode;
+    QueueType queue;
+};
+
+struct Report {
+    long voluntary;
+    long involuntary;
+    double usPerRound;
+};
+
+static Report runRounds(const Config &config, size_t threads, int rounds, int tasksPerRound, int idleUs) {
+    ThreadPool pool;
+    pool.setMode(config.mode);
+    pool.setQueueType(config.queue);
+    pool.start(threads);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    std::chrono::steady_clock::duration busy {};
+
+    std::vector<Result> results;
+    results.reserve(tasksPerRound);
+    for (int r = 0; r < rounds; r ++) {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < tasksPerRound; i ++) {
+            results.emplace_back(pool.submitTask(std::make_shared<NopTask>()));
+        }
+        for (auto &result : results) {
+            result.get();
+        }
+        results.clear();
+        busy += std::chrono::steady_clock::now() - begin;
+
+        std::this_thread::sleep_for(std::chrono::microseconds(idleUs));
+    }
+
+    getrusage(RUSAGE_SELF, &after);
+    return {
+        after.ru_nvcsw - before.ru_nvcsw,
+        after.ru_nivcsw - before.ru_nivcsw,
+        std::chrono::duration<double, std::micro>(busy).count() / rounds,
+    };
+}
+
+int main(int argc, char **argv) {
+    size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 2000;
+    int idleUs = 200;
+
+    Config configs[] = {
+        { "fixed/mutex", PoolMode::MODE_FIXED, QueueType::QUEUE_MUTEX },
+        { "fixed/ring", PoolMode::MODE_FIXED, QueueType::QUEUE_LOCK_FREE_RING },
+        { "stealing/mutex", PoolMode::MODE_WORK_STEALING, QueueType::QUEUE_MUTEX },
+    };
+
+    std::printf("threads=%zu rounds=%d idle=%dus\n", threads, rounds, idleUs);
+    std::printf("%-16s %6s %14s %14s %12s\n", "config", "tasks", "voluntary/rd", "involuntary/rd", "us/round");
+    for (const Config &config : configs) {
+        for (int tasks : { 1, 4, 16 }) {
+            Report report = runRounds(config, threads, rounds, tasks, idleUs);
+            std::printf("%-16s %6d %14.2f %14.2f %12.2f\n", config.name, tasks,
+                        double(report.voluntary) / rounds, double(report.involuntary) / rounds, report.usPerRound);
+        }
+    }
+}
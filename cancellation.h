@@ -0,0 +1,67 @@
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+#include <atomic>
+#include <memory>
+
+/*
+协作式取消
+example:
+CancellationSource source;
+SubmitOptions options;
+options.token = source.token();
+pool.submitTask(task, options);
+...
+source.cancel(); // 还在队列中的任务出队时直接丢弃，正在执行的任务通过token.isCancelled()发现后自行提前结束
+
+- 一个CancellationSource可以发出任意多个token，它们共享同一个取消标记
+- isCancelled()只是一次原子读，可以在任务的循环里频繁检查
+- 默认构造的token永远不会被取消
+*/
+class CancellationToken {
+public:
+    CancellationToken() = default;
+
+    bool isCancelled() const {
+        return flag_ != nullptr && flag_->load(std::memory_order_acquire);
+    }
+
+    // 是否关联了某个CancellationSource
+    bool canBeCancelled() const {
+        return flag_ != nullptr;
+    }
+
+private:
+    friend class CancellationSource;
+
+    explicit CancellationToken(std::shared_ptr<std::atomic_bool> flag)
+        : flag_(std::move(flag))
+    {}
+
+    std::shared_ptr<std::atomic_bool> flag_;
+};
+
+class CancellationSource {
+public:
+    CancellationSource()
+        : flag_(std::make_shared<std::atomic_bool>(false))
+    {}
+
+    CancellationToken token() const {
+        return CancellationToken(flag_);
+    }
+
+    // 取消所有关联的任务，可以重复调用
+    void cancel() {
+        flag_->store(true, std::memory_order_release);
+    }
+
+    bool isCancelled() const {
+        return flag_->load(std::memory_order_acquire);
+    }
+
+private:
+    std::shared_ptr<std::atomic_bool> flag_;
+};
+
+#endif
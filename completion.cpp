@@ -0,0 +1,209 @@
+#include "completion.h"
+
+#include <stdexcept>
+#include <utility>
+
+// --------- 实现CompletionQueue类
+CompletionQueue::CompletionQueue()
+    : core_(std::make_shared<Core>())
+{}
+
+void CompletionQueue::add(Result result, uint64_t tag) {
+    // 已经挂过通知的结果不会再通知完成队列，登记之前拒绝，不留下永远等不到的一项
+    if (result.armed_) {
+        throw std::logic_error("CompletionQueue: completion notification already attached");
+    }
+    // 等待中的一项由Core持有，结果确定后移到就绪列表；链表节点的位置不变，通知可以一直持有迭代器
+    CompletionList::iterator completion;
+    {
+        std::lock_guard<std::mutex> lock(core_->mtx_);
+        completion = core_->waiting_.emplace(core_->waiting_.end(), Completion { tag, std::move(result) });
+    }
+    core_->pending_.fetch_add(1, std::memory_order_relaxed);
+    // 只有挂通知的线程会访问这一项的结果，其他线程只移动别的节点，不需要加锁
+    completion->result.onReady([weak = std::weak_ptr<Core>(core_), completion]() {
+        if (std::shared_ptr<Core> core = weak.lock()) {
+            core->push(completion);
+        }
+    });
+}
+
+void CompletionQueue::submitTask(ThreadPool &pool, std::shared_ptr<Task> sp, uint64_t tag, const SubmitOptions &options) {
+    add(pool.submitTask(std::move(sp), options), tag);
+}
+
+bool CompletionQueue::next(Completion &completion) {
+    return nextUntil(completion, std::chrono::steady_clock::time_point::max());
+}
+
+bool CompletionQueue::nextFor(Completion &completion, std::chrono::milliseconds timeout) {
+    return nextUntil(completion, std::chrono::steady_clock::now() + timeout);
+}
+
+bool CompletionQueue::tryNext(Completion &completion) {
+    return core_->tryPop(completion);
+}
+
+bool CompletionQueue::nextUntil(Completion &completion, std::chrono::steady_clock::time_point deadline) {
+    Core &core = *core_;
+    for (;;) {
+        if (core.tryPop(completion)) {
+            return true;
+        }
+        // 登记的结果已经全部取走(可能是被其他线程取走的)，再等也等不到
+        if (core.pending_.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+        if (WaitHelper *helper = WaitHelper::current()) {
+            if (!helper->helpUntil(deadline, [&core]() { return core.isReady(); },
+                                   [&core](std::chrono::steady_clock::time_point until) { core.blockUntil(until); })) {
+                return false;
+            }
+            continue;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        core.blockUntil(deadline);
+    }
+}
+
+size_t CompletionQueue::pending() const {
+    return core_->pending_.load(std::memory_order_relaxed);
+}
+
+size_t CompletionQueue::readySize() const {
+    return core_->readySize_.load(std::memory_order_relaxed);
+}
+
+void CompletionQueue::Core::push(CompletionList::iterator completion) {
+    uint32_t prev;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        ready_.splice(ready_.end(), waiting_, completion);
+        prev = readySize_.fetch_add(1, std::memory_order_seq_cst);
+    }
+    // 等待者先登记再检查就绪数量，两边都是顺序一致的读写，不会错过唤醒
+    if (prev == 0 && waiters_.load(std::memory_order_seq_cst) > 0) {
+        futexWakeAll(readySize_);
+    }
+}
+
+bool CompletionQueue::Core::tryPop(Completion &completion) {
+    if (readySize_.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    CompletionList front;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (ready_.empty()) {
+            return false;
+        }
+        front.splice(front.end(), ready_, ready_.begin());
+        readySize_.fetch_sub(1, std::memory_order_relaxed);
+        // 和就绪列表一起在锁内扣除，其他等待者看到就绪列表为空时一定也能看到这里的扣除
+        pending_.fetch_sub(1, std::memory_order_release);
+    }
+    completion = std::move(front.front());
+    return true;
+}
+
+bool CompletionQueue::Core::isReady() const {
+    return readySize_.load(std::memory_order_acquire) > 0 || pending_.load(std::memory_order_acquire) == 0;
+}
+
+void CompletionQueue::Core::blockUntil(std::chrono::steady_clock::time_point deadline) {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    while (readySize_.load(std::memory_order_seq_cst) == 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            break;
+        }
+        futexWaitFor(readySize_, 0, deadline - now);
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+
+// --------- 实现whenAll、whenAny
+namespace {
+
+// whenAll的计数，从SlabAllocator分配，每个结果的完成通知各持有一份引用，最后一个到达的一方发布结果并释放它
+// 只引用计数和Promise，不持有结果本身，结果和它们的完成通知之间没有环
+// 计数多出的1归whenAll自己：挂完所有通知之前不会就绪，调用者在Future就绪后可能立即析构结果
+struct WhenAllState {
+    explicit WhenAllState(size_t count)
+        : remaining_(count + 1)
+    {}
+
+    void arrive() {
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            promise_.setValue();
+            SlabAllocator::destroy(this);
+        }
+    }
+
+    std::atomic<size_t> remaining_;
+    Promise<void> promise_;
+};
+
+// whenAny的状态，第一个确定的结果发布它的下标，最后一个释放引用的一方释放状态
+struct WhenAnyState {
+    explicit WhenAnyState(size_t count)
+        : refs_(count + 1)
+    {}
+
+    void arrive(size_t index) {
+        if (!settled_.exchange(true, std::memory_order_acq_rel)) {
+            promise_.setValue(index);
+        }
+        release();
+    }
+
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            SlabAllocator::destroy(this);
+        }
+    }
+
+    std::atomic<size_t> refs_;
+    std::atomic_bool settled_ {false};
+    Promise<size_t> promise_;
+};
+
+}
+
+Future<void> whenAll(std::vector<Result> &results) {
+    // 先检查整组都还没有挂过通知，中途抛出异常会留下挂了一半的通知和永远不会释放的计数
+    for (const Result &result : results) {
+        if (result.armed_) {
+            throw std::logic_error("whenAll: completion notification already attached");
+        }
+    }
+    WhenAllState *state = SlabAllocator::create<WhenAllState>(results.size());
+    Future<void> future = state->promise_.getFuture();
+    for (Result &result : results) {
+        result.onReady([state]() { state->arrive(); });
+    }
+    state->arrive();
+    return future;
+}
+
+Future<size_t> whenAny(std::vector<Result> &results) {
+    if (results.empty()) {
+        throw std::invalid_argument("whenAny: no results");
+    }
+    // 和whenAll一样先检查再挂通知
+    for (const Result &result : results) {
+        if (result.armed_) {
+            throw std::logic_error("whenAny: completion notification already attached");
+        }
+    }
+    WhenAnyState *state = SlabAllocator::create<WhenAnyState>(results.size());
+    Future<size_t> future = state->promise_.getFuture();
+    for (size_t i = 0; i < results.size(); i ++) {
+        results[i].onReady([state, i]() { state->arrive(i); });
+    }
+    state->release();
+    return future;
+}
@@ -0,0 +1,105 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "threadpool.h"
+
+/*
+完成队列：按完成的先后顺序取出结果，而不是按提交顺序逐个get，先完成的任务不用等最慢的那个
+example:
+CompletionQueue queue;
+for (uint64_t id = 0; id < n; id ++) {
+    queue.submitTask(pool, makeTask<Fetch>(id), id); // tag原样带回，用来区分是哪个任务
+}
+Completion done;
+while (queue.next(done)) {
+    handle(done.tag, done.result.get()); // 取出时结果已经确定，get()不会阻塞
+}
+
+// 只关心整组或者其中任意一个时，用whenAll/whenAny，整组只有一个通知；结果仍然由调用者持有
+whenAll(results).get();
+for (Result &r : results) { ... }
+size_t first = whenAny(results).get();
+
+- 每个结果在确定时由写入结果的线程把它放进就绪列表，取结果的一方只在就绪列表为空时睡眠；
+  就绪列表从空变为非空时才唤醒，没有等待者时不进入内核
+- 在工作线程上等待时和Result::get一样帮线程池执行其他任务
+- 每个结果只能挂一个完成通知：登记到完成队列、交给whenAll/whenAny或者调用then之后，再挂通知会抛出std::logic_error
+- 完成队列持有登记的结果，结果的完成通知只持有完成队列的弱引用；whenAll/whenAny的通知只引用一个计数，不持有结果，
+  结果一直不确定时放弃等待也不会泄漏
+*/
+
+// 完成队列中取出的一项
+struct Completion {
+    uint64_t tag = 0; // 登记时给出的标记
+    Result result;    // 已经确定的结果
+};
+
+class CompletionQueue {
+public:
+    CompletionQueue();
+
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    // 登记一个结果，它确定之后(执行完毕、被丢弃或者提交失败)可以从队列中取出
+    void add(Result result, uint64_t tag = 0);
+    // 提交任务并登记它的结果
+    void submitTask(ThreadPool &pool, std::shared_ptr<Task> sp, uint64_t tag = 0,
+                    const SubmitOptions &options = SubmitOptions());
+
+    // 取出最先完成的一项，没有时等待；登记的结果都已经取出时返回false
+    bool next(Completion &completion);
+    // 最多等待timeout，超时或者登记的结果都已经取出时返回false
+    bool nextFor(Completion &completion, std::chrono::milliseconds timeout);
+    // 不等待，没有已经完成的结果时返回false
+    bool tryNext(Completion &completion);
+
+    // 登记了还没有取出的数量
+    size_t pending() const;
+    // 已经完成、可以立即取出的数量
+    size_t readySize() const;
+
+private:
+    using CompletionList = std::list<Completion, SlabStlAllocator<Completion>>;
+
+    // 登记的结果和就绪列表，和队列对象一起析构；结果的完成通知只持有它的弱引用，队列先析构时通知什么也不做
+    struct Core {
+        // 由写入结果的线程调用，把登记的一项从等待列表移到就绪列表
+        void push(CompletionList::iterator completion);
+        bool tryPop(Completion &completion);
+        // 有已经完成的结果，或者已经没有可以等的结果
+        bool isReady() const;
+        // 在就绪数量上睡眠，直到可以取出或超时
+        void blockUntil(std::chrono::steady_clock::time_point deadline);
+
+        std::mutex mtx_;
+        CompletionList waiting_;              // 还没有确定的结果
+        CompletionList ready_;                // 按完成顺序排列
+        std::atomic<uint32_t> readySize_ {0}; // 就绪列表的长度，同时作为futex等待的变量
+        std::atomic<uint32_t> waiters_ {0};   // 睡眠中的取结果线程数量
+        std::atomic<size_t> pending_ {0};     // 登记了还没有取出的数量
+    };
+
+    bool nextUntil(Completion &completion, std::chrono::steady_clock::time_point deadline);
+
+    std::shared_ptr<Core> core_;
+};
+
+// 整组结果都确定之后就绪，之后每个Result::get()都不会阻塞；结果仍然由调用者持有，在返回的Future就绪之前可以析构
+// 整组只有一个计数和一个通知，最后一个完成的任务唤醒等待者；results为空时立即就绪
+Future<void> whenAll(std::vector<Result> &results);
+
+// 任意一个结果确定之后就绪，值是最先确定的结果的下标；其余的任务继续执行，可以再从results中取出它们的结果
+// results为空时抛出std::invalid_argument
+Future<size_t> whenAny(std::vector<Result> &results);
+
+#endif
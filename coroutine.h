@@ -0,0 +1,549 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "threadpool.h"
+
+/*
+基于线程池的C++20协程
+example:
+CoTask<int> fetch(ThreadPool &pool, int id) {
+    co_await pool.schedule();          // 切换到线程池中的线程执行
+    co_return id * 2;
+}
+
+CoTask<int> handle(ThreadPool &pool) {
+    auto [a, b] = co_await whenAll(fetch(pool, 1), fetch(pool, 2));
+    co_return a + b;
+}
+
+int sum = syncWait(handle(pool));       // 非线程池线程中阻塞等待结果
+
+- CoTask是惰性的：调用协程函数只创建协程帧，第一次co_await(或syncWait、whenAll)时才在当前线程开始执行
+- 协程执行完毕时，由执行完它的线程通过对称转移直接恢复等待它的协程，不需要再经过任务队列，也不占用线程阻塞等待
+- co_await pool.schedule()和co_await task都不分配内存，whenAll只分配组合器自己的协程帧，
+  whenAny额外从SlabAllocator分配一个共享状态(其余的子任务在它返回之后还会继续执行)
+- 协程帧从SlabAllocator分配，在一个线程上创建、在另一个线程上执行完毕销毁也不经过malloc
+- 分离的协程(detach)抛出的异常保存在返回的CoDetached中，join()时重新抛出
+*/
+
+template<typename T> class CoTask;
+class CoDetached;
+
+// 协程的返回值为void时，组合器的结果中用std::monostate占位
+template<typename T>
+using CoResult = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+// 子任务执行完毕时的通知，组合器和syncWait用它代替直接恢复等待者
+class CoJoin {
+public:
+    // 一个子任务执行完毕，返回接下来要在当前线程恢复的协程，没有时返回std::noop_coroutine()
+    // 返回之后子任务的协程帧随时可能被销毁
+    virtual std::coroutine_handle<> arrive() noexcept = 0;
+
+protected:
+    ~CoJoin() = default;
+};
+
+// 分离的协程和CoDetached共享的状态，从SlabAllocator分配，两边各持有一份引用
+class CoDetachState {
+public:
+    // 协程执行完毕，协程帧已经销毁
+    void finish(std::exception_ptr error) noexcept {
+        error_ = std::move(error);
+        latch_.countDown();
+        release();
+    }
+
+    void release() noexcept {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            SlabAllocator::destroy(this);
+        }
+    }
+
+    BatchLatch latch_ { 1 };
+    std::exception_ptr error_; // latch_归零之后才能读取
+    std::atomic<uint32_t> refs_ {2};
+};
+
+// 各种返回值类型的promise共用的部分
+class CoPromiseBase {
+public:
+    // 最终挂起点：恢复等待者，或者通知组合器，或者销毁分离的协程
+    class FinalAwaiter {
+    public:
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            CoPromiseBase &promise = handle.promise();
+            if (promise.join_ != nullptr) {
+                return promise.join_->arrive();
+            }
+            if (promise.continuation_) {
+                return promise.continuation_;
+            }
+            if (CoDetachState *detached = promise.detached_) {
+                // 异常交给CoDetached，先销毁协程帧再通知，join()返回时协程帧已经释放
+                std::exception_ptr error = std::move(promise.error_);
+                handle.destroy();
+                detached->finish(std::move(error));
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    // 协程帧的分配，超过SlabAllocator::MAX_SIZE的大帧由它转交给operator new
+    static void* operator new(size_t size) {
+        return SlabAllocator::allocate(size);
+    }
+    static void operator delete(void *ptr, size_t size) noexcept {
+        SlabAllocator::deallocate(ptr, size);
+    }
+
+    std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() const noexcept {
+        return {};
+    }
+
+    void unhandled_exception() noexcept {
+        error_ = std::current_exception();
+    }
+
+protected:
+    template<typename T> friend class CoTask;
+
+    void rethrowIfFailed() const {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    std::coroutine_handle<> continuation_; // co_await这个协程的等待者
+    CoJoin *join_ = nullptr;               // 由组合器或syncWait启动时的完成通知
+    CoDetachState *detached_ = nullptr;    // 分离之后执行完毕时自行销毁，并把异常交给CoDetached
+    std::exception_ptr error_;
+};
+
+template<typename T>
+class CoPromise : public CoPromiseBase {
+public:
+    CoTask<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U &&value) {
+        value_.emplace(std::forward<U>(value));
+    }
+
+    T result() {
+        rethrowIfFailed();
+        return std::move(*value_);
+    }
+
+private:
+    std::optional<T> value_;
+};
+
+template<>
+class CoPromise<void> : public CoPromiseBase {
+public:
+    CoTask<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result() {
+        rethrowIfFailed();
+    }
+};
+
+// 惰性协程任务，只能移动，析构时销毁还没有分离的协程帧
+// 协程执行期间(已经开始、还没有执行完毕)CoTask不能析构
+template<typename T = void>
+class CoTask {
+public:
+    using promise_type = CoPromise<T>;
+
+    CoTask() = default;
+    explicit CoTask(std::coroutine_handle<promise_type> handle)
+        : handle_(handle)
+    {}
+
+    CoTask(CoTask &&other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr))
+    {}
+
+    CoTask& operator=(CoTask &&other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+
+    ~CoTask() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool isValid() const {
+        return static_cast<bool>(handle_);
+    }
+
+    bool isReady() const {
+        return handle_ && handle_.done();
+    }
+
+    // co_await task：在当前线程开始执行task，执行完毕后由执行完它的线程恢复当前协程
+    auto operator co_await() noexcept {
+        class Awaiter {
+        public:
+            explicit Awaiter(std::coroutine_handle<promise_type> handle)
+                : handle_(handle)
+            {}
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+                handle_.promise().continuation_ = awaiter;
+                return handle_;
+            }
+
+            T await_resume() {
+                return handle_.promise().result();
+            }
+
+        private:
+            std::coroutine_handle<promise_type> handle_;
+        };
+        return Awaiter(handle_);
+    }
+
+    // 在当前线程开始执行，执行完毕时通知join而不是恢复等待者，供组合器和syncWait使用
+    void start(CoJoin *join) {
+        handle_.promise().join_ = join;
+        handle_.resume();
+    }
+
+    // 取出执行完毕的结果，协程抛出的异常在这里重新抛出
+    T result() {
+        return handle_.promise().result();
+    }
+
+    // 在当前线程开始执行并且不再等待它，协程执行完毕后自行销毁
+    // 返回的CoDetached可以等待协程执行完毕并取得它抛出的异常，不关心时直接丢弃
+    CoDetached detach() &&;
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// detach()的返回值，只能移动
+// 不调用join()直接析构时协程照常执行完毕，它抛出的异常被丢弃
+class CoDetached {
+public:
+    CoDetached() = default;
+    explicit CoDetached(CoDetachState *state)
+        : state_(state)
+    {}
+
+    CoDetached(CoDetached &&other) noexcept
+        : state_(std::exchange(other.state_, nullptr))
+    {}
+
+    CoDetached& operator=(CoDetached &&other) noexcept {
+        if (this != &other) {
+            reset();
+            state_ = std::exchange(other.state_, nullptr);
+        }
+        return *this;
+    }
+
+    CoDetached(const CoDetached&) = delete;
+    CoDetached& operator=(const CoDetached&) = delete;
+
+    ~CoDetached() {
+        reset();
+    }
+
+    bool isValid() const {
+        return state_ != nullptr;
+    }
+
+    bool isDone() const {
+        return state_ != nullptr && state_->latch_.isDone();
+    }
+
+    // 等待协程执行完毕，它抛出的异常在这里重新抛出；在工作线程上等待时帮线程池执行其他任务
+    void join() {
+        if (state_ == nullptr) {
+            throw std::logic_error("CoDetached: nothing to join");
+        }
+        state_->latch_.wait();
+        std::exception_ptr error = std::move(state_->error_);
+        reset();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    void reset() {
+        if (state_ != nullptr) {
+            std::exchange(state_, nullptr)->release();
+        }
+    }
+
+    CoDetachState *state_ = nullptr;
+};
+
+template<typename T>
+CoDetached CoTask<T>::detach() && {
+    std::coroutine_handle<promise_type> handle = std::exchange(handle_, nullptr);
+    CoDetachState *state = SlabAllocator::create<CoDetachState>();
+    handle.promise().detached_ = state;
+    handle.resume();
+    return CoDetached(state);
+}
+
+template<typename T>
+CoTask<T> CoPromise<T>::get_return_object() noexcept {
+    return CoTask<T>(std::coroutine_handle<CoPromise<T>>::from_promise(*this));
+}
+
+inline CoTask<void> CoPromise<void>::get_return_object() noexcept {
+    return CoTask<void>(std::coroutine_handle<CoPromise<void>>::from_promise(*this));
+}
+
+// 取出子任务的结果，void的子任务得到std::monostate
+template<typename T>
+CoResult<T> takeCoResult(CoTask<T> &task) {
+    if constexpr (std::is_void_v<T>) {
+        task.result();
+        return std::monostate();
+    } else {
+        return task.result();
+    }
+}
+
+// 在当前线程执行task并阻塞等待结果，用于从普通函数进入协程
+// 不要在线程池的线程中调用，等待期间这个线程不会执行其他任务
+template<typename T>
+T syncWait(CoTask<T> task) {
+    class LatchJoin : public CoJoin {
+    public:
+        std::coroutine_handle<> arrive() noexcept override {
+            latch_.countDown();
+            return std::noop_coroutine();
+        }
+
+        BatchLatch latch_ { 1 };
+    };
+
+    LatchJoin join;
+    task.start(&join);
+    join.latch_.wait();
+    return task.result();
+}
+
+// whenAll的等待体：依次启动所有子任务，最后一个执行完毕的子任务恢复等待者
+// 计数多出的1归等待者自己：子任务在启动过程中就全部执行完毕时，由等待者直接继续，不需要挂起
+template<typename StartAll>
+class WhenAllAwaiter : public CoJoin {
+public:
+    WhenAllAwaiter(size_t count, StartAll startAll)
+        : remaining_(count + 1),
+          startAll_(std::move(startAll))
+    {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> waiter) {
+        waiter_ = waiter;
+        startAll_(static_cast<CoJoin*>(this));
+        return remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+
+    void await_resume() const noexcept {}
+
+    std::coroutine_handle<> arrive() noexcept override {
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            return waiter_;
+        }
+        return std::noop_coroutine();
+    }
+
+private:
+    std::atomic<size_t> remaining_;
+    std::coroutine_handle<> waiter_;
+    StartAll startAll_;
+};
+
+// 等待所有子任务执行完毕，按顺序返回各自的结果
+// 有子任务抛出异常时，等全部执行完毕后重新抛出顺序最靠前的那个异常
+template<typename T>
+CoTask<std::conditional_t<std::is_void_v<T>, void, std::vector<T>>> whenAll(std::vector<CoTask<T>> tasks) {
+    co_await WhenAllAwaiter(tasks.size(), [&tasks](CoJoin *join) {
+        for (auto &task : tasks) {
+            task.start(join);
+        }
+    });
+    if constexpr (std::is_void_v<T>) {
+        for (auto &task : tasks) {
+            task.result();
+        }
+    } else {
+        std::vector<T> values;
+        values.reserve(tasks.size());
+        for (auto &task : tasks) {
+            values.push_back(task.result());
+        }
+        co_return values;
+    }
+}
+
+template<typename... Ts>
+CoTask<std::tuple<CoResult<Ts>...>> whenAll(CoTask<Ts>... tasks) {
+    co_await WhenAllAwaiter(sizeof...(Ts), [&](CoJoin *join) {
+        (tasks.start(join), ...);
+    });
+    // 花括号初始化保证按从左到右的顺序取结果
+    co_return std::tuple<CoResult<Ts>...> { takeCoResult(tasks)... };
+}
+
+// whenAny的结果：最先执行完毕的子任务的下标和它的结果
+template<typename T>
+struct WhenAnyResult {
+    size_t index;
+    CoResult<T> value;
+};
+
+// whenAny的共享状态，由等待者和每个子任务各持有一份引用，子任务的协程帧也归它所有
+// 等待者恢复之后其余的子任务还在执行，最后一个执行完毕的子任务释放整个状态
+template<typename T>
+class WhenAnyState {
+public:
+    explicit WhenAnyState(std::vector<CoTask<T>> tasks)
+        : tasks_(std::move(tasks)),
+          refs_(tasks_.size() + 1)
+    {
+        slots_.reserve(tasks_.size());
+        for (size_t i = 0; i < tasks_.size(); i ++) {
+            slots_.emplace_back(this, i);
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> waiter) {
+        waiter_ = waiter;
+        for (size_t i = 0; i < tasks_.size(); i ++) {
+            tasks_[i].start(&slots_[i]);
+        }
+        // 启动过程中已经有子任务执行完毕时不挂起
+        return pending_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+
+    void await_resume() const noexcept {}
+
+    WhenAnyResult<T> takeResult() {
+        size_t index = winner_.load(std::memory_order_acquire);
+        return WhenAnyResult<T> { index, takeCoResult(tasks_[index]) };
+    }
+
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            SlabAllocator::destroy(this);
+        }
+    }
+
+private:
+    // 每个子任务一个通知，用来区分是哪个子任务执行完毕
+    class Slot : public CoJoin {
+    public:
+        Slot(WhenAnyState *state, size_t index)
+            : state_(state),
+              index_(index)
+        {}
+
+        std::coroutine_handle<> arrive() noexcept override {
+            return state_->arrive(index_);
+        }
+
+    private:
+        WhenAnyState *state_;
+        size_t index_;
+    };
+
+    std::coroutine_handle<> arrive(size_t index) noexcept {
+        std::coroutine_handle<> next = std::noop_coroutine();
+        size_t none = NO_WINNER;
+        if (winner_.compare_exchange_strong(none, index, std::memory_order_acq_rel)) {
+            // 等待者和第一个执行完毕的子任务，后到的一方负责恢复等待者
+            if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                next = waiter_;
+            }
+        }
+        release(); // 可能销毁包括当前子任务在内的所有协程帧
+        return next;
+    }
+
+    static constexpr size_t NO_WINNER = static_cast<size_t>(-1);
+
+    std::vector<CoTask<T>> tasks_;
+    std::vector<Slot> slots_;
+    std::atomic<size_t> refs_;
+    std::atomic<size_t> pending_ {2};
+    std::atomic<size_t> winner_ {NO_WINNER};
+    std::coroutine_handle<> waiter_;
+};
+
+// 等待最先执行完毕的子任务，返回它的下标和结果(它抛出的异常在这里重新抛出)
+// 其余的子任务在后台继续执行直到结束，结果和异常被丢弃，它们引用的对象需要保证一直有效
+// tasks为空时抛出std::invalid_argument
+template<typename T>
+CoTask<WhenAnyResult<T>> whenAny(std::vector<CoTask<T>> tasks) {
+    if (tasks.empty()) {
+        throw std::invalid_argument("whenAny: no tasks");
+    }
+    struct StateRef {
+        ~StateRef() {
+            state_->release();
+        }
+        WhenAnyState<T> *state_;
+    };
+    StateRef ref { SlabAllocator::create<WhenAnyState<T>>(std::move(tasks)) };
+    co_await *ref.state_;
+    co_return ref.state_->takeResult();
+}
+
+#endif
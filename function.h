@@ -0,0 +1,146 @@
+#ifndef FUNCTION_H
+#define FUNCTION_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "slab.h"
+
+template<typename Signature, size_t InlineSize = 64>
+class MoveOnlyFunction;
+
+/*
+只能移动的函数对象，相当于带小对象优化的std::function
+- 不要求可调用对象可以拷贝，所以可以捕获std::promise、unique_ptr等只能移动的对象
+- 不超过InlineSize字节、并且移动不抛异常的可调用对象直接存放在内部，不需要堆分配，放不下的从SlabAllocator分配
+- 用函数指针表代替虚函数，不依赖RTTI
+*/
+template<typename R, typename... Args, size_t InlineSize>
+class MoveOnlyFunction<R(Args...), InlineSize> {
+public:
+    MoveOnlyFunction() noexcept = default;
+    MoveOnlyFunction(std::nullptr_t) noexcept {}
+    ~MoveOnlyFunction() {
+        reset();
+    }
+
+    MoveOnlyFunction(const MoveOnlyFunction&) = delete;
+    MoveOnlyFunction& operator=(const MoveOnlyFunction&) = delete;
+
+    MoveOnlyFunction(MoveOnlyFunction &&other) noexcept {
+        moveFrom(other);
+    }
+    MoveOnlyFunction& operator=(MoveOnlyFunction &&other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+    MoveOnlyFunction& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    template<typename F, typename D = std::decay_t<F>,
+             typename = std::enable_if_t<!std::is_same_v<D, MoveOnlyFunction> && std::is_invocable_r_v<R, D&, Args...>>>
+    MoveOnlyFunction(F &&func) {
+        if constexpr (isInline<D>) {
+            ::new (static_cast<void*>(storage_.buf_)) D(std::forward<F>(func));
+        } else {
+            storage_.heap_ = SlabAllocator::create<D>(std::forward<F>(func));
+        }
+        ops_ = &opsOf<D>;
+    }
+
+    R operator()(Args... args) {
+        return ops_->invoke_(data(), std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept {
+        return ops_ != nullptr;
+    }
+
+    bool operator==(std::nullptr_t) const noexcept {
+        return ops_ == nullptr;
+    }
+
+    // 可调用对象是否存放在内部缓冲区中(没有堆分配)
+    bool isInlineStored() const noexcept {
+        return ops_ != nullptr && ops_->inline_;
+    }
+
+    void reset() noexcept {
+        if (ops_ != nullptr) {
+            ops_->destroy_(*this);
+            ops_ = nullptr;
+        }
+    }
+
+    // 某个可调用类型能否存放在内部缓冲区中
+    template<typename F>
+    static constexpr bool isInline = sizeof(F) <= InlineSize
+                                  && alignof(std::max_align_t) % alignof(F) == 0
+                                  && std::is_nothrow_move_constructible_v<F>;
+
+private:
+    struct Ops {
+        bool inline_;
+        R (*invoke_)(void *func, Args&&... args);
+        void (*move_)(MoveOnlyFunction &dst, MoveOnlyFunction &src) noexcept;
+        void (*destroy_)(MoveOnlyFunction &self) noexcept;
+    };
+
+    template<typename F>
+    static R invokeImpl(void *func, Args&&... args) {
+        return std::invoke(*static_cast<F*>(func), std::forward<Args>(args)...);
+    }
+
+    template<typename F>
+    static void moveImpl(MoveOnlyFunction &dst, MoveOnlyFunction &src) noexcept {
+        if constexpr (isInline<F>) {
+            F *from = reinterpret_cast<F*>(src.storage_.buf_);
+            ::new (static_cast<void*>(dst.storage_.buf_)) F(std::move(*from));
+            from->~F();
+        } else {
+            dst.storage_.heap_ = src.storage_.heap_;
+        }
+    }
+
+    template<typename F>
+    static void destroyImpl(MoveOnlyFunction &self) noexcept {
+        if constexpr (isInline<F>) {
+            reinterpret_cast<F*>(self.storage_.buf_)->~F();
+        } else {
+            SlabAllocator::destroy(static_cast<F*>(self.storage_.heap_));
+        }
+    }
+
+    template<typename F>
+    static constexpr Ops opsOf = { isInline<F>, &invokeImpl<F>, &moveImpl<F>, &destroyImpl<F> };
+
+    void* data() {
+        return ops_->inline_ ? static_cast<void*>(storage_.buf_) : storage_.heap_;
+    }
+
+    void moveFrom(MoveOnlyFunction &other) noexcept {
+        if (other.ops_ != nullptr) {
+            other.ops_->move_(*this, other);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    union Storage {
+        alignas(std::max_align_t) unsigned char buf_[InlineSize];
+        void *heap_;
+    };
+
+    Storage storage_;
+    const Ops *ops_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+在一个32位原子变量上睡眠/唤醒，Linux下直接使用futex系统调用，其他平台退化为C++20的atomic::wait
+和mutex + condition_variable相比，没有等待者时唤醒方只需要一次原子操作，不进入内核
+*/
+
+// 自旋等待时降低CPU功耗，并让出超线程的执行资源
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+#ifdef __linux__
+
+// 如果word仍等于expected就睡眠，直到被唤醒(可能虚假唤醒，调用者需要循环检查条件)
+inline void futexWait(std::atomic<uint32_t> &word, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+// 带超时的futexWait，超时返回false，其他情况(被唤醒、值已改变、虚假唤醒)返回true
+inline bool futexWaitFor(std::atomic<uint32_t> &word, uint32_t expected, std::chrono::nanoseconds timeout) {
+    if (timeout <= std::chrono::nanoseconds::zero()) {
+        return false;
+    }
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    long ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+    return !(ret == -1 && errno == ETIMEDOUT);
+}
+
+inline void futexWakeOne(std::atomic<uint32_t> &word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+inline void futexWakeAll(std::atomic<uint32_t> &word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+inline void futexWait(std::atomic<uint32_t> &word, uint32_t expected) {
+    word.wait(expected);
+}
+
+// atomic::wait没有超时版本，退化为逐步加长的短暂睡眠
+inline bool futexWaitFor(std::atomic<uint32_t> &word, uint32_t expected, std::chrono::nanoseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    auto pause = std::chrono::microseconds(50);
+    while (word.load(std::memory_order_acquire) == expected) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(pause, deadline - now));
+        pause = std::min(pause * 2, std::chrono::microseconds(1000));
+    }
+    return true;
+}
+
+inline void futexWakeOne(std::atomic<uint32_t> &word) {
+    word.notify_one();
+}
+
+inline void futexWakeAll(std::atomic<uint32_t> &word) {
+    word.notify_all();
+}
+
+#endif
+
+#endif
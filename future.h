@@ -0,0 +1,495 @@
+#ifndef FUTURE_H
+#define FUTURE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "function.h"
+#include "futex.h"
+#include "slab.h"
+
+template<typename T> class Future;
+template<typename T> class Promise;
+
+// then的回调参数：T为void时回调没有参数，否则参数为T
+template<typename T, typename F>
+struct ThenResult {
+    using type = std::invoke_result_t<std::decay_t<F>&, T>;
+};
+
+template<typename F>
+struct ThenResult<void, F> {
+    using type = std::invoke_result_t<std::decay_t<F>&>;
+};
+
+/*
+等待结果的线程如果是某个执行器(例如线程池)的工作线程，等待期间可以帮它执行其他任务
+- 递归的分治任务在工作线程上等待子任务时，自己先把子任务执行掉，不会出现所有线程都阻塞在等待上的死锁，也不需要额外的线程
+- 执行器在自己的线程上通过setCurrent登记，Future::get/wait、Result::get、BatchResult::waitAll都会使用它
+- 线程池的Result在等待之前先把还在队列中的那个任务领走直接执行，等待的子任务已经在别的线程上执行时才帮忙执行其他任务
+- 注意：帮忙执行的可能是任意任务，等待之前不要持有其他任务也会获取的锁；帮忙执行的任务可能让带超时的等待晚一些返回
+*/
+class WaitHelper {
+public:
+    // 执行一个其他的任务，没有可以执行的任务时返回false
+    virtual bool helpOnce() = 0;
+
+    // 当前线程登记的WaitHelper，没有时为nullptr
+    static WaitHelper* current() {
+        return current_;
+    }
+    static void setCurrent(WaitHelper *helper) {
+        current_ = helper;
+    }
+
+    // 等到ready()为真或者超过deadline，返回ready()
+    // 有任务时一直帮忙执行；没有任务时调用block(deadline)睡一小会儿，睡眠时间逐步加长，期间提交的任务最多延迟1ms被看到
+    template<typename Ready, typename Block>
+    bool helpUntil(std::chrono::steady_clock::time_point deadline, Ready ready, Block block) {
+        auto backoff = MIN_BACKOFF;
+        while (!ready()) {
+            if (helpOnce()) {
+                backoff = MIN_BACKOFF;
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            block(deadline - now < backoff ? deadline : now + backoff);
+            backoff = std::min(backoff * 2, MAX_BACKOFF);
+        }
+        return true;
+    }
+
+protected:
+    ~WaitHelper() = default;
+
+private:
+    static constexpr std::chrono::microseconds MIN_BACKOFF { 16 };
+    static constexpr std::chrono::microseconds MAX_BACKOFF { 1000 };
+
+    static inline thread_local WaitHelper *current_ = nullptr;
+};
+
+/*
+Future和Promise之间共享的状态
+所有的同步都围绕一个32位原子状态字：
+- STATE_READY        结果(值或异常)已经写入
+- STATE_WAITING      有线程在futex上睡眠，写入结果的一方需要唤醒
+- STATE_CONTINUATION 已经挂上了后续操作，写入结果的一方负责执行它
+等待方先自旋一小段时间，结果还没有出来再在状态字上futex睡眠；没有等待者时写入结果不进入内核
+*/
+class SharedStateBase {
+public:
+    enum : uint32_t {
+        STATE_READY = 1,
+        STATE_WAITING = 2,
+        STATE_CONTINUATION = 4,
+    };
+
+    SharedStateBase() = default;
+    virtual ~SharedStateBase() = default;
+
+    SharedStateBase(const SharedStateBase&) = delete;
+    SharedStateBase& operator=(const SharedStateBase&) = delete;
+
+    // 共享状态在提交者线程上创建，最后一个引用常常在工作线程上释放，从SlabAllocator分配
+    // 析构函数是虚函数，delete this时size是实际类型的大小
+    static void* operator new(size_t size) {
+        return SlabAllocator::allocate(size);
+    }
+    static void* operator new(size_t size, std::align_val_t align) {
+        return SlabAllocator::allocate(size, static_cast<size_t>(align));
+    }
+    static void operator delete(void *ptr, size_t size) noexcept {
+        SlabAllocator::deallocate(ptr, size);
+    }
+    static void operator delete(void *ptr, size_t size, std::align_val_t align) noexcept {
+        SlabAllocator::deallocate(ptr, size, static_cast<size_t>(align));
+    }
+
+    void addRef() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    bool isReady() const {
+        return state_.load(std::memory_order_acquire) & STATE_READY;
+    }
+
+    void wait() {
+        if (spinUntilReady()) {
+            return;
+        }
+        if (WaitHelper *helper = WaitHelper::current()) {
+            helper->helpUntil(std::chrono::steady_clock::time_point::max(), [this]() { return isReady(); },
+                              [this](std::chrono::steady_clock::time_point until) { blockUntil(until); });
+            return;
+        }
+        for (;;) {
+            uint32_t s = state_.load(std::memory_order_acquire);
+            if (s & STATE_READY) {
+                return;
+            }
+            if (!(s & STATE_WAITING)
+                && !state_.compare_exchange_weak(s, s | STATE_WAITING, std::memory_order_acq_rel)) {
+                continue;
+            }
+            futexWait(state_, s | STATE_WAITING);
+        }
+    }
+
+    // 等到结果写入或超时，返回结果是否已经写入
+    bool waitUntil(std::chrono::steady_clock::time_point deadline) {
+        if (spinUntilReady()) {
+            return true;
+        }
+        if (WaitHelper *helper = WaitHelper::current()) {
+            return helper->helpUntil(deadline, [this]() { return isReady(); },
+                                     [this](std::chrono::steady_clock::time_point until) { blockUntil(until); });
+        }
+        return blockUntil(deadline);
+    }
+
+    // 在状态字上睡眠，直到结果写入或超时
+    bool blockUntil(std::chrono::steady_clock::time_point deadline) {
+        for (;;) {
+            uint32_t s = state_.load(std::memory_order_acquire);
+            if (s & STATE_READY) {
+                return true;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return false;
+            }
+            if (!(s & STATE_WAITING)
+                && !state_.compare_exchange_weak(s, s | STATE_WAITING, std::memory_order_acq_rel)) {
+                continue;
+            }
+            futexWaitFor(state_, s | STATE_WAITING, deadline - now);
+        }
+    }
+
+    // 挂上结果写入后要执行的操作，由写入结果的线程执行；如果结果已经写入，当前线程立即执行
+    // 每个状态只能挂一个后续操作
+    void setContinuation(MoveOnlyFunction<void()> func) {
+        continuation_ = std::move(func);
+        uint32_t prev = state_.fetch_or(STATE_CONTINUATION, std::memory_order_acq_rel);
+        if (prev & STATE_READY) {
+            runContinuation();
+        }
+    }
+
+    void setException(std::exception_ptr error) {
+        error_ = std::move(error);
+        markReady();
+    }
+
+    bool hasException() const {
+        return error_ != nullptr;
+    }
+
+    void rethrowIfException() {
+        if (error_ != nullptr) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+protected:
+    // 发布结果，唤醒等待者，执行后续操作
+    void markReady() {
+        uint32_t prev = state_.fetch_or(STATE_READY, std::memory_order_acq_rel);
+        if (prev & STATE_WAITING) {
+            futexWakeAll(state_);
+        }
+        if (prev & STATE_CONTINUATION) {
+            runContinuation();
+        }
+    }
+
+private:
+    static constexpr int SPIN_COUNT = 128;
+
+    bool spinUntilReady() {
+        for (int i = 0; i < SPIN_COUNT; i ++) {
+            if (isReady()) {
+                return true;
+            }
+            cpuRelax();
+        }
+        return isReady();
+    }
+
+    void runContinuation() {
+        MoveOnlyFunction<void()> func = std::move(continuation_);
+        func();
+    }
+
+private:
+    std::atomic<uint32_t> state_ {0};
+    std::atomic<uint32_t> refs_ {1};
+    std::exception_ptr error_;
+    MoveOnlyFunction<void()> continuation_;
+};
+
+template<typename T>
+class SharedState : public SharedStateBase {
+public:
+    // void用monostate占位，这样值的存取不需要为void单独写一套
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    template<typename... Args>
+    void setValue(Args&&... args) {
+        value_.emplace(std::forward<Args>(args)...);
+        markReady();
+    }
+
+    Value& value() {
+        return *value_;
+    }
+
+private:
+    std::optional<Value> value_;
+};
+
+/*
+轻量的future，用法和std::future基本一致
+- 可以安全地移动，结果保存在共享状态中，和Future对象的地址无关
+- get()只能调用一次，之后valid()为false
+- then(executor, func)在结果写入后把func投递到executor(例如线程池)上执行，不占用任何阻塞的线程
+*/
+template<typename T>
+class Future {
+public:
+    Future() = default;
+    ~Future() {
+        if (state_ != nullptr) {
+            state_->release();
+        }
+    }
+
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    Future(Future &&other) noexcept
+        : state_(std::exchange(other.state_, nullptr))
+    {}
+    Future& operator=(Future &&other) noexcept {
+        if (this != &other) {
+            if (state_ != nullptr) {
+                state_->release();
+            }
+            state_ = std::exchange(other.state_, nullptr);
+        }
+        return *this;
+    }
+
+    bool valid() const {
+        return state_ != nullptr;
+    }
+
+    bool isReady() const {
+        checkState();
+        return state_->isReady();
+    }
+
+    void wait() const {
+        checkState();
+        state_->wait();
+    }
+
+    template<typename Rep, typename Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period> &timeout) const {
+        return wait_until(std::chrono::steady_clock::now() + timeout);
+    }
+
+    template<typename Clock, typename Duration>
+    std::future_status wait_until(const std::chrono::time_point<Clock, Duration> &deadline) const {
+        checkState();
+        auto steadyDeadline = std::chrono::steady_clock::now()
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(deadline - Clock::now());
+        return state_->waitUntil(steadyDeadline) ? std::future_status::ready : std::future_status::timeout;
+    }
+
+    // 等待并取出结果，任务抛出的异常会在这里重新抛出
+    T get() {
+        checkState();
+        state_->wait();
+        SharedState<T> *state = std::exchange(state_, nullptr);
+        struct Releaser {
+            SharedState<T> *state;
+            ~Releaser() { state->release(); }
+        } releaser { state };
+
+        state->rethrowIfException();
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(state->value());
+        }
+    }
+
+    // 结果写入后，把func投递到executor上执行，返回func结果的Future
+    // func的参数是T(T为void时没有参数)；如果当前结果是异常，func不会执行，异常直接传给返回的Future
+    // executor需要提供post(MoveOnlyFunction<void()>)
+    template<typename Executor, typename F>
+    auto then(Executor &executor, F &&func) {
+        using R = typename ThenResult<T, F>::type;
+        checkState();
+
+        Promise<R> promise;
+        Future<R> next = promise.getFuture();
+        SharedState<T> *state = std::exchange(state_, nullptr);
+
+        state->setContinuation([&executor, state, promise = std::move(promise), func = std::forward<F>(func)]() mutable {
+            executor.post([state, promise = std::move(promise), func = std::move(func)]() mutable {
+                Future<T> source(state);
+                try {
+                    if constexpr (std::is_void_v<T>) {
+                        source.get();
+                        promise.setValueFrom(func);
+                    } else {
+                        promise.setValueFrom(func, source.get());
+                    }
+                } catch (...) {
+                    promise.setException(std::current_exception());
+                }
+            });
+        });
+        return next;
+    }
+
+    // 结果写入后在写入结果的线程上直接执行func，func不应该阻塞
+    // 给批量等待、完成队列等内部组件使用，不转移结果的所有权
+    template<typename F>
+    void onReady(F &&func) {
+        checkState();
+        state_->setContinuation(MoveOnlyFunction<void()>(std::forward<F>(func)));
+    }
+
+private:
+    template<typename> friend class Promise;
+    template<typename> friend class Future;
+
+    explicit Future(SharedState<T> *state)
+        : state_(state)
+    {}
+
+    void checkState() const {
+        if (state_ == nullptr) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+    }
+
+    SharedState<T> *state_ = nullptr;
+};
+
+template<typename T>
+class Promise {
+public:
+    Promise()
+        : state_(new SharedState<T>())
+    {}
+
+    // 不带共享状态的空Promise，需要时再移动赋值一个新的Promise
+    explicit Promise(std::nullptr_t)
+        : state_(nullptr)
+    {}
+
+    // 没有写入结果就析构时，等待者会收到broken_promise异常，不会永远阻塞
+    ~Promise() {
+        abandon();
+    }
+
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    Promise(Promise &&other) noexcept
+        : state_(std::exchange(other.state_, nullptr)),
+          retrieved_(other.retrieved_)
+    {}
+    Promise& operator=(Promise &&other) noexcept {
+        if (this != &other) {
+            abandon();
+            state_ = std::exchange(other.state_, nullptr);
+            retrieved_ = other.retrieved_;
+        }
+        return *this;
+    }
+
+    bool valid() const {
+        return state_ != nullptr;
+    }
+
+    Future<T> getFuture() {
+        if (state_ == nullptr) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        if (retrieved_) {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+        retrieved_ = true;
+        state_->addRef();
+        return Future<T>(state_);
+    }
+
+    template<typename... Args>
+    void setValue(Args&&... args) {
+        SharedState<T> *state = take();
+        state->setValue(std::forward<Args>(args)...);
+        state->release();
+    }
+
+    void setException(std::exception_ptr error) {
+        SharedState<T> *state = take();
+        state->setException(std::move(error));
+        state->release();
+    }
+
+    // 调用func，把返回值(或抛出的异常)写入结果
+    template<typename F, typename... Args>
+    void setValueFrom(F &func, Args&&... args) {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                func(std::forward<Args>(args)...);
+                setValue();
+            } else {
+                setValue(func(std::forward<Args>(args)...));
+            }
+        } catch (...) {
+            setException(std::current_exception());
+        }
+    }
+
+    // 放弃这个结果，等待者收到broken_promise异常
+    void abandon() {
+        if (state_ != nullptr) {
+            setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+
+private:
+    SharedState<T>* take() {
+        if (state_ == nullptr) {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+        return std::exchange(state_, nullptr);
+    }
+
+    SharedState<T> *state_;
+    bool retrieved_ = false;
+};
+
+#endif
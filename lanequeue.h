@@ -0,0 +1,342 @@
+#ifndef LANEQUEUE_H
+#define LANEQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ringbuffer.h"
+
+/*
+带优先级车道和租户公平调度的任务队列
+- 车道之间严格按优先级出队，0号车道最高
+- 同一车道内，各个租户按权重轮转(weighted round-robin)：轮到的租户连续出队weight个任务后让给下一个租户
+- 老化：一个非空车道超过agingThreshold没有被服务过，下一次出队优先服务它，低优先级车道不会被饿死
+- 截止时间优先(EDF)：车道内不再按租户轮转，而是按截止时间从早到晚出队(小根堆)，截止时间相同的按入队顺序；
+  车道之间仍然按优先级和老化
+注意：不是线程安全的，需要调用者加锁；只有laneSize()可以不加锁读取
+*/
+template<typename T>
+class LaneQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit LaneQueue(size_t laneCount)
+        : lanes_(laneCount),
+          laneSizes_(std::make_unique<std::atomic<size_t>[]>(laneCount))
+    {}
+
+    LaneQueue(const LaneQueue&) = delete;
+    LaneQueue& operator=(const LaneQueue&) = delete;
+
+    // 设置租户的权重，至少为1
+    void setWeight(uint32_t tenant, uint32_t weight) {
+        weights_[tenant] = weight > 0 ? weight : 1;
+    }
+
+    // 车道内按截止时间出队，只能在队列为空时切换
+    void setDeadlineOrder(bool enabled) {
+        deadlineOrder_ = enabled;
+    }
+
+    // 非空车道最长多久没有被服务就强制服务一次，zero表示不做老化
+    void setAgingThreshold(Clock::duration threshold) {
+        agingThreshold_ = threshold;
+    }
+
+    // deadline只在截止时间优先时使用
+    void push(T item, size_t lane, uint32_t tenant, Clock::time_point deadline = Clock::time_point::max()) {
+        Lane &l = lanes_[lane];
+        if (l.size == 0 && agingThreshold_ != Clock::duration::zero()) {
+            l.since = Clock::now();
+        }
+
+        if (deadlineOrder_) {
+            l.heap.push_back(DeadlineEntry { deadline, nextSeq_ ++, std::move(item) });
+            std::push_heap(l.heap.begin(), l.heap.end(), laterFirst);
+            l.size ++;
+            size_ ++;
+            laneSizes_[lane].store(l.size, std::memory_order_relaxed);
+            return;
+        }
+
+        auto it = l.index.find(tenant);
+        if (it == l.index.end()) {
+            // 优先复用已经取空的租户留下的下标和队列
+            if (!l.freeSlots.empty()) {
+                it = l.index.emplace(tenant, l.freeSlots.back()).first;
+                l.freeSlots.pop_back();
+                l.ids[it->second] = tenant;
+            } else {
+                it = l.index.emplace(tenant, l.tenants.size()).first;
+                l.tenants.emplace_back(std::make_unique<RingBuffer<T>>(16));
+                l.ids.push_back(tenant);
+            }
+        }
+        size_t t = it->second;
+        if (l.tenants[t]->empty()) {
+            // 租户从空变为非空，排到轮转的末尾
+            if (l.active.empty()) {
+                l.credit = weightOf(l, t);
+            }
+            l.active.emplace(t);
+        }
+        l.tenants[t]->emplace(std::move(item));
+
+        l.size ++;
+        size_ ++;
+        laneSizes_[lane].store(l.size, std::memory_order_relaxed);
+    }
+
+    // 按照 老化车道 > 优先级 > 租户轮转 的顺序出队一个元素
+    bool pop(T &item) {
+        size_t lane = 0;
+        if (!agedLane(lane, 2) && !firstLane(lane)) {
+            return false;
+        }
+        popFrom(lane, item);
+        return true;
+    }
+
+    // 只取最高优先级车道或者已经老化的车道中的元素，其他情况返回false
+    // 给同时有其他任务来源(无锁环形队列、本地队列)的消费者使用，先服务紧急的任务
+    bool popUrgent(T &item) {
+        size_t lane = 0;
+        if (!agedLane(lane, 1)) {
+            if (lanes_[0].size == 0) {
+                return false;
+            }
+            lane = 0;
+        }
+        popFrom(lane, item);
+        return true;
+    }
+
+    // 取出最低优先级的非空车道中、当前租户最早入队的元素，给POLICY_DROP_OLDEST丢弃
+    // 只考虑droppable返回true的元素：当前租户的队首不能丢弃时，按轮转顺序找下一个能丢弃的元素
+    // 截止时间优先时取车道中最早入队的元素，需要遍历整个堆，只在队列满时发生
+    template<typename Pred>
+    bool popOldest(T &item, Pred droppable) {
+        for (size_t i = lanes_.size(); i -- > 0; ) {
+            Lane &l = lanes_[i];
+            if (l.size == 0) {
+                continue;
+            }
+            if (deadlineOrder_) {
+                auto oldest = l.heap.end();
+                for (auto it = l.heap.begin(); it != l.heap.end(); ++ it) {
+                    if (droppable(it->item) && (oldest == l.heap.end() || it->seq < oldest->seq)) {
+                        oldest = it;
+                    }
+                }
+                if (oldest == l.heap.end()) {
+                    continue;
+                }
+                item = std::move(oldest->item);
+                *oldest = std::move(l.heap.back());
+                l.heap.pop_back();
+                std::make_heap(l.heap.begin(), l.heap.end(), laterFirst);
+                l.size --;
+                size_ --;
+                laneSizes_[i].store(l.size, std::memory_order_relaxed);
+                return true;
+            }
+            for (size_t a = 0; a < l.active.size(); a ++) {
+                size_t t = l.active.at(a);
+                RingBuffer<T> &q = *l.tenants[t];
+                for (size_t j = 0; j < q.size(); j ++) {
+                    if (!droppable(q.at(j))) {
+                        continue;
+                    }
+                    if (a == 0 && j == 0) {
+                        takeFrom(i, t, item);
+                    } else {
+                        eraseFrom(i, a, j, item);
+                    }
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    size_t laneCount() const {
+        return lanes_.size();
+    }
+
+    // 某个车道中的元素数量，可以不加锁读取
+    size_t laneSize(size_t lane) const {
+        return laneSizes_[lane].load(std::memory_order_relaxed);
+    }
+
+    // 某个车道中还有元素的租户数量，取空的租户不再占用记录
+    size_t tenantCount(size_t lane) const {
+        return lanes_[lane].index.size();
+    }
+
+private:
+    struct DeadlineEntry {
+        Clock::time_point deadline;
+        uint64_t seq; // 入队顺序
+        T item;
+    };
+
+    // 堆顶是截止时间最早、最先入队的元素
+    static bool laterFirst(const DeadlineEntry &a, const DeadlineEntry &b) {
+        return a.deadline != b.deadline ? a.deadline > b.deadline : a.seq > b.seq;
+    }
+
+    struct Lane {
+        std::vector<std::unique_ptr<RingBuffer<T>>> tenants; // 每个租户的FIFO，取空的租户的下标会被复用
+        std::unordered_map<uint32_t, size_t> index;           // 租户id -> tenants下标
+        std::vector<uint32_t> ids;                            // tenants下标 -> 租户id
+        std::vector<size_t> freeSlots;                        // 取空的租户归还的tenants下标，给新出现的租户复用
+        RingBuffer<size_t> active { 16 };                    // 有元素的租户，按轮转顺序排列，队首是当前租户
+        uint32_t credit = 0;                                  // 当前租户本轮还能连续出队的数量
+        std::vector<DeadlineEntry> heap;                      // 截止时间优先时代替tenants
+        size_t size = 0;
+        Clock::time_point since;                              // 车道上一次被服务(或者从空变为非空)的时间
+    };
+
+    uint32_t weightOf(const Lane &l, size_t t) const {
+        auto it = weights_.find(l.ids[t]);
+        return it == weights_.end() ? 1 : it->second;
+    }
+
+    // 找出等待最久、并且已经超过老化阈值的非空车道
+    // 非空车道少于minNonEmpty个时没有竞争，不需要读时钟
+    bool agedLane(size_t &lane, size_t minNonEmpty) {
+        if (agingThreshold_ == Clock::duration::zero()) {
+            return false;
+        }
+        size_t nonEmpty = 0;
+        for (auto &l : lanes_) {
+            nonEmpty += l.size > 0;
+        }
+        if (nonEmpty < minNonEmpty) {
+            return false;
+        }
+
+        auto now = Clock::now();
+        bool found = false;
+        Clock::time_point oldest = now - agingThreshold_;
+        for (size_t i = 1; i < lanes_.size(); i ++) {
+            if (lanes_[i].size > 0 && lanes_[i].since <= oldest) {
+                oldest = lanes_[i].since;
+                lane = i;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    bool firstLane(size_t &lane) const {
+        for (size_t i = 0; i < lanes_.size(); i ++) {
+            if (lanes_[i].size > 0) {
+                lane = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void popFrom(size_t lane, T &item) {
+        Lane &l = lanes_[lane];
+        if (deadlineOrder_) {
+            std::pop_heap(l.heap.begin(), l.heap.end(), laterFirst);
+            item = std::move(l.heap.back().item);
+            l.heap.pop_back();
+            l.size --;
+            size_ --;
+            laneSizes_[lane].store(l.size, std::memory_order_relaxed);
+        } else {
+            takeFrom(lane, l.active.front(), item);
+        }
+        // 只有开启老化时才需要记录服务时间
+        if (l.size > 0 && agingThreshold_ != Clock::duration::zero()) {
+            l.since = Clock::now();
+        }
+    }
+
+    // 从车道lane的租户t中取出队首元素，并推进轮转
+    void takeFrom(size_t lane, size_t t, T &item) {
+        Lane &l = lanes_[lane];
+        RingBuffer<T> &q = *l.tenants[t];
+        item = std::move(q.front());
+        q.pop();
+
+        // t总是轮转队首的当前租户
+        if (l.credit > 0) {
+            l.credit --;
+        }
+        if (q.empty() || l.credit == 0) {
+            // 当前租户取空了，或者本轮的配额用完了，轮到下一个租户
+            l.active.pop();
+            if (!q.empty()) {
+                l.active.emplace(t);
+            } else {
+                releaseTenant(l, t);
+            }
+            if (!l.active.empty()) {
+                l.credit = weightOf(l, l.active.front());
+            }
+        }
+
+        l.size --;
+        size_ --;
+        laneSizes_[lane].store(l.size, std::memory_order_relaxed);
+    }
+
+    // 租户取空并退出了轮转，本轮剩下的配额随之作废：删除它的记录，下标和队列留给之后出现的租户
+    // 租户id来自调用者(例如每个连接一个)，不回收的话映射会随着出现过的租户数量一直增长
+    void releaseTenant(Lane &l, size_t t) {
+        l.index.erase(l.ids[t]);
+        l.freeSlots.push_back(t);
+    }
+
+    // 从车道lane轮转中第a个租户的队列里删除第j个元素，不推进轮转，只给popOldest使用
+    void eraseFrom(size_t lane, size_t a, size_t j, T &item) {
+        Lane &l = lanes_[lane];
+        size_t t = l.active.at(a);
+        RingBuffer<T> &q = *l.tenants[t];
+        item = std::move(q.at(j));
+        q.erase(j);
+        if (q.empty()) {
+            // 租户取空了，退出轮转；退出的是当前租户时轮到下一个
+            l.active.erase(a);
+            releaseTenant(l, t);
+            if (a == 0 && !l.active.empty()) {
+                l.credit = weightOf(l, l.active.front());
+            }
+        }
+
+        l.size --;
+        size_ --;
+        laneSizes_[lane].store(l.size, std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<Lane> lanes_;
+    std::unique_ptr<std::atomic<size_t>[]> laneSizes_;    // 各个车道的元素数量，给监控不加锁读取
+    std::unordered_map<uint32_t, uint32_t> weights_;     // 租户id -> 权重，没有设置的租户权重为1
+    Clock::duration agingThreshold_ = Clock::duration::zero();
+    bool deadlineOrder_ = false;
+    uint64_t nextSeq_ = 0;
+    size_t size_ = 0;
+};
+
+#endif
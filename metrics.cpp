@@ -0,0 +1,150 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <sstream>
+
+// --------- 实现LatencyHistogram类
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < BUCKET_COUNT; i ++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::bucketLow(size_t bucket) {
+    if (bucket < SUB_COUNT) {
+        return bucket;
+    }
+    unsigned exponent = static_cast<unsigned>(bucket / SUB_COUNT) + SUB_BITS - 1;
+    uint64_t sub = bucket % SUB_COUNT;
+    return (SUB_COUNT + sub) << (exponent - SUB_BITS);
+}
+
+uint64_t LatencyHistogram::bucketWidth(size_t bucket) {
+    if (bucket < SUB_COUNT) {
+        return 1;
+    }
+    unsigned exponent = static_cast<unsigned>(bucket / SUB_COUNT) + SUB_BITS - 1;
+    return uint64_t(1) << (exponent - SUB_BITS);
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    q = std::clamp(q, 0.0, 1.0);
+    // 第rank个值(从1开始)所在的桶
+    uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(q * static_cast<double>(count_) + 0.5), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i ++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            // 桶的中点不会超过实际记录到的最大值
+            return std::min(bucketLow(i) + bucketWidth(i) / 2, max_);
+        }
+    }
+    return max_;
+}
+
+
+// --------- 实现ConcurrentHistogram类
+void ConcurrentHistogram::addTo(LatencyHistogram &out) const {
+    for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; i ++) {
+        out.counts_[i] += counts_[i].load(std::memory_order_relaxed);
+    }
+    out.count_ += count_.load(std::memory_order_relaxed);
+    out.sum_ += sum_.load(std::memory_order_relaxed);
+    out.max_ = std::max(out.max_, max_.load(std::memory_order_relaxed));
+}
+
+
+// --------- 实现MetricsSnapshot类
+// 以秒为单位输出，Prometheus约定时长的单位是秒
+static double seconds(uint64_t ns) {
+    return static_cast<double>(ns) / 1e9;
+}
+
+static void writeSummary(std::ostringstream &out, const std::string &name, const std::string &help,
+                         const LatencyHistogram &hist) {
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << " summary\n";
+    for (double q : { 0.5, 0.9, 0.99, 0.999 }) {
+        out << name << "{quantile=\"" << q << "\"} " << seconds(hist.percentile(q)) << '\n';
+    }
+    out << name << "_sum " << seconds(hist.sum()) << '\n';
+    out << name << "_count " << hist.count() << '\n';
+}
+
+static void writeGauge(std::ostringstream &out, const std::string &name, const std::string &help, size_t value) {
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << " gauge\n";
+    out << name << ' ' << value << '\n';
+}
+
+// 每个线程一条样本的计数器
+template<typename Get>
+static void writeWorkerCounter(std::ostringstream &out, const std::string &name, const std::string &help,
+                               const std::vector<WorkerStats> &workers, Get get) {
+    out << "# HELP " << name << ' ' << help << '\n';
+    out << "# TYPE " << name << " counter\n";
+    for (const WorkerStats &w : workers) {
+        out << name << "{worker=\"" << w.slot << "\"} " << get(w) << '\n';
+    }
+}
+
+std::string MetricsSnapshot::toPrometheus(const std::string &prefix) const {
+    std::ostringstream out;
+    writeGauge(out, prefix + "_threads", "Current number of worker threads.", threads);
+    writeGauge(out, prefix + "_idle_threads", "Worker threads not running a task.", idleThreads);
+    writeGauge(out, prefix + "_parked_threads", "Worker threads asleep waiting for work.", parkedThreads);
+    writeGauge(out, prefix + "_blocked_threads", "Worker threads inside a blocking section.", blockedThreads);
+    writeGauge(out, prefix + "_spare_threads", "Extra threads started to cover blocked workers.", spareThreads);
+    writeGauge(out, prefix + "_pending_tasks", "Tasks submitted but not yet started.", pendingTasks);
+
+    out << "# HELP " << prefix << "_lane_depth Tasks waiting in each priority lane.\n";
+    out << "# TYPE " << prefix << "_lane_depth gauge\n";
+    static const char *laneNames[] = { "high", "normal", "low" };
+    for (size_t i = 0; i < laneDepth.size(); i ++) {
+        out << prefix << "_lane_depth{lane=\"" << (i < 3 ? laneNames[i] : std::to_string(i).c_str()) << "\"} "
+            << laneDepth[i] << '\n';
+    }
+
+    out << "# HELP " << prefix << "_dropped_tasks_total Tasks discarded by POLICY_DROP_OLDEST.\n";
+    out << "# TYPE " << prefix << "_dropped_tasks_total counter\n";
+    out << prefix << "_dropped_tasks_total " << droppedTasks << '\n';
+
+    out << "# HELP " << prefix << "_expired_tasks_total Tasks skipped at dequeue because their deadline had passed.\n";
+    out << "# TYPE " << prefix << "_expired_tasks_total counter\n";
+    out << prefix << "_expired_tasks_total " << expiredTasks << '\n';
+
+    out << "# HELP " << prefix << "_cancelled_tasks_total Tasks skipped at dequeue because they were cancelled.\n";
+    out << "# TYPE " << prefix << "_cancelled_tasks_total counter\n";
+    out << prefix << "_cancelled_tasks_total " << cancelledTasks << '\n';
+
+    out << "# HELP " << prefix << "_failed_tasks_total Exceptions thrown by tasks without a result channel.\n";
+    out << "# TYPE " << prefix << "_failed_tasks_total counter\n";
+    out << prefix << "_failed_tasks_total " << failedTasks << '\n';
+
+    if (!enabled) {
+        return out.str();
+    }
+
+    writeWorkerCounter(out, prefix + "_tasks_total", "Tasks run by each worker.", workers,
+                       [](const WorkerStats &w) { return std::to_string(w.tasks); });
+    writeWorkerCounter(out, prefix + "_busy_seconds_total", "Time each worker spent running tasks.", workers,
+                       [](const WorkerStats &w) { return std::to_string(seconds(w.busyNs)); });
+    writeWorkerCounter(out, prefix + "_idle_seconds_total", "Time each worker spent between tasks.", workers,
+                       [](const WorkerStats &w) { return std::to_string(seconds(w.idleNs)); });
+    writeWorkerCounter(out, prefix + "_steals_total", "Tasks each worker took from another worker or node.", workers,
+                       [](const WorkerStats &w) { return std::to_string(w.steals); });
+    writeWorkerCounter(out, prefix + "_parks_total", "Times each worker went to sleep.", workers,
+                       [](const WorkerStats &w) { return std::to_string(w.parks); });
+    writeWorkerCounter(out, prefix + "_helped_total", "Tasks each worker ran while waiting on a result.", workers,
+                       [](const WorkerStats &w) { return std::to_string(w.helped); });
+
+    writeSummary(out, prefix + "_queue_wait_seconds", "Time from submission to start of execution.", queueWait);
+    writeSummary(out, prefix + "_run_seconds", "Task execution time.", runTime);
+    return out.str();
+}
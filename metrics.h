@@ -0,0 +1,152 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 为0时线程池的热路径上没有任何计数和读时钟的代码，snapshot()只返回各个队列和线程数量的瞬时值
+#ifndef THREADPOOL_METRICS
+#define THREADPOOL_METRICS 1
+#endif
+
+// 只有一个写者的计数器，读-改-写不需要原子的RMW指令，其他线程随时可以读取
+inline void relaxedAdd(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+class ConcurrentHistogram;
+
+/*
+HDR风格的对数-线性直方图，记录以纳秒为单位的时长
+- 按最高位分组(2的幂)，每组再线性分成32个桶，任意值的相对误差不超过1/32
+- 小于32ns的值每个值一个桶，超过2^40ns(约18分钟)的值计入最后一个桶
+- 桶的数量固定，记录一个值只是一次位运算和一次加法，不分配内存
+*/
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 5;
+    static constexpr unsigned SUB_COUNT = 1u << SUB_BITS;
+    static constexpr unsigned MAX_EXPONENT = 40;
+    static constexpr size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BITS + 2) * SUB_COUNT;
+
+    void record(uint64_t ns) {
+        counts_[bucketOf(ns)] ++;
+        count_ ++;
+        sum_ += ns;
+        if (ns > max_) {
+            max_ = ns;
+        }
+    }
+
+    void merge(const LatencyHistogram &other);
+
+    uint64_t count() const { return count_; }
+    uint64_t sum() const { return sum_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ > 0 ? static_cast<double>(sum_) / count_ : 0.0; }
+    // q取值[0, 1]，返回该分位所在桶的中点，没有记录时返回0
+    uint64_t percentile(double q) const;
+
+    static size_t bucketOf(uint64_t ns) {
+        if (ns < SUB_COUNT) {
+            return static_cast<size_t>(ns);
+        }
+        unsigned exponent = 63u - static_cast<unsigned>(__builtin_clzll(ns));
+        if (exponent > MAX_EXPONENT) {
+            return BUCKET_COUNT - 1;
+        }
+        size_t sub = static_cast<size_t>(ns >> (exponent - SUB_BITS)) & (SUB_COUNT - 1);
+        return (exponent - SUB_BITS + 1) * SUB_COUNT + sub;
+    }
+    // 桶的下界和宽度
+    static uint64_t bucketLow(size_t bucket);
+    static uint64_t bucketWidth(size_t bucket);
+
+private:
+    friend class ConcurrentHistogram;
+
+    std::array<uint64_t, BUCKET_COUNT> counts_ {};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+// 只由所属线程写入、其他线程随时可以读取的直方图，桶和LatencyHistogram相同
+// 读取时各个桶之间不是同一瞬间的值，相差的只是正在记录的那一两个样本
+class ConcurrentHistogram {
+public:
+    void record(uint64_t ns) {
+        relaxedAdd(counts_[LatencyHistogram::bucketOf(ns)]);
+        relaxedAdd(count_);
+        relaxedAdd(sum_, ns);
+        if (ns > max_.load(std::memory_order_relaxed)) {
+            max_.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    // 把当前的计数累加到out
+    void addTo(LatencyHistogram &out) const;
+
+private:
+    std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> counts_ {};
+    std::atomic<uint64_t> count_ {0};
+    std::atomic<uint64_t> sum_ {0};
+    std::atomic<uint64_t> max_ {0};
+};
+
+// 每个线程私有的计数，只由所属线程写入，snapshot()在其他线程上读取
+// 独占缓存行，不同线程的计数之间没有伪共享
+struct alignas(64) WorkerMetrics {
+    std::atomic<uint64_t> tasks_ {0};  // 执行的任务数量
+    std::atomic<uint64_t> busyNs_ {0}; // 执行任务的总时长
+    std::atomic<uint64_t> idleNs_ {0}; // 两个任务之间空闲的总时长
+    std::atomic<uint64_t> steals_ {0}; // 从其他线程或其他节点取得的任务数量
+    std::atomic<uint64_t> parks_ {0};  // 真正挂起(进入内核睡眠)的次数
+    std::atomic<uint64_t> helps_ {0};  // 等待结果期间执行的任务数量(所等待的任务或其他任务)，不计入tasks_
+    ConcurrentHistogram queueWait_;    // 任务从入队到开始执行的时长
+    ConcurrentHistogram runTime_;      // 任务执行的时长
+};
+
+// 一个线程的计数快照
+struct WorkerStats {
+    size_t slot = 0;
+    uint64_t tasks = 0;
+    uint64_t busyNs = 0;
+    uint64_t idleNs = 0;
+    uint64_t steals = 0;
+    uint64_t parks = 0;
+    uint64_t helped = 0;
+};
+
+// ThreadPool::snapshot()的返回值
+struct MetricsSnapshot {
+    bool enabled = THREADPOOL_METRICS; // 编译时关闭了计数时为false，只有瞬时值有意义
+
+    // 瞬时值
+    size_t threads = 0;        // 线程数量
+    size_t idleThreads = 0;    // 没有在执行任务的线程数量
+    size_t parkedThreads = 0;  // 挂起中的线程数量
+    size_t blockedThreads = 0; // 处于BlockingGuard中的线程数量
+    size_t spareThreads = 0;   // 为了顶替阻塞的线程而启用的备用线程数量(包含在threads中)
+    size_t pendingTasks = 0;   // 已经提交、还没有开始执行的任务数量(包括本地队列)
+    std::vector<size_t> laneDepth; // 各个优先级车道的深度，下标为TaskPriority
+    size_t droppedTasks = 0;   // POLICY_DROP_OLDEST丢弃的任务数量
+    size_t expiredTasks = 0;   // 出队时超过截止时间、没有执行的任务数量
+    size_t cancelledTasks = 0; // 出队时已经取消、没有执行的任务数量
+    size_t failedTasks = 0;    // 没有结果通道的任务(post)抛出异常的次数
+
+    // 累计值
+    std::vector<WorkerStats> workers; // 曾经运行过线程的每个slot
+    WorkerStats total;                // 所有线程之和，slot无意义
+    LatencyHistogram queueWait;
+    LatencyHistogram runTime;
+
+    // Prometheus文本格式，prefix是每个指标名称的前缀
+    std::string toPrometheus(const std::string &prefix = "threadpool") const;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/*
+有界无锁多生产者多消费者环形队列 (Dmitry Vyukov 的 bounded MPMC queue)
+- 容量向上取整为2的幂，下标通过位与取模
+- 每个槽位带一个序号seq，生产者和消费者通过比较序号判断槽位是否可写/可读，
+  只在入队、出队位置上各做一次CAS，没有任何锁
+- 队列满时tryPush立即返回false，队列空时tryPop立即返回false，阻塞与否由调用者决定
+*/
+template<typename T>
+class BoundedMPMCQueue {
+public:
+    explicit BoundedMPMCQueue(size_t capacity)
+        : enqueuePos_(0),
+          dequeuePos_(0) {
+        size_t cap = 2;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        mask_ = cap - 1;
+        cells_ = std::make_unique<Cell[]>(cap);
+        for (size_t i = 0; i < cap; i ++) {
+            cells_[i].seq_.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~BoundedMPMCQueue() = default;
+
+    BoundedMPMCQueue(const BoundedMPMCQueue&) = delete;
+    BoundedMPMCQueue& operator=(const BoundedMPMCQueue&) = delete;
+
+    // 入队，队列满时返回false，data保持不变
+    bool tryPush(T &data) {
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // 槽位空闲，抢占入队位置
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽位上一轮的数据还没被取走，队列已满
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data_ = std::move(data);
+        cell->seq_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 出队，队列空时返回false
+    bool tryPop(T &data) {
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽位还没有被写入，队列为空
+                return false;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        data = std::move(cell->data_);
+        // 序号前进一整圈，供下一轮的生产者使用
+        cell->seq_.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    // 近似的元素数量，仅作为参考
+    size_t size() const {
+        size_t e = enqueuePos_.load(std::memory_order_relaxed);
+        size_t d = dequeuePos_.load(std::memory_order_relaxed);
+        return e > d ? e - d : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq_;
+        T data_;
+    };
+
+    // 生产者和消费者的位置放在不同的缓存行，避免伪共享
+    alignas(64) std::atomic<size_t> enqueuePos_;
+    alignas(64) std::atomic<size_t> dequeuePos_;
+    alignas(64) size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+};
+
+#endif
@@ -0,0 +1,316 @@
+#include "pipeline.h"
+
+#include <stdexcept>
+#include <utility>
+
+// 令牌：一个数据项在流水线中的全部状态，本身就是投递给线程池的任务
+class Pipeline::Token : public Task {
+public:
+    static constexpr size_t SOURCE = static_cast<size_t>(-1);
+
+    explicit Token(Pipeline *pipeline)
+        : pipeline_(pipeline)
+    {}
+
+    Any run() override {
+        if (stage_ == SOURCE) {
+            pipeline_->produce(this);
+        } else {
+            pipeline_->runOwned(this, stage_);
+        }
+        return Any();
+    }
+
+    Pipeline *pipeline_;
+    Any item_;                // 当前阶段的输入
+    uint64_t seq_ = 0;        // 数据源产生它的顺序
+    size_t stage_ = SOURCE;   // 投递给线程池后从哪里继续：执行数据源，或者处理已经占用的串行阶段
+    Token *next_ = nullptr;   // 在空闲令牌栈或者乱序阶段的收件箱中时指向下一个令牌
+};
+
+
+// 阶段：并行阶段只有处理函数，串行阶段还有缓冲区和占用状态
+class Pipeline::Stage {
+public:
+    Stage(StageMode mode, MoveOnlyFunction<Any(Any)> func, size_t tokens)
+        : mode_(mode),
+          func_(std::move(func)),
+          slotSize_(mode == StageMode::STAGE_SERIAL_IN_ORDER ? tokens : 0),
+          slots_(std::make_unique<std::atomic<Token*>[]>(slotSize_))
+    {}
+
+    // 每次运行前重置占用状态，上一次运行结束时缓冲区一定是空的
+    void reset() {
+        pending_.store(0, std::memory_order_relaxed);
+        nextSeq_.store(0, std::memory_order_relaxed);
+    }
+
+    // 数据项到达串行阶段，占用了阶段时返回接下来要处理的数据项，否则数据项留在缓冲区，返回nullptr
+    Token* enter(Token *token) {
+        if (mode_ == StageMode::STAGE_SERIAL_OUT_OF_ORDER) {
+            // 先入收件箱再计数，计数从0变为1的线程占用阶段，处理的是最早到达的数据项，不一定是自己带来的那个
+            pushToken(inbox_, token);
+            return pending_.fetch_add(1, std::memory_order_acq_rel) == 0 ? popQueued() : nullptr;
+        }
+
+        uint64_t seq = token->seq_;
+        if (nextSeq_.load(std::memory_order_acquire) == seq) {
+            return token;
+        }
+        // 序号在[nextSeq_, nextSeq_ + 令牌数量)之内，每个槽位同时最多只有一个数据项
+        std::atomic<Token*> &slot = slots_[seq % slotSize_];
+        slot.store(token, std::memory_order_seq_cst);
+        // 放入槽位的同时前一个数据项可能刚好处理完：它先推进序号再查看槽位，两边至少有一方能看到对方，由领到的一方处理
+        Token *expected = token;
+        if (nextSeq_.load(std::memory_order_seq_cst) == seq
+            && slot.compare_exchange_strong(expected, nullptr, std::memory_order_seq_cst)) {
+            return token;
+        }
+        return nullptr;
+    }
+
+    // 处理完一个数据项，缓冲区中还有可以处理的数据项时返回它，阶段继续被占用
+    Token* leave(Token *token) {
+        if (mode_ == StageMode::STAGE_SERIAL_OUT_OF_ORDER) {
+            return pending_.fetch_sub(1, std::memory_order_acq_rel) == 1 ? nullptr : popQueued();
+        }
+        uint64_t next = token->seq_ + 1;
+        nextSeq_.store(next, std::memory_order_seq_cst);
+        return slots_[next % slotSize_].exchange(nullptr, std::memory_order_seq_cst);
+    }
+
+    StageMode mode_;
+    MoveOnlyFunction<Any(Any)> func_;
+
+private:
+    // 取出最早到达的数据项，收件箱里的数据项整批取出后反转成先到先处理
+    // 计数中的数据项都已经放进收件箱(先入收件箱再计数)，这里一定能取到，不需要等待
+    Token* popQueued() {
+        while (ready_ == nullptr) {
+            Token *list = inbox_.exchange(nullptr, std::memory_order_acquire);
+            while (list != nullptr) {
+                Token *next = list->next_;
+                list->next_ = ready_;
+                ready_ = list;
+                list = next;
+            }
+        }
+        Token *token = ready_;
+        ready_ = token->next_;
+        token->next_ = nullptr;
+        return token;
+    }
+
+    std::atomic<Token*> inbox_ {nullptr};            // 乱序阶段新到达的数据项，后到的在栈顶
+    Token *ready_ = nullptr;                         // 已经从收件箱取出、按到达顺序排好的数据项，只由占用阶段的线程访问
+    std::atomic<size_t> pending_ {0};                // 乱序阶段到达了还没有处理完的数据项数量
+    size_t slotSize_;
+    std::unique_ptr<std::atomic<Token*>[]> slots_;   // 有序阶段的缓冲区，按序号对令牌数量取模
+    std::atomic<uint64_t> nextSeq_ {0};              // 有序阶段下一个要处理的序号
+};
+
+// --------- 实现Pipeline类
+Pipeline::Pipeline(size_t tokens) {
+    tokens = std::max<size_t>(tokens, 1);
+    tokens_.reserve(tokens);
+    for (size_t i = 0; i < tokens; i ++) {
+        tokens_.emplace_back(std::make_unique<Token>(this));
+        pushToken(freeTokens_, tokens_.back().get());
+    }
+}
+
+Pipeline::~Pipeline() {
+    waitUntil(std::chrono::steady_clock::time_point::max());
+}
+
+void Pipeline::setSource(MoveOnlyFunction<bool(Any&)> source) {
+    source_ = std::move(source);
+}
+
+void Pipeline::addStage(StageMode mode, MoveOnlyFunction<Any(Any)> func) {
+    stages_.emplace_back(std::make_unique<Stage>(mode, std::move(func), tokens_.size()));
+}
+
+size_t Pipeline::size() const {
+    return stages_.size();
+}
+
+void Pipeline::run(ThreadPool &pool) {
+    if (!isDone()) {
+        throw std::logic_error("Pipeline: previous run has not finished");
+    }
+    if (!source_) {
+        throw std::logic_error("Pipeline: no source");
+    }
+
+    pool_ = &pool;
+    failed_ = false;
+    error_ = nullptr;
+    nextSeq_ = 0;
+    for (auto &stage : stages_) {
+        stage->reset();
+    }
+    remaining_.store(1, std::memory_order_relaxed);
+    sourceDone_.store(false, std::memory_order_release);
+    tryStartSource();
+}
+
+void Pipeline::wait() {
+    waitUntil(std::chrono::steady_clock::time_point::max());
+    if (error_ != nullptr) {
+        std::rethrow_exception(error_);
+    }
+}
+
+bool Pipeline::waitFor(std::chrono::milliseconds timeout) {
+    return waitUntil(std::chrono::steady_clock::now() + timeout);
+}
+
+bool Pipeline::waitUntil(std::chrono::steady_clock::time_point deadline) {
+    // 在工作线程上等待时帮线程池执行其他任务(包括流水线自己的令牌)，固定大小的线程池不会因为等待而死锁
+    if (WaitHelper *helper = WaitHelper::current()) {
+        return helper->helpUntil(deadline, [this]() { return isDone(); },
+                                 [this](std::chrono::steady_clock::time_point until) { blockUntil(until); });
+    }
+    return blockUntil(deadline);
+}
+
+bool Pipeline::blockUntil(std::chrono::steady_clock::time_point deadline) {
+    while (uint32_t r = remaining_.load(std::memory_order_acquire)) {
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            futexWait(remaining_, r);
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        futexWaitFor(remaining_, r, deadline - now);
+    }
+    return true;
+}
+
+bool Pipeline::isDone() const {
+    return remaining_.load(std::memory_order_acquire) == 0;
+}
+
+void Pipeline::pushToken(std::atomic<Token*> &head, Token *token) {
+    Token *top = head.load(std::memory_order_relaxed);
+    do {
+        token->next_ = top;
+    } while (!head.compare_exchange_weak(top, token, std::memory_order_seq_cst, std::memory_order_relaxed));
+}
+
+void Pipeline::tryStartSource() {
+    for (;;) {
+        if (sourceDone_.load(std::memory_order_acquire) || freeTokens_.load(std::memory_order_seq_cst) == nullptr) {
+            return;
+        }
+        bool expected = false;
+        if (!sourceActive_.compare_exchange_strong(expected, true, std::memory_order_seq_cst)) {
+            return;
+        }
+        // 只有占用数据源的线程会取走令牌，栈顶的令牌不会被别人取走再放回来，没有ABA问题
+        Token *token = freeTokens_.load(std::memory_order_seq_cst);
+        while (token != nullptr
+               && !freeTokens_.compare_exchange_weak(token, token->next_, std::memory_order_seq_cst, std::memory_order_seq_cst)) {}
+        if (token != nullptr) {
+            token->next_ = nullptr;
+            token->stage_ = Token::SOURCE;
+            pool_->postInternal(*token, SubmitOptions());
+            return;
+        }
+        // 放下标记之前归还令牌的一方看到数据源被占用会直接返回，这里再检查一次
+        sourceActive_.store(false, std::memory_order_seq_cst);
+    }
+}
+
+void Pipeline::produce(Token *token) {
+    bool more = false;
+    if (!failed_.load(std::memory_order_relaxed)) {
+        try {
+            more = source_(token->item_);
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }
+
+    if (!more) {
+        token->item_.reset();
+        sourceDone_.store(true, std::memory_order_release);
+        pushToken(freeTokens_, token);
+        sourceActive_.store(false, std::memory_order_release);
+        arrive(); // 这之后不能再访问流水线的任何成员
+        return;
+    }
+
+    token->seq_ = nextSeq_ ++;
+    remaining_.fetch_add(1, std::memory_order_relaxed);
+    // 还有空闲令牌时把数据源交给另一个线程继续执行，当前线程带着刚产生的数据项往下走
+    sourceActive_.store(false, std::memory_order_seq_cst);
+    tryStartSource();
+    carry(token, 0);
+}
+
+void Pipeline::carry(Token *token, size_t stage) {
+    for (size_t i = stage; i < stages_.size(); i ++) {
+        Stage &s = *stages_[i];
+        if (s.mode_ == StageMode::STAGE_PARALLEL) {
+            execute(s, token);
+            continue;
+        }
+        token = s.enter(token);
+        if (token == nullptr) {
+            // 阶段正被其他线程占用，数据项留在缓冲区里，由占用阶段的线程交给线程池
+            return;
+        }
+        runOwned(token, i);
+        return;
+    }
+    finish(token);
+}
+
+void Pipeline::runOwned(Token *token, size_t stage) {
+    Stage &s = *stages_[stage];
+    execute(s, token);
+    // 缓冲区里的下一个数据项交给线程池继续占用这个阶段，当前线程带着手上的数据项往下走
+    if (Token *next = s.leave(token)) {
+        next->stage_ = stage;
+        pool_->postInternal(*next, SubmitOptions());
+    }
+    carry(token, stage + 1);
+}
+
+void Pipeline::execute(Stage &stage, Token *token) {
+    // 已经有阶段失败时不再执行，但数据项依然走完流水线，保证有序阶段的序号连续、令牌被归还
+    if (failed_.load(std::memory_order_relaxed)) {
+        token->item_.reset();
+        return;
+    }
+    try {
+        token->item_ = stage.func_(std::move(token->item_));
+    } catch (...) {
+        token->item_.reset();
+        fail(std::current_exception());
+    }
+}
+
+void Pipeline::finish(Token *token) {
+    token->item_.reset();
+    pushToken(freeTokens_, token);
+    tryStartSource();
+    arrive(); // 这之后不能再访问流水线的任何成员
+}
+
+void Pipeline::fail(std::exception_ptr error) {
+    bool expected = false;
+    if (failed_.compare_exchange_strong(expected, true)) {
+        error_ = std::move(error);
+    }
+}
+
+void Pipeline::arrive() {
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        futexWakeAll(remaining_);
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include "threadpool.h"
+
+/*
+多阶段流水线：数据源逐个产生数据项，每个数据项依次经过各个阶段，不同的数据项在不同的阶段上同时进行
+example:
+Pipeline pipeline(16); // 最多16个数据项同时在流水线中
+pipeline.setSource([&](Any &item) {
+    std::string line;
+    if (!std::getline(in, line)) {
+        return false; // 没有更多数据
+    }
+    item = std::move(line);
+    return true;
+});
+pipeline.addStage(StageMode::STAGE_PARALLEL, [](Any item) -> Any {
+    return transform(item.cast_<std::string>());
+});
+pipeline.addStage(StageMode::STAGE_SERIAL_IN_ORDER, [&](Any item) -> Any {
+    out << item.cast_<std::string>() << '\n'; // 按输入的顺序写出
+    return Any();
+});
+pipeline.run(pool);
+pipeline.wait();
+
+- 每个数据项占用一个令牌，令牌用完时数据源暂停，直到有数据项走完整条流水线；流水线中的内存占用不超过令牌数量个数据项
+- 令牌本身就是投递给线程池的任务，在构造时一次分配好，运行时每个数据项不再分配内存
+- 一个线程拿到数据项后带着它一直往下走，数据始终在同一个核的缓存里；只有串行阶段正被其他线程占用时才把数据项留在
+  这个阶段的缓冲区里离开，占用这个阶段的线程处理完手上的数据项后，把缓冲区里的下一个交给线程池接着处理
+- 串行阶段的缓冲区都是无锁的，不会等待：乱序阶段用侵入式的无锁栈做收件箱，占用阶段的线程整批取出后反转成先到先处理；
+  有序阶段用按序号下标的槽位数组，容量是令牌数量
+- 令牌作为线程池的内部任务投递，队列满时不会被丢弃；在工作线程上wait()时帮线程池执行任务，固定大小的线程池也不会死锁
+- 数据源本身是串行的，产生数据项的顺序就是有序阶段的处理顺序
+*/
+
+enum class StageMode {
+    STAGE_SERIAL_IN_ORDER,     // 同一时刻只处理一个数据项，按数据源产生的顺序处理
+    STAGE_SERIAL_OUT_OF_ORDER, // 同一时刻只处理一个数据项，先到先处理
+    STAGE_PARALLEL,            // 多个数据项同时处理
+};
+
+class Pipeline {
+public:
+    // tokens是同时在流水线中的数据项上限，至少为1
+    explicit Pipeline(size_t tokens);
+    // 析构前等待正在进行的运行结束
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // 设置数据源：每次调用产生一个数据项写入item，返回false表示没有更多数据；调用是串行的
+    void setSource(MoveOnlyFunction<bool(Any&)> source);
+    // 按顺序添加阶段，func的参数是上一个阶段的返回值，最后一个阶段的返回值被丢弃
+    void addStage(StageMode mode, MoveOnlyFunction<Any(Any)> func);
+
+    size_t size() const;
+
+    // 开始运行，立即返回；上一次运行没有结束或者没有设置数据源时抛出std::logic_error
+    void run(ThreadPool &pool);
+
+    // 等待数据源结束并且所有数据项走完流水线，某个阶段抛出的异常会在这里重新抛出
+    // 有阶段抛出异常后数据源不再被调用，已经在流水线中的数据项不再执行后面的阶段
+    void wait();
+    // 最多等待timeout，运行已经结束返回true
+    bool waitFor(std::chrono::milliseconds timeout);
+    bool isDone() const;
+
+private:
+    class Token;
+    class Stage;
+    // 把令牌放入侵入式的无锁栈(Treiber栈)，空闲令牌和乱序阶段的收件箱共用
+    static void pushToken(std::atomic<Token*> &head, Token *token);
+
+    // 等到运行结束或者超过deadline，在工作线程上等待时帮忙执行其他任务
+    bool waitUntil(std::chrono::steady_clock::time_point deadline);
+    // 在remaining_上睡眠，直到运行结束或者超过deadline
+    bool blockUntil(std::chrono::steady_clock::time_point deadline);
+
+    // 尝试启动数据源：需要有空闲的令牌，并且数据源没有在执行
+    void tryStartSource();
+    // 调用一次数据源，产生的数据项由当前线程带着往下走
+    void produce(Token *token);
+    // 从第stage个阶段开始带着数据项往下走
+    void carry(Token *token, size_t stage);
+    // 当前线程已经占用了第stage个串行阶段，处理完数据项后释放阶段，再接着往下走
+    void runOwned(Token *token, size_t stage);
+    // 执行一个阶段，已经有阶段失败时不再执行
+    void execute(Stage &stage, Token *token);
+    // 数据项走完流水线，归还令牌
+    void finish(Token *token);
+    void fail(std::exception_ptr error);
+    // 数据源结束，或者一个数据项走完流水线
+    void arrive();
+
+    MoveOnlyFunction<bool(Any&)> source_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::vector<std::unique_ptr<Token>> tokens_;
+    std::atomic<Token*> freeTokens_ {nullptr}; // 空闲的令牌，侵入式的无锁栈，只有占用数据源的线程会取走令牌
+    std::atomic_bool sourceActive_ {false};    // 数据源正在执行，或者已经有一个令牌在等着执行它
+    std::atomic_bool sourceDone_ {true};       // 数据源已经结束
+    uint64_t nextSeq_ = 0;                     // 下一个数据项的序号，只由执行数据源的线程访问
+    ThreadPool *pool_ = nullptr;               // 本次运行所在的线程池
+
+    std::atomic<uint32_t> remaining_ {0};      // 流水线中的数据项数量，数据源没有结束时多计1，同时作为futex等待的变量
+    std::atomic_bool failed_ {false};          // 是否已经有阶段抛出异常
+    std::exception_ptr error_;                 // 第一个阶段抛出的异常
+};
+
+#endif
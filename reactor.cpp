@@ -0,0 +1,387 @@
+#include "reactor.h"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "futex.h"
+
+// 一次就绪最多读入的字节数，读不完的数据留给下一次投递，一个连接不能一直占着工作线程
+static const size_t MAX_READ_PER_DISPATCH = 256 * 1024;
+// 每次读之前保证的最小可写空间
+static const size_t MIN_READ_SPACE = 4096;
+
+// --------- 实现IoBuffer类
+void IoBuffer::consume(size_t n) {
+    begin_ += std::min(n, size());
+    // 数据全部处理完时回到开头，下次读入不需要挪动
+    if (begin_ == end_) {
+        begin_ = end_ = 0;
+    }
+}
+
+char* IoBuffer::prepare(size_t n) {
+    if (writable() < n) {
+        // 只挪动还没有处理的半个请求
+        if (begin_ > 0) {
+            std::memmove(data_.data(), data_.data() + begin_, size());
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (writable() < n) {
+            data_.resize(std::max(data_.size() * 2, end_ + n));
+        }
+    }
+    return data_.data() + end_;
+}
+
+void IoBuffer::append(std::string_view data) {
+    std::memcpy(prepare(data.size()), data.data(), data.size());
+    commit(data.size());
+}
+
+// --------- 实现Connection类
+void Connection::send(std::string_view data) {
+    if (failed_ || data.empty()) {
+        return;
+    }
+    // 前面还有暂存的数据时只能排在后面，保证顺序
+    if (output_.empty()) {
+        ssize_t n = ::send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                failed_ = true;
+                return;
+            }
+            n = 0;
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    if (!data.empty()) {
+        output_.append(data);
+    }
+}
+
+bool Connection::flush() {
+    while (!output_.empty()) {
+        std::string_view pending = output_.readable();
+        ssize_t n = ::send(fd_, pending.data(), pending.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        output_.consume(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+Any Connection::run() {
+    // 交还给reactor之后连接可能已经被释放，serve返回后不能再访问成员
+    reactor_->serve(*this);
+    return Any();
+}
+
+// --------- 实现IoReactor类
+struct IoReactor::Listener : IoChannel {
+    Listener(int fd, Handler handler)
+        : IoChannel(true),
+          fd_(fd),
+          handler_(std::move(handler))
+    {}
+
+    int fd_;
+    Handler handler_;
+};
+
+struct IoReactor::Loop {
+    int epfd_ = -1;
+    int wakefd_ = -1;                            // eventfd，注册到epoll时data.ptr为nullptr
+    std::thread thread_;
+    std::atomic<Connection*> completions_ {nullptr}; // 工作线程交还的连接，无锁栈
+    std::atomic_bool sleeping_ {false};          // reactor线程是否可能正在epoll_wait中睡眠
+    std::unordered_set<Connection*> connections_; // 本reactor上的连接，只由reactor线程访问(停止后由stop访问)
+};
+
+static std::system_error systemError(const char *what) {
+    return std::system_error(errno, std::system_category(), what);
+}
+
+IoReactor::IoReactor(ThreadPool &pool, size_t reactorThreads)
+    : pool_(pool)
+{
+    for (size_t i = 0; i < std::max<size_t>(reactorThreads, 1); i ++) {
+        auto loop = std::make_unique<Loop>();
+        loop->epfd_ = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakefd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->epfd_ < 0 || loop->wakefd_ < 0) {
+            throw systemError("IoReactor");
+        }
+        epoll_event ev {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        epoll_ctl(loop->epfd_, EPOLL_CTL_ADD, loop->wakefd_, &ev);
+        loops_.push_back(std::move(loop));
+    }
+}
+
+IoReactor::~IoReactor() {
+    stop();
+    for (auto &loop : loops_) {
+        ::close(loop->wakefd_);
+        ::close(loop->epfd_);
+    }
+}
+
+uint16_t IoReactor::listen(uint16_t port, Handler handler, const std::string &host) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw systemError("socket");
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        ::close(fd);
+        throw std::system_error(EINVAL, std::system_category(), "listen: bad address " + host);
+    }
+    socklen_t len = sizeof(addr);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), len) < 0 || ::listen(fd, SOMAXCONN) < 0
+        || getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+        std::system_error error = systemError("listen");
+        ::close(fd);
+        throw error;
+    }
+
+    std::lock_guard<std::mutex> lock(listenMtx_);
+    listeners_.push_back(std::make_unique<Listener>(fd, std::move(handler)));
+    // 监听套接字只注册在第一个reactor上，水平触发
+    epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = static_cast<IoChannel*>(listeners_.back().get());
+    epoll_ctl(loops_[0]->epfd_, EPOLL_CTL_ADD, fd, &ev);
+    return ntohs(addr.sin_port);
+}
+
+void IoReactor::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    stopping_ = false;
+    for (auto &loop : loops_) {
+        Loop *raw = loop.get();
+        loop->thread_ = std::thread([this, raw]() { runLoop(*raw); });
+    }
+}
+
+void IoReactor::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    stopping_ = true;
+    uint64_t one = 1;
+    for (auto &loop : loops_) {
+        [[maybe_unused]] ssize_t n = write(loop->wakefd_, &one, sizeof(one));
+    }
+    for (auto &loop : loops_) {
+        loop->thread_.join();
+    }
+
+    // 等正在工作线程上处理的连接全部交还
+    while (uint32_t n = inFlight_.load()) {
+        futexWait(inFlight_, n);
+    }
+
+    std::lock_guard<std::mutex> lock(listenMtx_);
+    for (auto &listener : listeners_) {
+        ::close(listener->fd_);
+    }
+    listeners_.clear();
+    for (auto &loop : loops_) {
+        // 完成链表中还没有注册的新连接也要关闭
+        Connection *conn = loop->completions_.exchange(nullptr, std::memory_order_acquire);
+        while (conn != nullptr) {
+            Connection *next = conn->nextCompletion_;
+            loop->connections_.insert(conn);
+            conn = next;
+        }
+        for (Connection *c : loop->connections_) {
+            ::close(c->fd_);
+            delete c;
+        }
+        connections_ -= loop->connections_.size();
+        loop->connections_.clear();
+    }
+}
+
+size_t IoReactor::connectionCount() const {
+    return connections_.load(std::memory_order_relaxed);
+}
+
+void IoReactor::runLoop(Loop &loop) {
+    const int MAX_EVENTS = 128;
+    epoll_event events[MAX_EVENTS];
+
+    while (!stopping_.load(std::memory_order_acquire)) {
+        drainCompletions(loop);
+
+        // 先声明要睡眠再检查完成链表，和complete中的先入链表再检查sleeping_配对，两边至少有一方看到对方
+        loop.sleeping_.store(true, std::memory_order_seq_cst);
+        int timeout = loop.completions_.load(std::memory_order_seq_cst) != nullptr ? 0 : -1;
+        int n = epoll_wait(loop.epfd_, events, MAX_EVENTS, timeout);
+        loop.sleeping_.store(false, std::memory_order_relaxed);
+
+        for (int i = 0; i < n; i ++) {
+            IoChannel *channel = static_cast<IoChannel*>(events[i].data.ptr);
+            if (channel == nullptr) {
+                uint64_t value;
+                [[maybe_unused]] ssize_t r = read(loop.wakefd_, &value, sizeof(value));
+                continue;
+            }
+            if (channel->listening_) {
+                acceptAll(*static_cast<Listener*>(channel));
+                continue;
+            }
+            // EPOLLONESHOT已经让这个连接暂停接收事件，交给工作线程
+            Connection *conn = static_cast<Connection*>(channel);
+            conn->events_ = events[i].events;
+            inFlight_.fetch_add(1, std::memory_order_relaxed);
+            pool_.postInternal(*conn, SubmitOptions());
+        }
+    }
+}
+
+void IoReactor::acceptAll(Listener &listener) {
+    for (;;) {
+        int fd = accept4(listener.fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN：已经接受完了；EMFILE等错误：监听套接字保持可读，下一轮再试
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        size_t target = nextLoop_.fetch_add(1, std::memory_order_relaxed) % loops_.size();
+        Connection *conn = new Connection(this, target, fd, &listener.handler_);
+        connections_.fetch_add(1, std::memory_order_relaxed);
+        // 由所属的reactor线程注册，连接集合只由它自己访问
+        conn->op_ = Connection::Op::OP_ADD;
+        pushCompletion(*loops_[target], conn);
+    }
+}
+
+void IoReactor::drainCompletions(Loop &loop) {
+    Connection *conn = loop.completions_.exchange(nullptr, std::memory_order_acquire);
+    while (conn != nullptr) {
+        Connection *next = conn->nextCompletion_;
+        epoll_event ev {};
+        ev.data.ptr = static_cast<IoChannel*>(conn);
+        switch (conn->op_) {
+        case Connection::Op::OP_ADD:
+            loop.connections_.insert(conn);
+            ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+            epoll_ctl(loop.epfd_, EPOLL_CTL_ADD, conn->fd_, &ev);
+            break;
+        case Connection::Op::OP_REARM:
+            ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT | (conn->output_.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+            epoll_ctl(loop.epfd_, EPOLL_CTL_MOD, conn->fd_, &ev);
+            break;
+        case Connection::Op::OP_CLOSE:
+            closeConnection(loop, conn);
+            break;
+        }
+        conn = next;
+    }
+}
+
+void IoReactor::closeConnection(Loop &loop, Connection *conn) {
+    epoll_ctl(loop.epfd_, EPOLL_CTL_DEL, conn->fd_, nullptr);
+    ::close(conn->fd_);
+    loop.connections_.erase(conn);
+    connections_.fetch_sub(1, std::memory_order_relaxed);
+    delete conn;
+}
+
+void IoReactor::serve(Connection &conn) {
+    bool peerClosed = false;
+
+    if (!conn.failed_ && !conn.flush()) {
+        conn.failed_ = true;
+    }
+
+    // 直接读入连接的读缓冲区，读到EAGAIN或者达到本次的上限为止
+    // 处理函数(以及读缓冲区扩容)抛出的异常按出错关闭连接：连接必须交还，否则它一直计在inFlight_里，stop永远等不到
+    std::exception_ptr error;
+    try {
+        if (!conn.failed_ && (conn.events_ & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+            size_t total = 0;
+            while (total < MAX_READ_PER_DISPATCH) {
+                char *buf = conn.input_.prepare(MIN_READ_SPACE);
+                ssize_t n = ::recv(conn.fd_, buf, conn.input_.writable(), 0);
+                if (n > 0) {
+                    conn.input_.commit(static_cast<size_t>(n));
+                    total += static_cast<size_t>(n);
+                    continue;
+                }
+                if (n == 0) {
+                    peerClosed = true;
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    conn.failed_ = true;
+                }
+                break;
+            }
+            if (total > 0 && !conn.failed_) {
+                (*conn.handler_)(conn);
+            }
+        }
+    } catch (...) {
+        conn.failed_ = true;
+        error = std::current_exception();
+    }
+
+    Connection::Op op = Connection::Op::OP_REARM;
+    if (conn.failed_ || ((peerClosed || conn.closing_) && conn.output_.empty())) {
+        op = Connection::Op::OP_CLOSE;
+    }
+    complete(conn, op);
+    // 连接已经交还，异常继续抛给线程池的错误处理函数
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+
+void IoReactor::complete(Connection &conn, Connection::Op op) {
+    conn.op_ = op;
+    pushCompletion(*loops_[conn.loop_], &conn);
+    // 先交还再减计数，stop等到计数归零时所有连接都已经在完成链表或者连接集合里
+    if (inFlight_.fetch_sub(1) == 1 && stopping_.load()) {
+        futexWakeAll(inFlight_);
+    }
+}
+
+void IoReactor::pushCompletion(Loop &loop, Connection *conn) {
+    Connection *head = loop.completions_.load(std::memory_order_relaxed);
+    do {
+        conn->nextCompletion_ = head;
+    } while (!loop.completions_.compare_exchange_weak(head, conn, std::memory_order_seq_cst));
+    // reactor线程没有睡眠时会在下一轮循环中处理，不需要系统调用
+    if (loop.sleeping_.exchange(false, std::memory_order_seq_cst)) {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t n = write(loop.wakefd_, &one, sizeof(one));
+    }
+}
@@ -0,0 +1,205 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "function.h"
+#include "threadpool.h"
+
+/*
+基于epoll的网络I/O，和线程池配合使用(仅Linux)
+example:
+ThreadPool pool;
+pool.start(4);
+IoReactor reactor(pool);
+uint16_t port = reactor.listen(8080, [](Connection &conn) {
+    conn.send(conn.input());           // echo
+    conn.consume(conn.input().size());
+});
+reactor.start();
+
+- reactor线程只负责epoll_wait和accept，连接可读(或可写)时把连接本身作为任务投递给线程池，
+  由工作线程读取数据、调用处理函数、发送响应
+- 连接以EPOLLONESHOT注册，同一时刻只有一个线程(reactor或者某个工作线程)操作它，缓冲区不需要加锁
+- 每个连接有自己的读缓冲区，内核直接读入缓冲区的尾部，处理函数通过input()就地解析，跨请求复用，不再释放
+- 工作线程处理完后把连接挂到reactor的无锁完成链表上，只有reactor正在epoll_wait中睡眠时才通过eventfd唤醒它；
+  连接本身就是投递给线程池的任务，投递和完成都不分配内存
+*/
+
+// 连接的读写缓冲区：[begin_, end_)是还没有处理的数据，尾部是可以直接读入的空间
+class IoBuffer {
+public:
+    // 还没有处理的数据
+    std::string_view readable() const {
+        return std::string_view(data_.data() + begin_, end_ - begin_);
+    }
+    size_t size() const {
+        return end_ - begin_;
+    }
+    bool empty() const {
+        return begin_ == end_;
+    }
+
+    // 丢弃开头的n字节
+    void consume(size_t n);
+    // 保证尾部至少有n字节可写空间，返回可写位置；空间不够时先把未处理的数据挪到开头，再扩容
+    char* prepare(size_t n);
+    // 可写空间的大小
+    size_t writable() const {
+        return data_.size() - end_;
+    }
+    // 确认prepare之后写入了n字节
+    void commit(size_t n) {
+        end_ += n;
+    }
+    void append(std::string_view data);
+
+private:
+    std::vector<char> data_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+};
+
+class IoReactor;
+
+// epoll事件关联的对象：监听套接字或者连接
+class IoChannel {
+protected:
+    explicit IoChannel(bool listening)
+        : listening_(listening)
+    {}
+    ~IoChannel() = default;
+
+private:
+    friend class IoReactor;
+    bool listening_;
+};
+
+// 一个TCP连接，只在处理函数中(工作线程持有它期间)访问
+class Connection : public Task, private IoChannel {
+public:
+    int fd() const {
+        return fd_;
+    }
+
+    // 已经读到、还没有处理的数据，直接指向读缓冲区
+    std::string_view input() const {
+        return input_.readable();
+    }
+    // 处理完开头的n字节，剩下的不完整请求留到下次数据到达时继续处理
+    void consume(size_t n) {
+        input_.consume(n);
+    }
+
+    // 非阻塞发送，内核发送缓冲区满时剩余的部分暂存起来，由reactor等到可写时再次投递
+    void send(std::string_view data);
+    // 发送完暂存的数据后关闭连接
+    void close() {
+        closing_ = true;
+    }
+
+    // 供处理函数保存每个连接的解析状态等，连接关闭时不会释放它指向的对象
+    void *context = nullptr;
+
+    Any run() override;
+
+private:
+    friend class IoReactor;
+    using Handler = MoveOnlyFunction<void(Connection&)>;
+
+    // 连接交还给reactor时要做的操作
+    enum class Op {
+        OP_ADD,   // 新连接，注册到epoll
+        OP_REARM, // 重新等待可读(有暂存数据时还等待可写)
+        OP_CLOSE, // 关闭并释放
+    };
+
+    Connection(IoReactor *reactor, size_t loop, int fd, Handler *handler)
+        : IoChannel(false),
+          reactor_(reactor),
+          loop_(loop),
+          fd_(fd),
+          handler_(handler)
+    {}
+
+    // 把暂存的数据写入内核，出错返回false
+    bool flush();
+
+    IoReactor *reactor_;
+    size_t loop_;        // 连接注册在哪个reactor线程上
+    int fd_;
+    Handler *handler_;   // 监听套接字上的处理函数
+    IoBuffer input_;
+    IoBuffer output_;    // 还没有写入内核的数据
+    uint32_t events_ = 0; // 本次就绪的epoll事件
+    bool closing_ = false;
+    bool failed_ = false; // 读写出错，暂存的数据也不再发送
+    Op op_ = Op::OP_ADD;
+    Connection *nextCompletion_ = nullptr; // 完成链表中的下一个
+};
+
+class IoReactor {
+public:
+    using Handler = Connection::Handler;
+
+    // reactorThreads个reactor线程，新连接在它们之间轮流分配
+    explicit IoReactor(ThreadPool &pool, size_t reactorThreads = 1);
+    // 析构时stop
+    ~IoReactor();
+
+    IoReactor(const IoReactor&) = delete;
+    IoReactor& operator=(const IoReactor&) = delete;
+
+    // 在host:port上监听，port为0时由系统分配，返回实际的端口；失败时抛出std::system_error
+    // 同一个监听套接字上的所有连接共用handler，不同的工作线程可能同时调用它
+    uint16_t listen(uint16_t port, Handler handler, const std::string &host = "127.0.0.1");
+
+    // 启动reactor线程
+    void start();
+    // 停止接受新连接和事件，等正在处理的连接交还后关闭所有连接
+    void stop();
+
+    // 当前打开的连接数量
+    size_t connectionCount() const;
+
+private:
+    friend class Connection;
+
+    struct Listener;
+    struct Loop;
+
+    // reactor线程的事件循环
+    void runLoop(Loop &loop);
+    // 处理监听套接字上的新连接
+    void acceptAll(Listener &listener);
+    // 处理完成链表中交还的连接
+    void drainCompletions(Loop &loop);
+    // 工作线程执行：读数据、调用处理函数、发送，最后交还给reactor
+    void serve(Connection &conn);
+    // 把连接挂到所属reactor的完成链表上，必要时唤醒它
+    void complete(Connection &conn, Connection::Op op);
+    void pushCompletion(Loop &loop, Connection *conn);
+    void closeConnection(Loop &loop, Connection *conn);
+
+private:
+    ThreadPool &pool_;
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::vector<std::unique_ptr<Listener>> listeners_;
+    std::mutex listenMtx_;
+    std::atomic<size_t> nextLoop_ {0};       // 新连接轮流分配到的reactor
+    std::atomic<size_t> connections_ {0};
+    std::atomic<uint32_t> inFlight_ {0};     // 投递给线程池、还没有交还的连接数量，同时作为futex等待的变量
+    std::atomic_bool running_ {false};
+    std::atomic_bool stopping_ {false};
+};
+
+#endif
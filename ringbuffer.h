@@ -0,0 +1,105 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+/*
+可扩容的环形缓冲区，用来代替std::queue作为任务队列
+std::queue默认基于std::deque，元素较大时几乎每放入几个元素就要分配一个新的块，
+这里的缓冲区只在容量不足时翻倍扩容，之后反复入队出队不再分配内存
+注意：不是线程安全的，需要调用者加锁
+*/
+template<typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity = 64)
+        : head_(0),
+          size_(0) {
+        size_t cap = 1;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        capacity_ = cap;
+        slots_ = static_cast<T*>(::operator new(sizeof(T) * capacity_, std::align_val_t(alignof(T))));
+    }
+    ~RingBuffer() {
+        clear();
+        ::operator delete(slots_, std::align_val_t(alignof(T)));
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        if (size_ == capacity_) {
+            grow();
+        }
+        ::new (static_cast<void*>(&slots_[(head_ + size_) & (capacity_ - 1)])) T(std::forward<Args>(args)...);
+        size_ ++;
+    }
+
+    T& front() {
+        return slots_[head_];
+    }
+
+    // 从队首数起的第i个元素
+    T& at(size_t i) {
+        return slots_[(head_ + i) & (capacity_ - 1)];
+    }
+
+    // 删除第i个元素，后面的元素依次前移；只在丢弃任务这类少见的路径上使用
+    void erase(size_t i) {
+        for (; i + 1 < size_; i ++) {
+            at(i) = std::move(at(i + 1));
+        }
+        at(size_ - 1).~T();
+        size_ --;
+    }
+
+    void pop() {
+        slots_[head_].~T();
+        head_ = (head_ + 1) & (capacity_ - 1);
+        size_ --;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    void clear() {
+        while (size_ > 0) {
+            pop();
+        }
+    }
+
+private:
+    void grow() {
+        size_t newCapacity = capacity_ * 2;
+        T *slots = static_cast<T*>(::operator new(sizeof(T) * newCapacity, std::align_val_t(alignof(T))));
+        for (size_t i = 0; i < size_; i ++) {
+            T &item = slots_[(head_ + i) & (capacity_ - 1)];
+            ::new (static_cast<void*>(&slots[i])) T(std::move(item));
+            item.~T();
+        }
+        ::operator delete(slots_, std::align_val_t(alignof(T)));
+        slots_ = slots;
+        capacity_ = newCapacity;
+        head_ = 0;
+    }
+
+private:
+    T *slots_;
+    size_t capacity_;
+    size_t head_;
+    size_t size_;
+};
+
+#endif
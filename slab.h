@@ -0,0 +1,308 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <utility>
+
+/*
+按大小分级的slab分配器，承担线程池内部的小对象分配(任务、结果的共享状态、函数对象和Any的堆存储、协程帧)
+一次提交往往在提交者线程上分配、在工作线程上释放，这正是通用malloc最慢的情况，这里专门为它设计：
+- 每个线程有自己的堆，每个大小级别一个空闲链表，本线程分配、本线程释放都不需要任何原子操作
+- 内存按SPAN_SIZE对齐的span申请，一个span只切一种大小的块，释放时由地址找到span头，得知块的大小和所属的堆
+- 其他线程释放的块先攒在释放者线程本地，攒够一批(或换了目标堆、线程挂起、线程退出)时用一次CAS挂到所属堆的远程链表上，
+  所属线程自己的空闲链表用完时一次取走整条远程链表
+- 线程退出时它的堆(连同空闲的块)交给下一个新线程接着用，span不还给系统；超过MAX_SIZE的请求直接交给operator new
+- 释放时必须给出和分配时相同的大小(和对齐)，所以只适合自己知道对象大小的场合
+*/
+class SlabAllocator {
+public:
+    static constexpr size_t MAX_SIZE = 512;          // 超过这个大小不走slab
+    static constexpr size_t SPAN_SIZE = 32 * 1024;   // span的大小，同时也是它的对齐
+
+    static void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        if (size > MAX_SIZE || align > alignof(std::max_align_t)) {
+            return align > alignof(std::max_align_t) ? ::operator new(size, std::align_val_t(align))
+                                                     : ::operator new(size);
+        }
+        Heap *heap = local_.heap;
+        if (heap == nullptr) {
+            heap = adoptHeap();
+        }
+        size_t cls = classOf(size);
+        Block *block = heap->free[cls];
+        if (block != nullptr) {
+            heap->free[cls] = block->next;
+            return block;
+        }
+        return allocateSlow(heap, cls);
+    }
+
+    static void deallocate(void *ptr, size_t size, size_t align = alignof(std::max_align_t)) noexcept {
+        if (ptr == nullptr) {
+            return;
+        }
+        if (size > MAX_SIZE || align > alignof(std::max_align_t)) {
+            if (align > alignof(std::max_align_t)) {
+                ::operator delete(ptr, size, std::align_val_t(align));
+            } else {
+                ::operator delete(ptr, size);
+            }
+            return;
+        }
+        Block *block = static_cast<Block*>(ptr);
+        Span *span = spanOf(ptr);
+        Heap *heap = local_.heap;
+        if (span->owner == heap) {
+            block->next = heap->free[span->sizeClass];
+            heap->free[span->sizeClass] = block;
+            return;
+        }
+        freeRemote(span->owner, block);
+    }
+
+    // 在本线程分配/释放一个T，超过MAX_SIZE或者超对齐的类型直接使用operator new
+    template<typename T, typename... Args>
+    static T* create(Args&&... args) {
+        void *ptr = allocate(sizeof(T), alignof(T));
+        try {
+            return ::new (ptr) T(std::forward<Args>(args)...);
+        } catch (...) {
+            deallocate(ptr, sizeof(T), alignof(T));
+            throw;
+        }
+    }
+    template<typename T>
+    static void destroy(T *ptr) noexcept {
+        ptr->~T();
+        deallocate(ptr, sizeof(T), alignof(T));
+    }
+
+    // 把本线程攒着的、要还给其他线程的块立即还回去，线程长时间挂起之前调用
+    static void flushRemote() noexcept {
+        if (local_.pending != nullptr) {
+            flushPending();
+        }
+    }
+
+    // 所有span占用的内存总量
+    static size_t reservedBytes() {
+        return global().reserved.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Block {
+        Block *next;
+    };
+
+    // 大小级别：16字节一级到128，32字节一级到256，64字节一级到512
+    static constexpr size_t CLASS_COUNT = 16;
+    static constexpr uint16_t CLASS_SIZES[CLASS_COUNT] = {
+        16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512,
+    };
+    // 攒够这么多块就还给所属的堆
+    static constexpr uint32_t REMOTE_BATCH = 32;
+
+    static size_t classOf(size_t size) {
+        if (size <= 128) {
+            return size == 0 ? 0 : (size - 1) >> 4;
+        }
+        if (size <= 256) {
+            return 8 + ((size - 129) >> 5);
+        }
+        return 12 + ((size - 257) >> 6);
+    }
+
+    struct Heap;
+
+    // span开头的头部，之后是同一大小的块
+    struct alignas(64) Span {
+        Heap *owner;         // 从哪个堆切出来的，创建后不再改变
+        uint32_t sizeClass;
+        char *bump;          // 还没有切出去的部分
+        char *end;
+    };
+
+    struct Heap {
+        Block *free[CLASS_COUNT] {};       // 只由持有这个堆的线程访问
+        Span *current[CLASS_COUNT] {};     // 正在切块的span
+        std::atomic<Block*> remote {nullptr}; // 其他线程还回来的块，各种大小混在一起
+        Heap *nextIdle = nullptr;          // 空闲堆链表
+    };
+
+    // 线程本地的状态都是平凡类型，访问时不需要线程局部变量的初始化检查
+    struct LocalState {
+        Heap *heap;
+        Heap *pendingOwner;   // pending中的块属于哪个堆
+        Block *pending;       // 攒着还没有还回去的块
+        Block *pendingTail;
+        uint32_t pendingCount;
+        bool exited;          // 线程已经退出(线程局部变量析构阶段)，之后的远程释放不再攒批
+    };
+
+    // 线程退出时归还堆、还回攒着的块
+    struct ExitHook {
+        ~ExitHook() {
+            flushRemote();
+            local_.exited = true;
+            if (local_.heap != nullptr) {
+                releaseHeap(local_.heap);
+                local_.heap = nullptr;
+            }
+        }
+    };
+
+    struct Global {
+        std::mutex mtx;                     // 保护idleHeaps
+        Heap *idleHeaps = nullptr;          // 线程退出后留下的堆
+        std::atomic<size_t> reserved {0};
+    };
+
+    // 不析构：线程池的线程可能在静态对象析构之后才退出
+    static Global& global() {
+        static Global *g = new Global();
+        return *g;
+    }
+
+    // 注册线程退出钩子，每个线程只注册一次
+    static void armExitHook() {
+        static thread_local ExitHook hook;
+        (void)hook;
+    }
+
+    static Span* spanOf(void *ptr) {
+        return reinterpret_cast<Span*>(reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t(SPAN_SIZE) - 1));
+    }
+
+    static Heap* adoptHeap() {
+        Heap *heap = nullptr;
+        {
+            Global &g = global();
+            std::lock_guard<std::mutex> lock(g.mtx);
+            heap = g.idleHeaps;
+            if (heap != nullptr) {
+                g.idleHeaps = heap->nextIdle;
+            }
+        }
+        if (heap == nullptr) {
+            heap = new Heap(); // 堆和span一样不再释放，其他线程可能还持有从它切出的块
+        }
+        local_.heap = heap;
+        // 已经退出的线程里(其他线程局部变量的析构函数中)再分配，拿到的堆不再归还
+        if (!local_.exited) {
+            armExitHook();
+        }
+        return heap;
+    }
+
+    static void releaseHeap(Heap *heap) {
+        Global &g = global();
+        std::lock_guard<std::mutex> lock(g.mtx);
+        heap->nextIdle = g.idleHeaps;
+        g.idleHeaps = heap;
+    }
+
+    static void* allocateSlow(Heap *heap, size_t cls) {
+        // 先取回其他线程还回来的块，按大小分到各自的空闲链表
+        Block *block = heap->remote.exchange(nullptr, std::memory_order_acquire);
+        while (block != nullptr) {
+            Block *next = block->next;
+            size_t c = spanOf(block)->sizeClass;
+            block->next = heap->free[c];
+            heap->free[c] = block;
+            block = next;
+        }
+        block = heap->free[cls];
+        if (block != nullptr) {
+            heap->free[cls] = block->next;
+            return block;
+        }
+
+        size_t size = CLASS_SIZES[cls];
+        Span *span = heap->current[cls];
+        if (span == nullptr || span->bump + size > span->end) {
+            void *mem = ::operator new(SPAN_SIZE, std::align_val_t(SPAN_SIZE));
+            global().reserved.fetch_add(SPAN_SIZE, std::memory_order_relaxed);
+            span = ::new (mem) Span { heap, static_cast<uint32_t>(cls),
+                                      static_cast<char*>(mem) + sizeof(Span), static_cast<char*>(mem) + SPAN_SIZE };
+            heap->current[cls] = span;
+        }
+        void *ptr = span->bump;
+        span->bump += size;
+        return ptr;
+    }
+
+    static void freeRemote(Heap *owner, Block *block) noexcept {
+        LocalState &local = local_;
+        if (local.exited) {
+            pushRemote(owner, block, block);
+            return;
+        }
+        if (local.pending != nullptr && local.pendingOwner != owner) {
+            flushPending();
+        }
+        if (local.pending == nullptr) {
+            local.pendingOwner = owner;
+            local.pendingTail = block;
+            local.pendingCount = 0;
+            // 线程退出时不会把攒着的块带走
+            armExitHook();
+        }
+        block->next = local.pending;
+        local.pending = block;
+        if (++ local.pendingCount >= REMOTE_BATCH) {
+            flushPending();
+        }
+    }
+
+    static void flushPending() noexcept {
+        LocalState &local = local_;
+        pushRemote(local.pendingOwner, local.pending, local.pendingTail);
+        local.pending = nullptr;
+        local.pendingTail = nullptr;
+        local.pendingOwner = nullptr;
+        local.pendingCount = 0;
+    }
+
+    // 把[head, tail]整条链挂到owner的远程链表上
+    static void pushRemote(Heap *owner, Block *head, Block *tail) noexcept {
+        Block *top = owner->remote.load(std::memory_order_relaxed);
+        do {
+            tail->next = top;
+        } while (!owner->remote.compare_exchange_weak(top, head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    static inline thread_local LocalState local_ {};
+};
+
+// 让标准库容器和std::allocate_shared使用SlabAllocator
+template<typename T>
+class SlabStlAllocator {
+public:
+    using value_type = T;
+
+    SlabStlAllocator() noexcept = default;
+    template<typename U>
+    SlabStlAllocator(const SlabStlAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(SlabAllocator::allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *ptr, size_t n) noexcept {
+        SlabAllocator::deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    template<typename U>
+    bool operator==(const SlabStlAllocator<U>&) const noexcept {
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include "strand.h"
+
+#include <utility>
+
+// --------- 实现StrandCore类
+StrandCore::StrandCore(ThreadPool &pool, StrandTable *table, uint64_t key, const SubmitOptions &options)
+    : pool_(pool),
+      table_(table),
+      key_(key),
+      options_(options)
+{
+    // 截止时间和取消标记只对单个任务生效，strand本身一定会被执行
+    options_.deadline = std::chrono::steady_clock::time_point::max();
+    options_.token = CancellationToken();
+}
+
+void StrandCore::push(std::shared_ptr<Task> sp, const SubmitOptions &options) {
+    Task *task = sp.get();
+    task->deadline_ = options.deadline;
+    task->token_ = options.token;
+    task->self_ = std::move(sp);
+    Task *top = inbox_.load(std::memory_order_relaxed);
+    do {
+        task->strandNext_ = top;
+    } while (!inbox_.compare_exchange_weak(top, task, std::memory_order_release, std::memory_order_relaxed));
+}
+
+bool StrandCore::arrive() {
+    return pending_.fetch_add(1, std::memory_order_acq_rel) == 0;
+}
+
+void StrandCore::schedule() {
+    SubmitOptions placement = options_;
+    int node = node_.load(std::memory_order_relaxed);
+    if (placement.node < 0 && node >= 0) {
+        placement.node = node;
+    }
+    pool_.postInternal(*this, placement);
+}
+
+void StrandCore::release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        SlabAllocator::destroy(this);
+    }
+}
+
+Task* StrandCore::popTask() {
+    while (ready_ == nullptr) {
+        // pending_大于0时收件箱里一定有任务：提交者先入收件箱，再增加pending_
+        Task *list = inbox_.exchange(nullptr, std::memory_order_acquire);
+        while (list != nullptr) {
+            Task *next = list->strandNext_;
+            list->strandNext_ = ready_;
+            ready_ = list;
+            list = next;
+        }
+    }
+    Task *task = ready_;
+    ready_ = task->strandNext_;
+    task->strandNext_ = nullptr;
+    return task;
+}
+
+bool StrandCore::finishOne() {
+    if (table_ == nullptr) {
+        return pending_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+    // 按键的strand变为空闲时要从映射中删除，和提交者在分片的锁内配对；还有其他任务时不需要加锁
+    size_t pending = pending_.load(std::memory_order_relaxed);
+    while (pending > 1) {
+        if (pending_.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            return false;
+        }
+    }
+    return table_->retire(*this);
+}
+
+Any StrandCore::run() {
+    node_.store(pool_.currentNode(), std::memory_order_relaxed);
+    for (size_t n = 1; ; n ++) {
+        std::shared_ptr<Task> task(std::move(popTask()->self_));
+        if ((!task->token_.canBeCancelled() && task->deadline_ == std::chrono::steady_clock::time_point::max())
+            || !pool_.dropIfStale(*task, std::chrono::steady_clock::time_point::min())) {
+            pool_.execTask(*task);
+        }
+        task.reset();
+
+        if (finishOne()) {
+            // 空闲之后新的提交者可能已经再次投递了strand，这里释放的是本次投递的引用，之后不能再访问成员
+            release();
+            return Any();
+        }
+        if (n == BATCH) {
+            // 本次投递的引用转交给下一次投递
+            schedule();
+            return Any();
+        }
+    }
+}
+
+// --------- 实现StrandTable类
+StrandTable::StrandTable(ThreadPool &pool)
+    : pool_(pool)
+{}
+
+StrandTable::~StrandTable() {
+    // 线程池析构时所有任务都已经执行完毕，映射中只剩下从未启动的线程池里的strand
+    for (Shard &shard : shards_) {
+        for (auto &entry : shard.strands) {
+            entry.second->release();
+        }
+    }
+}
+
+StrandTable::Shard& StrandTable::shardOf(uint64_t key) {
+    // 键通常是连续的编号，打散之后再取分片
+    return shards_[(key * 0x9E3779B97F4A7C15ull) >> 58];
+}
+
+void StrandTable::submit(uint64_t key, std::shared_ptr<Task> sp, const SubmitOptions &options) {
+    StrandCore *core = nullptr;
+    bool idle = false;
+    {
+        Shard &shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        StrandCore *&slot = shard.strands[key];
+        if (slot == nullptr) {
+            // 映射持有一份引用
+            slot = SlabAllocator::create<StrandCore>(pool_, this, key, options);
+        }
+        core = slot;
+        core->push(std::move(sp), options);
+        idle = core->arrive();
+        if (idle) {
+            core->addRef(); // 本次投递持有一份引用，strand执行完毕变为空闲时释放
+        }
+    }
+    if (idle) {
+        core->schedule();
+    }
+}
+
+bool StrandTable::retire(StrandCore &core) {
+    bool idle = false;
+    {
+        Shard &shard = shardOf(core.key_);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        idle = core.pending_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        if (idle) {
+            shard.strands.erase(core.key_);
+        }
+    }
+    if (idle) {
+        core.release(); // 映射的引用，执行中的strand还持有本次投递的引用
+    }
+    return idle;
+}
+
+size_t StrandTable::size() const {
+    size_t n = 0;
+    for (const Shard &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        n += shard.strands.size();
+    }
+    return n;
+}
+
+// --------- 实现Strand类
+Strand::Strand(ThreadPool &pool, const SubmitOptions &options)
+    : core_(SlabAllocator::create<StrandCore>(pool, nullptr, 0, options))
+{}
+
+Strand::~Strand() {
+    if (core_ != nullptr) {
+        core_->release();
+    }
+}
+
+Strand::Strand(const Strand &other)
+    : core_(other.core_)
+{
+    core_->addRef();
+}
+
+Strand& Strand::operator=(const Strand &other) {
+    if (this != &other) {
+        other.core_->addRef();
+        if (core_ != nullptr) {
+            core_->release();
+        }
+        core_ = other.core_;
+    }
+    return *this;
+}
+
+Strand::Strand(Strand &&other) noexcept
+    : core_(std::exchange(other.core_, nullptr))
+{}
+
+Strand& Strand::operator=(Strand &&other) noexcept {
+    if (this != &other) {
+        if (core_ != nullptr) {
+            core_->release();
+        }
+        core_ = std::exchange(other.core_, nullptr);
+    }
+    return *this;
+}
+
+void Strand::submit(std::shared_ptr<Task> sp, const SubmitOptions &options) {
+    core_->push(std::move(sp), options);
+    if (core_->arrive()) {
+        core_->addRef();
+        core_->schedule();
+    }
+}
+
+Result Strand::submitTask(std::shared_ptr<Task> sp, const SubmitOptions &options) {
+    Future<Any> future = sp->makeFuture();
+    submit(std::move(sp), options);
+    return Result(std::move(future), SubmitStatus::STATUS_OK, &core_->pool());
+}
+
+void Strand::post(MoveOnlyFunction<void()> func) {
+    submit(ThreadPool::makeFuncTask(std::move(func)), SubmitOptions());
+}
@@ -0,0 +1,140 @@
+#ifndef STRAND_H
+#define STRAND_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "threadpool.h"
+
+/*
+串行执行器(strand)：投递到同一个strand的任务按提交顺序逐个执行，从不并发，不同的strand之间并行
+example:
+Strand strand(pool);
+strand.post([&]() { account.apply(event1); });
+strand.post([&]() { account.apply(event2); }); // 一定在event1之后执行，不需要再给account加锁
+
+// 或者按键串行，不需要自己保存Strand：同一个键的任务串行，不同的键并行
+pool.submitTask(accountId, makeTask<ApplyEvent>(event));
+
+- 任务先进入strand的无锁收件箱(Treiber栈，一次CAS)，把strand从空闲变为忙碌的提交者顺带把strand本身作为一个任务投递给线程池，
+  其余的提交者只入收件箱，不碰线程池的队列；没有竞争时一次提交只有一次CAS和一次原子加
+- strand在一个工作线程上连续执行收件箱里的任务，一个键的热数据一直留在这个核的缓存里；
+  连续执行BATCH个任务后把自己重新投递一次，给其他任务让出线程(工作线程投递的任务进入它自己的本地队列，通常还是由它接着执行)
+- strand空闲后再被唤醒时，投递到上一次执行它的线程所在的NUMA节点(只在多节点时生效)
+- 串行任务不占用线程池的任务队列，不受队列上限和溢出策略的约束；截止时间和取消标记在轮到它执行时检查
+- strand本身作为线程池的内部任务投递，队列满时也不会被POLICY_DROP_OLDEST丢弃，否则它的待执行计数不再归零，之后的任务全部丢失
+- 按键提交时，键到strand的映射分成若干个分片，每个分片一把锁，只在查找和strand变为空闲时短暂持有；
+  strand空闲时从映射中删除，键的数量不会无限增长。热点键可以改用Strand对象，完全不经过映射
+*/
+
+class StrandTable;
+
+// 一个strand的全部状态，本身就是投递给线程池的任务，线程池不接管它的生命周期，由引用计数管理
+class StrandCore final : public Task {
+public:
+    StrandCore(ThreadPool &pool, StrandTable *table, uint64_t key, const SubmitOptions &options);
+
+    // 把任务放入收件箱，任务在收件箱中由自身持有一份引用
+    void push(std::shared_ptr<Task> sp, const SubmitOptions &options);
+    // 记录一个待执行的任务，strand原本空闲时返回true，调用者需要随后调用schedule
+    bool arrive();
+    // 把strand投递给线程池，调用者已经为这次投递增加了引用
+    void schedule();
+
+    void addRef() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    void release();
+
+    ThreadPool& pool() const {
+        return pool_;
+    }
+
+    // 依次执行收件箱中的任务
+    Any run() override;
+
+private:
+    friend class StrandTable;
+
+    static constexpr size_t BATCH = 64; // 连续执行这么多个任务后重新投递一次
+
+    // 取出最早提交的任务，收件箱里的任务整批取出后反转成先进先出
+    Task* popTask();
+    // 一个任务执行完毕，strand变为空闲时返回true
+    bool finishOne();
+
+    ThreadPool &pool_;
+    StrandTable *table_;                // 按键提交的strand所在的映射，Strand对象为nullptr
+    uint64_t key_;
+    SubmitOptions options_;             // 投递strand本身时的车道、租户和节点
+    std::atomic<Task*> inbox_ {nullptr}; // 新提交的任务，后进的在栈顶
+    Task *ready_ = nullptr;             // 已经从收件箱取出、按提交顺序排好的任务，只由正在执行strand的线程访问
+    std::atomic<size_t> pending_ {0};   // 已经提交、还没有执行完的任务数量，从0变为1的提交者负责投递
+    std::atomic<int> node_ {-1};        // 上一次执行strand的线程所在的NUMA节点
+    std::atomic<uint32_t> refs_ {1};
+};
+
+// 按键提交的strand映射
+// 查找仍然在分片的锁内进行：retire要在同一个临界区里确认strand真的空闲并把它从映射中删除，
+// 否则提交者可能把任务放进一个正在退出的strand；删除之后StrandCore随最后一份引用释放，
+// 无锁的查找需要危险指针或者epoch之类的延迟回收，代价比锁更高。临界区内只有一次哈希查找和两次原子操作，
+// 64个分片下不同的键很少落在同一个分片上
+class StrandTable {
+public:
+    explicit StrandTable(ThreadPool &pool);
+    ~StrandTable();
+
+    StrandTable(const StrandTable&) = delete;
+    StrandTable& operator=(const StrandTable&) = delete;
+
+    void submit(uint64_t key, std::shared_ptr<Task> sp, const SubmitOptions &options);
+
+    // strand即将空闲时由执行它的线程调用：在分片的锁内扣除最后一个任务，真的空闲了就从映射中删除，返回是否空闲
+    bool retire(StrandCore &core);
+
+    // 映射中的strand数量，即有任务待执行的键的数量
+    size_t size() const;
+
+private:
+    static constexpr size_t SHARD_COUNT = 64;
+
+    struct alignas(64) Shard {
+        mutable std::mutex mtx;
+        std::unordered_map<uint64_t, StrandCore*> strands;
+    };
+
+    Shard& shardOf(uint64_t key);
+
+    ThreadPool &pool_;
+    Shard shards_[SHARD_COUNT];
+};
+
+// 可以反复使用的strand，持有者不需要经过按键的映射；可以拷贝，拷贝出来的对象指向同一个strand
+// 线程池必须比所有Strand对象以及投递到其中的任务活得更久
+class Strand {
+public:
+    // options中的车道、租户和节点用于投递strand本身
+    explicit Strand(ThreadPool &pool, const SubmitOptions &options = SubmitOptions());
+    ~Strand();
+
+    Strand(const Strand &other);
+    Strand& operator=(const Strand &other);
+    Strand(Strand &&other) noexcept;
+    Strand& operator=(Strand &&other) noexcept;
+
+    // 提交一个任务，options中只有截止时间和取消标记对这个任务生效
+    Result submitTask(std::shared_ptr<Task> sp, const SubmitOptions &options = SubmitOptions());
+    // 提交一个不需要返回值的函数
+    void post(MoveOnlyFunction<void()> func);
+
+private:
+    void submit(std::shared_ptr<Task> sp, const SubmitOptions &options);
+
+    StrandCore *core_;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "taskgraph.h"
+
+#include <stdexcept>
+
+// 图中的节点，本身就是一个Task，运行时直接把节点的shared_ptr放入线程池，不需要再分配内存
+class TaskGraph::Node : public Task {
+public:
+    Node(TaskGraph *graph, size_t index, MoveOnlyFunction<void()> func)
+        : graph_(graph),
+          index_(index),
+          func_(std::move(func))
+    {}
+
+    Any run() override {
+        // 沿着就绪的后继一直执行下去，直到没有可以接着执行的节点
+        Node *node = this;
+        while (node != nullptr) {
+            node = graph_->execute(node);
+        }
+        return Any();
+    }
+
+    TaskGraph *graph_;
+    size_t index_;
+    MoveOnlyFunction<void()> func_;
+    std::vector<Node*> successors_;     // 后继节点
+    uint32_t predecessorSize_ = 0;      // 前驱的数量
+    std::atomic<uint32_t> pending_ {0}; // 本次运行中还没执行完的前驱数量
+};
+
+TaskGraph::~TaskGraph() {
+    if (pool_ != nullptr) {
+        waitUntil(std::chrono::steady_clock::time_point::max());
+    }
+}
+
+TaskGraph::NodeId TaskGraph::addNode(MoveOnlyFunction<void()> func) {
+    nodes_.emplace_back(std::make_shared<Node>(this, nodes_.size(), std::move(func)));
+    dirty_ = true;
+    return nodes_.size() - 1;
+}
+
+void TaskGraph::precede(NodeId from, NodeId to) {
+    if (from >= nodes_.size() || to >= nodes_.size()) {
+        throw std::out_of_range("TaskGraph: node id out of range");
+    }
+    nodes_[from]->successors_.push_back(nodes_[to].get());
+    nodes_[to]->predecessorSize_ ++;
+    dirty_ = true;
+}
+
+size_t TaskGraph::size() const {
+    return nodes_.size();
+}
+
+void TaskGraph::prepare() {
+    roots_.clear();
+    for (auto &node : nodes_) {
+        if (node->predecessorSize_ == 0) {
+            roots_.push_back(node.get());
+        }
+    }
+
+    // Kahn算法检查是否有环：能按拓扑序访问到的节点数少于总数说明有环
+    std::vector<uint32_t> indegree(nodes_.size());
+    for (auto &node : nodes_) {
+        indegree[node->index_] = node->predecessorSize_;
+    }
+    std::vector<Node*> stack(roots_.begin(), roots_.end());
+    size_t visited = 0;
+    while (!stack.empty()) {
+        Node *node = stack.back();
+        stack.pop_back();
+        visited ++;
+        for (Node *succ : node->successors_) {
+            if (-- indegree[succ->index_] == 0) {
+                stack.push_back(succ);
+            }
+        }
+    }
+    if (visited != nodes_.size()) {
+        throw std::logic_error("TaskGraph: graph contains a cycle");
+    }
+    dirty_ = false;
+}
+
+void TaskGraph::run(ThreadPool &pool) {
+    if (!isDone()) {
+        throw std::logic_error("TaskGraph: previous run has not finished");
+    }
+    if (dirty_) {
+        prepare();
+    }
+    if (nodes_.empty()) {
+        return;
+    }
+
+    pool_ = &pool;
+    failed_ = false;
+    error_ = nullptr;
+    for (auto &node : nodes_) {
+        node->pending_.store(node->predecessorSize_, std::memory_order_relaxed);
+    }
+    remaining_.store(static_cast<uint32_t>(nodes_.size()), std::memory_order_release);
+
+    for (Node *root : roots_) {
+        schedule(root);
+    }
+}
+
+void TaskGraph::wait() {
+    waitUntil(std::chrono::steady_clock::time_point::max());
+    if (error_ != nullptr) {
+        std::rethrow_exception(error_);
+    }
+}
+
+bool TaskGraph::waitFor(std::chrono::milliseconds timeout) {
+    return waitUntil(std::chrono::steady_clock::now() + timeout);
+}
+
+bool TaskGraph::waitUntil(std::chrono::steady_clock::time_point deadline) {
+    // 在工作线程上等待时帮线程池执行其他任务(包括图自己的节点)，固定大小的线程池不会因为等待而死锁
+    if (WaitHelper *helper = WaitHelper::current()) {
+        return helper->helpUntil(deadline, [this]() { return isDone(); },
+                                 [this](std::chrono::steady_clock::time_point until) { blockUntil(until); });
+    }
+    return blockUntil(deadline);
+}
+
+bool TaskGraph::blockUntil(std::chrono::steady_clock::time_point deadline) {
+    while (uint32_t r = remaining_.load(std::memory_order_acquire)) {
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            futexWait(remaining_, r);
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        futexWaitFor(remaining_, r, deadline - now);
+    }
+    return true;
+}
+
+bool TaskGraph::isDone() const {
+    return remaining_.load(std::memory_order_acquire) == 0;
+}
+
+void TaskGraph::schedule(Node *node) {
+    // 节点的shared_ptr由nodes_持有，拷贝一份只增加引用计数
+    // 节点作为内部任务投递：不受队列上限和溢出策略的约束，不会被丢弃(否则wait永远不会返回)，也不会在当前线程上重入执行
+    pool_->postInternal(nodes_[node->index_], SubmitOptions());
+}
+
+TaskGraph::Node* TaskGraph::execute(Node *node) {
+    // 已经有节点失败时不再执行后面的节点，但依然推进计数，保证wait能够返回
+    if (!failed_.load(std::memory_order_relaxed)) {
+        try {
+            node->func_();
+        } catch (...) {
+            bool expected = false;
+            if (failed_.compare_exchange_strong(expected, true)) {
+                error_ = std::current_exception();
+            }
+        }
+    }
+
+    // 把后继的前驱计数减一，减到0的后继就绪；留下一个由当前线程接着执行，其余的放入线程池
+    Node *next = nullptr;
+    for (Node *succ : node->successors_) {
+        if (succ->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (next != nullptr) {
+                schedule(next);
+            }
+            next = succ;
+        }
+    }
+
+    // 最后一个节点执行完毕，唤醒等待者；这之后不能再访问图的任何成员
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        futexWakeAll(remaining_);
+    }
+    return next;
+}
@@ -0,0 +1,88 @@
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include "threadpool.h"
+
+/*
+任务图(DAG)：先声明节点和依赖关系，再把整张图提交给线程池
+example:
+TaskGraph graph;
+auto parse = graph.addNode([&]() { ... });
+auto left  = graph.addNode([&]() { ... });
+auto right = graph.addNode([&]() { ... });
+auto merge = graph.addNode([&]() { ... });
+graph.precede(parse, left);
+graph.precede(parse, right);
+graph.precede(left, merge);
+graph.precede(right, merge);
+
+graph.run(pool);
+graph.wait();
+
+- 每个节点有一个原子的前驱计数，最后一个前驱执行完毕的线程把计数减到0，节点随即就绪
+- 就绪的后继直接由这个线程接着执行(多个后继时其余的放入线程池，工作窃取模式下进入该线程的本地队列)，
+  不需要任何线程阻塞在Result::get()上等待前驱
+- 图构建好以后可以反复run，除第一次外每次运行都不再分配内存
+- 节点作为线程池的内部任务投递，队列满时不会被丢弃；在工作线程上wait()时帮线程池执行任务，固定大小的线程池也不会死锁
+*/
+class TaskGraph {
+public:
+    using NodeId = size_t;
+
+    TaskGraph() = default;
+    // 析构前等待正在进行的运行结束
+    ~TaskGraph();
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    // 添加一个节点，返回节点编号
+    NodeId addNode(MoveOnlyFunction<void()> func);
+
+    // 添加一条依赖：from执行完毕后to才能执行
+    void precede(NodeId from, NodeId to);
+
+    size_t size() const;
+
+    // 把整张图提交给线程池，立即返回；上一次运行没有结束时抛出std::logic_error，图中有环时也抛出std::logic_error
+    void run(ThreadPool &pool);
+
+    // 等待本次运行结束，某个节点抛出的异常会在这里重新抛出(之后的节点不再执行)
+    void wait();
+    // 最多等待timeout，运行已经结束返回true
+    bool waitFor(std::chrono::milliseconds timeout);
+    bool isDone() const;
+
+private:
+    class Node;
+
+    // 图的结构变化后重新找出入度为0的节点，并检查是否有环
+    void prepare();
+    // 把就绪的节点放入线程池
+    void schedule(Node *node);
+    // 执行一个节点，返回一个可以由当前线程接着执行的就绪后继
+    Node* execute(Node *node);
+    // 等到本次运行结束或者超过deadline，在工作线程上等待时帮忙执行其他任务
+    bool waitUntil(std::chrono::steady_clock::time_point deadline);
+    // 在remaining_上睡眠，直到本次运行结束或者超过deadline
+    bool blockUntil(std::chrono::steady_clock::time_point deadline);
+
+private:
+    std::vector<std::shared_ptr<Node>> nodes_;  // 所有节点，节点本身就是提交给线程池的Task
+    std::vector<Node*> roots_;                  // 没有前驱的节点
+    bool dirty_ = true;                         // 结构变化后需要重新prepare
+    ThreadPool *pool_ = nullptr;                // 本次运行所在的线程池
+
+    std::atomic<uint32_t> remaining_ {0};       // 本次运行还没执行完的节点数，同时作为futex等待的变量
+    std::atomic_bool failed_ {false};           // 是否已经有节点抛出异常
+    std::exception_ptr error_;                  // 第一个节点抛出的异常
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "threadpool.h"
+#include "coroutine.h"
+#include "completion.h"
 
 #include <iostream>
 #include <chrono>
@@ -11,16 +13,13 @@ public:
     MyTask(int a, int b) : a_(a), b_(b) {}
 
     Any run() {
-        std::cout << "tid: " << std::this_thread::get_id() << std::endl << "thread start" << std::endl;
-
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+        // 睡眠期间线程池临时启用一个备用线程顶替当前线程
+        ThreadPool::blocking([]() { std::this_thread::sleep_for(std::chrono::seconds(5)); });
         ll sum = 0;
         for (ll i = a_; i < b_; i ++) {
             sum += i;
         }
         return sum;
-
-        std::cout << "thread end" << std::endl;
     }
 
 private:
@@ -28,6 +27,23 @@ private:
     int b_;
 };
 
+// 协程版本的区间求和，co_await pool.schedule()之后在线程池中的线程上执行
+CoTask<ll> rangeSum(ThreadPool &pool, ll begin, ll end) {
+    co_await pool.schedule();
+    ll sum = 0;
+    for (ll i = begin; i <= end; i ++) {
+        sum += i;
+    }
+    co_return sum;
+}
+
+CoTask<ll> totalSum(ThreadPool &pool) {
+    auto [a, b, c] = co_await whenAll(rangeSum(pool, 1, 100000000),
+                                      rangeSum(pool, 100000001, 200000000),
+                                      rangeSum(pool, 200000001, 299999999));
+    co_return a + b + c;
+}
+
 int main() {
     ThreadPool pool;
     // 先设置各种前置模式，再启动线程池
@@ -40,16 +56,32 @@ int main() {
     }
     std::cout << sum << std::endl;
 
-    Result res1 = pool.submitTask(std::make_shared<MyTask>(1, 100000000));
-    Result res2 = pool.submitTask(std::make_shared<MyTask>(100000001, 200000000));
-    Result res3 = pool.submitTask(std::make_shared<MyTask>(200000001, 300000000));
+    CompletionQueue results;
+    results.submitTask(pool, makeTask<MyTask>(1, 100000000));
+    results.submitTask(pool, makeTask<MyTask>(100000001, 200000000));
+    results.submitTask(pool, makeTask<MyTask>(200000001, 300000000));
 
-    ll sum1 = res1.get().cast_<ll>();
-    ll sum2 = res2.get().cast_<ll>();
-    ll sum3 = res2.get().cast_<ll>();
+    // 按完成的先后顺序累加，不必先等最慢的那个
+    ll total = 0;
+    Completion done;
+    while (results.next(done)) {
+        total += done.result.get().cast_<ll>();
+    }
     
     // Master-worker model 即主线程负责提交任务，子线程负责执行任务，主线程等待多个子线程执行完毕后再获取结果之和
-    std::cout << (sum1 + sum2 + sum3) << std::endl;
+    std::cout << total << std::endl;
+
+    // 同样的求和交给parallelReduce，区间自动切分，主线程也参与计算
+    ll sum4 = pool.parallelReduce(1LL, 300000000LL, 0LL,
+        [](ll i) { return i; },
+        [](ll a, ll b) { return a + b; });
+    std::cout << sum4 << std::endl;
+
+    // 同样的求和写成协程，三段区间并发执行，最后一段执行完的线程直接恢复totalSum
+    std::cout << syncWait(totalSum(pool)) << std::endl;
+
+    // 线程池的运行指标，Prometheus文本格式
+    std::cout << pool.snapshot().toPrometheus();
 
     // pool.submitTask(std::make_shared<MyTask>());
     // pool.submitTask(std::make_shared<MyTask>());
@@ -60,6 +92,4 @@ int main() {
     // pool.submitTask(std::make_shared<MyTask>());
     // pool.submitTask(std::make_shared<MyTask>());
     // pool.submitTask(std::make_shared<MyTask>());
-
-    getchar();
 }
\ No newline at end of file
@@ -0,0 +1,247 @@
+// 异步结果的行为测试：Any、Future/Promise和then、Result::then、完成队列、whenAll/whenAny以及协程
+
+#include "check.h"
+#include "completion.h"
+#include "coroutine.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static void testAny() {
+    Any small = 42;
+    CHECK(small.hasValue());
+    CHECK(small.cast_<int>() == 42);
+    CHECK(small.tryCast<long>() == nullptr);
+    CHECK_THROWS(small.cast_<std::string>(), BadAnyCast);
+
+    // 放不下的值从SlabAllocator分配，移动之后原来的Any为空
+    Any large = std::string(200, 'x');
+    Any moved = std::move(large);
+    CHECK(!large.hasValue());
+    CHECK(moved.cast_<std::string>().size() == 200);
+
+    // 只能移动的类型取出时把值移动出来
+    Any owner = std::make_unique<int>(7);
+    std::unique_ptr<int> value = owner.cast_<std::unique_ptr<int>>();
+    CHECK(value != nullptr && *value == 7);
+}
+
+static void testFuture() {
+    ThreadPool pool;
+    pool.start(2);
+
+    Promise<int> promise;
+    Future<int> future = promise.getFuture();
+    Future<std::string> next = future.then(pool, [](int v) { return std::to_string(v * 2); });
+    CHECK(!future.valid());
+    promise.setValue(21);
+    CHECK(next.get() == "42");
+
+    // 异常沿着then传下去，后面的函数不执行
+    Promise<int> failing;
+    bool ran = false;
+    Future<void> after = failing.getFuture().then(pool, [&ran](int) { ran = true; });
+    failing.setException(std::make_exception_ptr(std::runtime_error("source")));
+    CHECK_THROWS(after.get(), std::runtime_error);
+    CHECK(!ran);
+
+    // 放弃的Promise让等待方得到broken_promise
+    Future<int> broken;
+    {
+        Promise<int> abandoned;
+        broken = abandoned.getFuture();
+    }
+    CHECK_THROWS(broken.get(), std::future_error);
+}
+
+static void testResultThen() {
+    ThreadPool pool;
+    pool.start(2);
+
+    Result result = pool.submitTask(fnTask([]() { return 20; }));
+    Result next = result.then([](Any value) { return value.cast_<int>() + 1; });
+    CHECK(next.isValid());
+    CHECK(next.get().cast_<int>() == 21);
+
+    // 每个结果只有一个完成通知
+    Result once = pool.submitTask(fnTask([]() { return 1; }));
+    Result after = once.then([](Any) {});
+    CHECK_THROWS(once.then([](Any) {}), std::logic_error);
+    std::vector<Result> armed;
+    armed.emplace_back(std::move(once));
+    CHECK_THROWS(whenAll(armed), std::logic_error);
+    after.wait();
+
+    // 没有关联线程池或者提交失败的结果返回无效的Result
+    CHECK(!Result().then([](Any) {}).isValid());
+    CHECK(!Result(Future<Any>(), SubmitStatus::STATUS_QUEUE_FULL).then([](Any) {}).isValid());
+
+    // 任务抛出的异常在get()时重新抛出
+    Result failed = pool.submitTask(fnTask([]() -> int { throw std::runtime_error("task"); }));
+    CHECK_THROWS(failed.get(), std::runtime_error);
+}
+
+// 完成队列按完成顺序取出：后提交但先完成的任务先取出
+static void testCompletionQueue() {
+    ThreadPool pool;
+    pool.start(2);
+
+    std::atomic_bool release {false};
+    CompletionQueue queue;
+    queue.submitTask(pool, fnTask([&release]() {
+        while (!release.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return 1;
+    }), 1);
+    queue.submitTask(pool, fnTask([]() { return 2; }), 2);
+    CHECK(queue.pending() == 2);
+
+    Completion done;
+    CHECK(queue.next(done));
+    CHECK(done.tag == 2);
+    CHECK(done.result.get().cast_<int>() == 2);
+    CHECK(!queue.tryNext(done));
+    release.store(true);
+    CHECK(queue.next(done));
+    CHECK(done.tag == 1);
+    CHECK(done.result.get().cast_<int>() == 1);
+    CHECK(!queue.next(done));
+    CHECK(queue.pending() == 0);
+
+    // 提交失败的结果立即可以取出
+    CompletionQueue failures;
+    failures.add(Result(Future<Any>(), SubmitStatus::STATUS_QUEUE_FULL), 9);
+    CHECK(failures.nextFor(done, std::chrono::milliseconds(1000)));
+    CHECK(done.tag == 9);
+    CHECK(!done.result.isValid());
+
+    // 一直不确定的结果：完成队列先析构，之后结果才确定，通知什么也不做，也不会泄漏
+    Promise<Any> late;
+    {
+        CompletionQueue abandoned;
+        abandoned.add(Result(late.getFuture()), 3);
+        CHECK(!abandoned.tryNext(done));
+    }
+    late.setValue(Any(3));
+}
+
+static void testWhenAllWhenAny() {
+    ThreadPool pool;
+    pool.start(2);
+
+    std::vector<Result> results;
+    for (int i = 0; i < 8; i ++) {
+        results.emplace_back(pool.submitTask(fnTask([i]() { return i; })));
+    }
+    whenAll(results).get();
+    int sum = 0;
+    for (Result &result : results) {
+        CHECK(result.isReady());
+        sum += result.get().cast_<int>();
+    }
+    CHECK(sum == 28);
+    std::vector<Result> empty;
+    whenAll(empty).get();
+
+    std::atomic_bool release {false};
+    std::vector<Result> race;
+    race.emplace_back(pool.submitTask(fnTask([&release]() {
+        while (!release.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return 0;
+    })));
+    race.emplace_back(pool.submitTask(fnTask([]() { return 1; })));
+    CHECK(whenAny(race).get() == 1);
+    CHECK(race[1].get().cast_<int>() == 1);
+    release.store(true);
+    CHECK(race[0].get().cast_<int>() == 0);
+    CHECK_THROWS(whenAny(empty), std::invalid_argument);
+
+    // 结果一直不确定时放弃等待：结果和计数之间没有环，Promise放弃之后全部释放
+    {
+        Promise<Any> never;
+        std::vector<Result> pending;
+        pending.emplace_back(never.getFuture());
+        Future<void> abandoned = whenAll(pending);
+        CHECK(!abandoned.isReady());
+    }
+}
+
+static CoTask<int> square(ThreadPool &pool, int v) {
+    co_await pool.schedule();
+    co_return v * v;
+}
+
+static CoTask<int> sumSquares(ThreadPool &pool) {
+    auto [a, b, c] = co_await whenAll(square(pool, 1), square(pool, 2), square(pool, 3));
+    co_return a + b + c;
+}
+
+static CoTask<int> throwing(ThreadPool &pool) {
+    co_await pool.schedule();
+    throw std::runtime_error("coroutine");
+}
+
+static void testCoroutines() {
+    ThreadPool pool;
+    pool.start(2);
+
+    CHECK(syncWait(sumSquares(pool)) == 14);
+
+    std::vector<CoTask<int>> tasks;
+    for (int i = 0; i < 10; i ++) {
+        tasks.push_back(square(pool, i));
+    }
+    std::vector<int> values = syncWait(whenAll(std::move(tasks)));
+    CHECK(values.size() == 10 && values[9] == 81);
+
+    std::vector<CoTask<int>> race;
+    race.push_back(square(pool, 5));
+    WhenAnyResult<int> any = syncWait(whenAny(std::move(race)));
+    CHECK(any.index == 0 && any.value == 25);
+
+    CHECK_THROWS(syncWait(throwing(pool)), std::runtime_error);
+
+    // 分离的协程抛出的异常在join()时重新抛出，而不是终止进程
+    CoDetached failed = throwing(pool).detach();
+    CHECK_THROWS(failed.join(), std::runtime_error);
+    CHECK(!failed.isValid());
+    CoDetached done = square(pool, 4).detach();
+    done.join();
+    // 不等待的协程照常执行完毕，异常被丢弃
+    throwing(pool).detach();
+}
+
+static CoTask<int> scheduled(ThreadPool &pool, std::atomic_bool &resumed) {
+    co_await pool.schedule();
+    resumed.store(true);
+    co_return 1;
+}
+
+// 队列满时POLICY_DROP_OLDEST只丢弃用户任务：排在最前面的协程恢复点不能被丢弃，否则协程永远不会恢复
+static void testScheduleSurvivesDropOldest() {
+    forEachDropOldest([](DropOldestFixture &fixture) {
+        ThreadPool &pool = fixture.pool();
+        std::atomic_bool resumed {false};
+        CoTask<int> task = scheduled(pool, resumed);
+        std::thread waiter([&task]() { CHECK(syncWait(std::move(task)) == 1); });
+        CHECK(waitUntil([&pool]() { return pool.getLaneDepth(TaskPriority::PRIORITY_NORMAL) == 1; }));
+        fixture.overflow();
+        waiter.join();
+        CHECK(resumed.load());
+    });
+}
+
+int main() {
+    RUN_TEST(testAny);
+    RUN_TEST(testFuture);
+    RUN_TEST(testResultThen);
+    RUN_TEST(testCompletionQueue);
+    RUN_TEST(testWhenAllWhenAny);
+    RUN_TEST(testCoroutines);
+    RUN_TEST(testScheduleSurvivesDropOldest);
+    return checkResult();
+}
@@ -0,0 +1,176 @@
+// 测试用的断言和辅助工具
+// 每个测试程序由若干个测试函数组成，CHECK失败时打印位置并记录，main最后返回失败的数量，交给ctest判断
+
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include "threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+inline int &checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            checkFailures() ++;                                                  \
+        }                                                                        \
+    } while (0)
+
+// 期望表达式抛出指定类型的异常
+#define CHECK_THROWS(expr, type)                                                 \
+    do {                                                                         \
+        bool thrown = false;                                                     \
+        try {                                                                    \
+            (void)(expr);                                                        \
+        } catch (const type&) {                                                  \
+            thrown = true;                                                       \
+        } catch (...) {                                                          \
+        }                                                                        \
+        if (!thrown) {                                                           \
+            std::fprintf(stderr, "%s:%d: %s did not throw %s\n", __FILE__, __LINE__, #expr, #type); \
+            checkFailures() ++;                                                  \
+        }                                                                        \
+    } while (0)
+
+// 依次执行测试函数，打印每个测试的名字，方便定位卡住的测试
+#define RUN_TEST(func)                                                           \
+    do {                                                                         \
+        std::fprintf(stderr, "[ RUN  ] %s\n", #func);                            \
+        func();                                                                  \
+    } while (0)
+
+inline int checkResult() {
+    std::fprintf(stderr, checkFailures() == 0 ? "all checks passed\n" : "%d checks failed\n", checkFailures());
+    return checkFailures() == 0 ? 0 : 1;
+}
+
+// 把函数包装成任务，函数没有返回值时run()返回空的Any
+template<typename F>
+class FnTask : public Task {
+public:
+    explicit FnTask(F func)
+        : func_(std::move(func))
+    {}
+
+    Any run() override {
+        if constexpr (std::is_void_v<std::invoke_result_t<F&>>) {
+            func_();
+            return Any();
+        } else {
+            return func_();
+        }
+    }
+
+private:
+    F func_;
+};
+
+template<typename F>
+std::shared_ptr<Task> fnTask(F func) {
+    return makeTask<FnTask<F>>(std::move(func));
+}
+
+// 占住线程池的线程，在它放开之前提交的任务都留在队列里，用来检查出队顺序和溢出策略
+class Gate {
+public:
+    // 提交一个占住线程的任务，等它开始执行后返回
+    void hold(ThreadPool &pool) {
+        result_ = pool.submitTask(fnTask([this]() {
+            started_.store(true);
+            while (!open_.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }));
+        while (!started_.load()) {
+            std::this_thread::yield();
+        }
+    }
+
+    void release() {
+        open_.store(true);
+        result_.wait();
+    }
+
+private:
+    std::atomic_bool started_ {false};
+    std::atomic_bool open_ {false};
+    Result result_;
+};
+
+// 等待条件成立，最多等timeout，返回条件最终是否成立
+template<typename Pred>
+bool waitUntil(Pred pred, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+
+// 内部组件在POLICY_DROP_OLDEST下的测试环境：队列阈值为2，唯一的线程被占住
+// 测试先投递内部组件的任务，再调用overflow()提交用户任务直到有一个被丢弃，然后检查内部组件的工作照常完成
+class DropOldestFixture {
+public:
+    DropOldestFixture(QueueType queue, QueueOrder order) {
+        pool_.setQueueType(queue);
+        pool_.setQueueOrder(order);
+        pool_.setTaskQueMaxThreshHold(2);
+        pool_.setOverflowPolicy(OverflowPolicy::POLICY_DROP_OLDEST);
+        pool_.start(1);
+        gate_.hold(pool_);
+    }
+
+    ThreadPool &pool() {
+        return pool_;
+    }
+
+    // 提交用户任务直到有一个被丢弃(环形队列会先把排在前面的内部任务挪到车道队列)，然后放开线程
+    void overflow() {
+        for (int i = 0; i < 4 && pool_.getDroppedTaskCount() == 0; i ++) {
+            results_.emplace_back(pool_.submitTask(fnTask([this]() { ran_ ++; })));
+        }
+        gate_.release();
+    }
+
+    // 被丢弃的只有一个用户任务，其余的用户任务都执行了
+    void finish() {
+        CHECK(pool_.getDroppedTaskCount() == 1);
+        CHECK(waitUntil([this]() { return ran_.load() + 1 == results_.size(); }));
+    }
+
+private:
+    ThreadPool pool_;
+    Gate gate_;
+    std::atomic<size_t> ran_ {0};
+    std::vector<Result> results_;
+};
+
+// 在每种队列和出队顺序下执行body(fixture)，body中检查内部组件的工作完成
+template<typename Body>
+void forEachDropOldest(Body body) {
+    for (QueueType queue : { QueueType::QUEUE_MUTEX, QueueType::QUEUE_LOCK_FREE_RING }) {
+        for (QueueOrder order : { QueueOrder::ORDER_FIFO, QueueOrder::ORDER_DEADLINE }) {
+            DropOldestFixture fixture(queue, order);
+            body(fixture);
+            fixture.finish();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,307 @@
+// 建立在线程池之上的执行器的行为测试：任务图、strand、流水线
+
+#include "check.h"
+#include "pipeline.h"
+#include "strand.h"
+#include "taskgraph.h"
+
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// 只有一个线程的线程池里，在工作线程上执行body(pool)：body等待内部组件时要帮忙执行，否则会死锁
+template<typename Body, typename T>
+static void checkWaitOnWorker(Body body, T expected) {
+    for (PoolMode mode : { PoolMode::MODE_FIXED, PoolMode::MODE_WORK_STEALING }) {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(1);
+
+        Result result = pool.submitTask(fnTask([&pool, &body]() { return body(pool); }));
+        CHECK(result.waitFor(std::chrono::milliseconds(5000)));
+        CHECK(result.get().cast_<T>() == expected);
+    }
+}
+
+// 菱形依赖：合并节点在两个分支之后执行，图可以反复运行
+static void testTaskGraph() {
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_WORK_STEALING);
+    pool.start(4);
+
+    std::atomic<int> step {0};
+    int parseAt = -1, leftAt = -1, rightAt = -1, mergeAt = -1;
+    TaskGraph graph;
+    auto parse = graph.addNode([&]() { parseAt = step ++; });
+    auto left = graph.addNode([&]() { leftAt = step ++; });
+    auto right = graph.addNode([&]() { rightAt = step ++; });
+    auto merge = graph.addNode([&]() { mergeAt = step ++; });
+    graph.precede(parse, left);
+    graph.precede(parse, right);
+    graph.precede(left, merge);
+    graph.precede(right, merge);
+
+    for (int round = 0; round < 3; round ++) {
+        step = 0;
+        graph.run(pool);
+        graph.wait();
+        CHECK(graph.isDone());
+        CHECK(parseAt == 0);
+        CHECK(leftAt > parseAt && rightAt > parseAt);
+        CHECK(mergeAt == 3);
+    }
+
+    // 节点抛出的异常在wait()重新抛出，之后的节点不再执行
+    TaskGraph failing;
+    bool ran = false;
+    auto first = failing.addNode([]() { throw std::runtime_error("node"); });
+    auto second = failing.addNode([&ran]() { ran = true; });
+    failing.precede(first, second);
+    failing.run(pool);
+    CHECK_THROWS(failing.wait(), std::runtime_error);
+    CHECK(!ran);
+
+    // 有环的图拒绝运行
+    TaskGraph cyclic;
+    auto a = cyclic.addNode([]() {});
+    auto b = cyclic.addNode([]() {});
+    cyclic.precede(a, b);
+    cyclic.precede(b, a);
+    CHECK_THROWS(cyclic.run(pool), std::logic_error);
+}
+
+// 节点是内部任务：队列满时POLICY_DROP_OLDEST丢弃的是用户任务，图照常运行结束
+static void testTaskGraphSurvivesDropOldest() {
+    forEachDropOldest([](DropOldestFixture &fixture) {
+        std::atomic<int> ran {0};
+        TaskGraph graph;
+        auto root = graph.addNode([&ran]() { ran ++; });
+        auto leaf = graph.addNode([&ran]() { ran ++; });
+        graph.precede(root, leaf);
+        graph.run(fixture.pool());
+        fixture.overflow();
+        CHECK(graph.waitFor(std::chrono::milliseconds(5000)));
+        CHECK(ran.load() == 2);
+    });
+}
+
+// 只有一个线程的线程池里，任务运行任务图并等待它结束：等待的线程帮忙执行节点，不会死锁
+static void testTaskGraphWaitOnWorker() {
+    checkWaitOnWorker([](ThreadPool &pool) {
+        std::atomic<int> ran {0};
+        TaskGraph graph;
+        auto root = graph.addNode([&ran]() { ran ++; });
+        for (int i = 0; i < 8; i ++) {
+            graph.precede(root, graph.addNode([&ran]() { ran ++; }));
+        }
+        graph.run(pool);
+        graph.wait();
+        return ran.load();
+    }, 9);
+}
+
+// 同一个strand的任务按提交顺序执行，从不并发
+static void testStrand() {
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_WORK_STEALING);
+    pool.start(4);
+
+    Strand strand(pool);
+    std::atomic<int> running {0};
+    std::atomic_bool overlapped {false};
+    std::vector<int> order;
+    for (int i = 0; i < 1000; i ++) {
+        strand.post([&, i]() {
+            if (running.fetch_add(1) != 0) {
+                overlapped.store(true);
+            }
+            order.push_back(i);
+            running.fetch_sub(1);
+        });
+    }
+    Result last = strand.submitTask(fnTask([]() { return 1; }));
+    CHECK(last.get().cast_<int>() == 1);
+    CHECK(!overlapped.load());
+    bool inOrder = order.size() == 1000;
+    for (size_t i = 0; inOrder && i < order.size(); i ++) {
+        inOrder = order[i] == static_cast<int>(i);
+    }
+    CHECK(inOrder);
+}
+
+// 按键串行：同一个键的任务串行，不同的键互不影响
+static void testKeyedStrands() {
+    ThreadPool pool;
+    pool.start(4);
+
+    const uint64_t KEYS = 8;
+    std::vector<std::vector<int>> orders(KEYS);
+    std::vector<Result> results;
+    for (int i = 0; i < 400; i ++) {
+        uint64_t key = static_cast<uint64_t>(i) % KEYS;
+        results.emplace_back(pool.submitTask(key, fnTask([&orders, key, i]() { orders[key].push_back(i); })));
+    }
+    for (Result &result : results) {
+        result.get();
+    }
+    bool inOrder = true;
+    for (uint64_t key = 0; key < KEYS; key ++) {
+        inOrder = inOrder && orders[key].size() == 50;
+        for (size_t j = 1; inOrder && j < orders[key].size(); j ++) {
+            inOrder = orders[key][j] > orders[key][j - 1];
+        }
+    }
+    CHECK(inOrder);
+}
+
+// 队列满时POLICY_DROP_OLDEST不能丢弃排队中的strand：丢弃之后它的待执行计数不再归零，之后投递的任务都不会执行
+static void testStrandSurvivesDropOldest() {
+    forEachDropOldest([](DropOldestFixture &fixture) {
+        ThreadPool &pool = fixture.pool();
+        Strand strand(pool);
+        std::atomic<int> ran {0};
+        strand.post([&ran]() { ran ++; });
+        pool.post(1, [&ran]() { ran ++; });
+        fixture.overflow();
+        CHECK(waitUntil([&ran]() { return ran.load() == 2; }));
+
+        // strand依然可用
+        Result later = strand.submitTask(fnTask([]() { return 3; }));
+        CHECK(later.waitFor(std::chrono::milliseconds(5000)));
+        CHECK(later.get().cast_<int>() == 3);
+        pool.post(1, [&ran]() { ran ++; });
+        CHECK(waitUntil([&ran]() { return ran.load() == 3; }));
+    });
+}
+
+// 并行阶段打乱完成顺序，有序阶段依然按数据源的顺序输出；同时在流水线中的数据项不超过令牌数量
+static void testPipeline() {
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_WORK_STEALING);
+    pool.start(4);
+
+    const int ITEMS = 500;
+    const size_t TOKENS = 8;
+    Pipeline pipeline(TOKENS);
+    int next = 0;
+    std::atomic<int> inFlight {0};
+    std::atomic<int> maxInFlight {0};
+    pipeline.setSource([&](Any &item) {
+        if (next == ITEMS) {
+            return false;
+        }
+        int now = ++ inFlight;
+        int seen = maxInFlight.load();
+        while (now > seen && !maxInFlight.compare_exchange_weak(seen, now)) {}
+        item = next ++;
+        return true;
+    });
+    pipeline.addStage(StageMode::STAGE_PARALLEL, [](Any item) -> Any {
+        int v = item.cast_<int>();
+        if (v % 7 == 0) {
+            std::this_thread::yield();
+        }
+        return v * 2;
+    });
+    std::vector<int> unordered;
+    pipeline.addStage(StageMode::STAGE_SERIAL_OUT_OF_ORDER, [&unordered](Any item) -> Any {
+        unordered.push_back(item.cast_<int>());
+        return item;
+    });
+    std::vector<int> ordered;
+    pipeline.addStage(StageMode::STAGE_SERIAL_IN_ORDER, [&](Any item) -> Any {
+        ordered.push_back(item.cast_<int>());
+        inFlight --;
+        return Any();
+    });
+
+    for (int round = 0; round < 2; round ++) {
+        next = 0;
+        ordered.clear();
+        unordered.clear();
+        pipeline.run(pool);
+        pipeline.wait();
+        CHECK(pipeline.isDone());
+        CHECK(ordered.size() == static_cast<size_t>(ITEMS));
+        CHECK(unordered.size() == static_cast<size_t>(ITEMS));
+        bool inOrder = true;
+        for (int i = 0; inOrder && i < static_cast<int>(ordered.size()); i ++) {
+            inOrder = ordered[i] == i * 2;
+        }
+        CHECK(inOrder);
+        CHECK(maxInFlight.load() <= static_cast<int>(TOKENS));
+    }
+
+    // 阶段抛出的异常在wait()重新抛出
+    Pipeline failing(4);
+    int produced = 0;
+    failing.setSource([&produced](Any &item) {
+        item = produced;
+        return produced ++ < 100;
+    });
+    failing.addStage(StageMode::STAGE_SERIAL_IN_ORDER, [](Any item) -> Any {
+        if (item.cast_<int>() == 10) {
+            throw std::runtime_error("stage");
+        }
+        return item;
+    });
+    failing.run(pool);
+    CHECK_THROWS(failing.wait(), std::runtime_error);
+    CHECK(produced < 100);
+}
+
+// 数到count的流水线：一个有序阶段累加
+static void countTo(Pipeline &pipeline, int count, int &produced, long long &sum) {
+    pipeline.setSource([&produced, count](Any &item) {
+        if (produced == count) {
+            return false;
+        }
+        item = produced ++;
+        return true;
+    });
+    pipeline.addStage(StageMode::STAGE_SERIAL_OUT_OF_ORDER, [](Any item) -> Any { return item; });
+    pipeline.addStage(StageMode::STAGE_SERIAL_IN_ORDER, [&sum](Any item) -> Any {
+        sum += item.cast_<int>();
+        return Any();
+    });
+}
+
+// 令牌是内部任务：队列满时POLICY_DROP_OLDEST丢弃的是用户任务，流水线照常结束
+static void testPipelineSurvivesDropOldest() {
+    forEachDropOldest([](DropOldestFixture &fixture) {
+        Pipeline pipeline(4);
+        int produced = 0;
+        long long sum = 0;
+        countTo(pipeline, 100, produced, sum);
+        pipeline.run(fixture.pool());
+        fixture.overflow();
+        CHECK(pipeline.waitFor(std::chrono::milliseconds(5000)));
+        CHECK(sum == 4950);
+    });
+}
+
+// 只有一个线程的线程池里，任务运行流水线并等待它结束：等待的线程帮忙执行令牌，不会死锁
+static void testPipelineWaitOnWorker() {
+    checkWaitOnWorker([](ThreadPool &pool) {
+        Pipeline pipeline(4);
+        int produced = 0;
+        long long sum = 0;
+        countTo(pipeline, 100, produced, sum);
+        pipeline.run(pool);
+        pipeline.wait();
+        return sum;
+    }, 4950LL);
+}
+
+int main() {
+    RUN_TEST(testTaskGraph);
+    RUN_TEST(testTaskGraphSurvivesDropOldest);
+    RUN_TEST(testTaskGraphWaitOnWorker);
+    RUN_TEST(testStrand);
+    RUN_TEST(testKeyedStrands);
+    RUN_TEST(testStrandSurvivesDropOldest);
+    RUN_TEST(testPipeline);
+    RUN_TEST(testPipelineSurvivesDropOldest);
+    RUN_TEST(testPipelineWaitOnWorker);
+    return checkResult();
+}
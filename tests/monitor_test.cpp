@@ -0,0 +1,157 @@
+// 运行指标和调度追踪的行为测试：快照中的计数和分布、Prometheus文本格式、Chrome trace的导出和嵌套的任务
+
+#include "check.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 统计text中sub出现的次数
+static size_t countOf(const std::string &text, const std::string &sub) {
+    size_t count = 0;
+    for (size_t pos = text.find(sub); pos != std::string::npos; pos = text.find(sub, pos + sub.size())) {
+        count ++;
+    }
+    return count;
+}
+
+// 快照：瞬时值反映线程和队列的状态，累计值覆盖所有执行过的任务
+static void testSnapshot() {
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1);
+    pool.setOverflowPolicy(OverflowPolicy::POLICY_DROP_OLDEST);
+    pool.start(2);
+
+    std::vector<Result> results;
+    for (int i = 0; i < 100; i ++) {
+        Result result = pool.submitTask(fnTask([i]() { return i; }));
+        result.get();
+    }
+
+    // 两个线程都被占住，队列阈值为1，第二个排队的任务挤掉第一个
+    Gate first, second;
+    first.hold(pool);
+    second.hold(pool);
+    Result dropped = pool.submitTask(fnTask([]() {}));
+    Result kept = pool.submitTask(fnTask([]() {}));
+    MetricsSnapshot busy = pool.snapshot();
+    CHECK(busy.threads == 2);
+    CHECK(busy.pendingTasks == 1);
+    CHECK(busy.droppedTasks == 1);
+    first.release();
+    second.release();
+    kept.get();
+
+    MetricsSnapshot snap = pool.snapshot();
+    CHECK(snap.threads == 2);
+    CHECK(snap.pendingTasks == 0);
+    CHECK(snap.laneDepth.size() == TASK_PRIORITY_COUNT);
+    if (snap.enabled) {
+        // 100个任务、两个占住线程的任务和最后一个任务；结果就绪时工作线程可能还没有记录这个任务
+        // 快照逐项读取各个计数，工作线程同时在记录时一次快照里的计数可能不一致，等到全部到齐
+        CHECK(waitUntil([&pool, &snap]() {
+            snap = pool.snapshot();
+            return snap.total.tasks == 103 && snap.queueWait.count() == 103 && snap.runTime.count() == 103;
+        }));
+        CHECK(snap.workers.size() == 2);
+        uint64_t tasks = 0;
+        for (const WorkerStats &w : snap.workers) {
+            tasks += w.tasks;
+        }
+        CHECK(tasks == snap.total.tasks);
+        CHECK(snap.queueWait.percentile(0.5) <= snap.queueWait.max());
+    }
+}
+
+// Prometheus文本格式：每个指标都有HELP和TYPE，前缀可以替换
+static void testPrometheus() {
+    ThreadPool pool;
+    pool.start(2);
+    for (int i = 0; i < 10; i ++) {
+        pool.submitTask(fnTask([]() {})).get();
+    }
+
+    MetricsSnapshot snap = pool.snapshot();
+    if (snap.enabled) {
+        CHECK(waitUntil([&pool, &snap]() {
+            snap = pool.snapshot();
+            return snap.total.tasks == 10 && snap.runTime.count() == 10;
+        }));
+    }
+    std::string text = snap.toPrometheus();
+    CHECK(text.find("# TYPE threadpool_threads gauge\nthreadpool_threads 2\n") != std::string::npos);
+    CHECK(text.find("threadpool_dropped_tasks_total 0\n") != std::string::npos);
+    CHECK(countOf(text, "# HELP ") == countOf(text, "# TYPE "));
+    if (snap.enabled) {
+        CHECK(text.find("# TYPE threadpool_tasks_total counter\n") != std::string::npos);
+        CHECK(text.find("threadpool_tasks_total{worker=\"0\"}") != std::string::npos);
+        CHECK(text.find("threadpool_queue_wait_seconds{quantile=\"0.99\"}") != std::string::npos);
+        CHECK(text.find("threadpool_run_seconds_count 10\n") != std::string::npos);
+    }
+
+    std::string custom = snap.toPrometheus("app_pool");
+    CHECK(custom.find("app_pool_threads 2\n") != std::string::npos);
+    CHECK(custom.find("threadpool_") == std::string::npos);
+}
+
+static std::string chromeTrace(const ThreadPool &pool) {
+    std::ostringstream out;
+    pool.writeChromeTrace(out);
+    return out.str();
+}
+
+// 调度追踪：每个执行完的任务在Chrome trace中对应一段时间，停止追踪后不再记录
+static void testChromeTrace() {
+    ThreadPool pool;
+    pool.start(2);
+    pool.startTracing(1024);
+    std::vector<Result> results;
+    for (int i = 0; i < 10; i ++) {
+        results.emplace_back(pool.submitTask(fnTask([]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        })));
+    }
+    for (Result &result : results) {
+        result.get();
+    }
+    // 结果就绪时工作线程可能还没有记录结束事件
+    CHECK(waitUntil([&pool]() { return countOf(chromeTrace(pool), "\"ph\":\"X\",\"name\":\"task\"") == 10; }));
+    pool.stopTracing();
+    pool.submitTask(fnTask([]() {})).get();
+
+    std::string json = chromeTrace(pool);
+    CHECK(json.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0) == 0);
+    CHECK(json.size() >= 4 && json.compare(json.size() - 4, 4, "\n]}\n") == 0);
+    CHECK(countOf(json, "\"ph\":\"X\",\"name\":\"task\"") == 10);
+    CHECK(countOf(json, "\"ph\":\"i\",\"name\":\"submit\"") == 10);
+    CHECK(countOf(json, "\"ph\":\"B\",\"name\":\"task\"") == 0);
+    CHECK(json.find("\"name\":\"worker 0\"") != std::string::npos);
+    CHECK(json.find("\"name\":\"thread 0\"") != std::string::npos);
+}
+
+// 等待结果时帮忙执行的任务嵌套在外层任务的时间段里，内外两层都能配成完整的一段
+static void testNestedSpans() {
+    for (PoolMode mode : { PoolMode::MODE_FIXED, PoolMode::MODE_WORK_STEALING }) {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(1);
+        pool.startTracing(1024);
+
+        Result outer = pool.submitTask(fnTask([&pool]() {
+            Result first = pool.submitTask(fnTask([]() { return 1; }));
+            Result second = pool.submitTask(fnTask([]() { return 2; }));
+            return second.get().cast_<int>() + first.get().cast_<int>();
+        }));
+        CHECK(outer.get().cast_<int>() == 3);
+        CHECK(waitUntil([&pool]() { return countOf(chromeTrace(pool), "\"ph\":\"X\",\"name\":\"task\"") == 3; }));
+        CHECK(countOf(chromeTrace(pool), "\"ph\":\"B\",\"name\":\"task\"") == 0);
+    }
+}
+
+int main() {
+    RUN_TEST(testSnapshot);
+    RUN_TEST(testPrometheus);
+    RUN_TEST(testChromeTrace);
+    RUN_TEST(testNestedSpans);
+    return checkResult();
+}
@@ -0,0 +1,187 @@
+// 网络I/O的行为测试(仅Linux)：回显、多个连接并发、大块数据跨越多次读写、处理函数关闭连接、处理函数抛出异常、停止
+
+#include "check.h"
+#include "reactor.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 连接到本机的port，失败返回-1
+static int connectTo(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// 读到n字节或者对端关闭为止
+static std::string recvN(int fd, size_t n) {
+    std::string data;
+    char buf[4096];
+    while (data.size() < n) {
+        ssize_t got = ::recv(fd, buf, sizeof(buf), 0);
+        if (got <= 0) {
+            break;
+        }
+        data.append(buf, static_cast<size_t>(got));
+    }
+    return data;
+}
+
+static void echo(Connection &conn) {
+    conn.send(conn.input());
+    conn.consume(conn.input().size());
+}
+
+// 多个客户端同时回显，数据比读缓冲区和内核发送缓冲区都大时也完整返回
+static void testEcho() {
+    ThreadPool pool;
+    pool.start(4);
+    IoReactor reactor(pool, 2);
+    uint16_t port = reactor.listen(0, echo);
+    CHECK(port != 0);
+    reactor.start();
+
+    std::vector<std::thread> clients;
+    std::atomic<int> ok {0};
+    for (int c = 0; c < 4; c ++) {
+        clients.emplace_back([port, c, &ok]() {
+            int fd = connectTo(port);
+            if (fd < 0) {
+                return;
+            }
+            bool good = true;
+            for (int round = 0; round < 20; round ++) {
+                std::string message = "client " + std::to_string(c) + " round " + std::to_string(round);
+                good = good && sendAll(fd, message) && recvN(fd, message.size()) == message;
+            }
+            ::close(fd);
+            if (good) {
+                ok ++;
+            }
+        });
+    }
+    int fd = connectTo(port);
+    CHECK(fd >= 0);
+    std::string large(4 << 20, '\0');
+    for (size_t i = 0; i < large.size(); i ++) {
+        large[i] = static_cast<char>('a' + i % 26);
+    }
+    // 一边发一边收，避免两端的内核缓冲区都满了互相等待
+    std::thread sender([fd, &large]() { sendAll(fd, large); });
+    std::string back = recvN(fd, large.size());
+    sender.join();
+    CHECK(back == large);
+    ::close(fd);
+
+    for (std::thread &client : clients) {
+        client.join();
+    }
+    CHECK(ok.load() == 4);
+    CHECK(waitUntil([&reactor]() { return reactor.connectionCount() == 0; }));
+    reactor.stop();
+}
+
+// 处理函数回复后关闭连接：客户端先收到完整的回复再读到EOF，连接数量回到0
+static void testCloseAfterReply() {
+    ThreadPool pool;
+    pool.start(2);
+    IoReactor reactor(pool);
+    uint16_t port = reactor.listen(0, [](Connection &conn) {
+        size_t pos = conn.input().find('\n');
+        if (pos == std::string_view::npos) {
+            return;
+        }
+        conn.send("bye ");
+        conn.send(conn.input().substr(0, pos + 1));
+        conn.consume(pos + 1);
+        conn.close();
+    });
+    reactor.start();
+
+    int fd = connectTo(port);
+    CHECK(fd >= 0);
+    CHECK(waitUntil([&reactor]() { return reactor.connectionCount() == 1; }));
+    // 请求分两次到达，第一次不完整
+    CHECK(sendAll(fd, "hel"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK(sendAll(fd, "lo\n"));
+    CHECK(recvN(fd, 1 << 10) == "bye hello\n");
+    ::close(fd);
+    CHECK(waitUntil([&reactor]() { return reactor.connectionCount() == 0; }));
+
+    // 停止时仍然打开的连接被关闭，客户端读到EOF
+    int idle = connectTo(port);
+    CHECK(idle >= 0);
+    CHECK(waitUntil([&reactor]() { return reactor.connectionCount() == 1; }));
+    reactor.stop();
+    CHECK(reactor.connectionCount() == 0);
+    CHECK(recvN(idle, 1).empty());
+    ::close(idle);
+}
+
+// 处理函数抛出异常：连接按出错关闭，异常交给线程池的错误处理函数，其他连接不受影响，stop不会卡住
+static void testHandlerThrows() {
+    std::atomic<int> errors {0};
+    ThreadPool pool;
+    pool.setErrorHandler([&errors](std::exception_ptr) { errors ++; });
+    pool.start(2);
+    IoReactor reactor(pool);
+    uint16_t port = reactor.listen(0, [](Connection &conn) {
+        if (conn.input().find("boom") != std::string_view::npos) {
+            throw std::runtime_error("boom");
+        }
+        echo(conn);
+    });
+    reactor.start();
+
+    int bad = connectTo(port);
+    CHECK(bad >= 0);
+    CHECK(sendAll(bad, "boom"));
+    CHECK(recvN(bad, 1).empty());
+    ::close(bad);
+    // 连接交还之后才把异常交给错误处理函数
+    CHECK(waitUntil([&errors]() { return errors.load() == 1; }));
+    CHECK(waitUntil([&reactor]() { return reactor.connectionCount() == 0; }));
+
+    int good = connectTo(port);
+    CHECK(good >= 0);
+    CHECK(sendAll(good, "ping") && recvN(good, 4) == "ping");
+    reactor.stop();
+    CHECK(reactor.connectionCount() == 0);
+    ::close(good);
+}
+
+int main() {
+    RUN_TEST(testEcho);
+    RUN_TEST(testCloseAfterReply);
+    RUN_TEST(testHandlerThrows);
+    return checkResult();
+}
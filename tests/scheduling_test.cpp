@@ -0,0 +1,610 @@
+// 线程池调度的行为测试：各种模式和队列下的正确性、车道和截止时间的出队顺序、溢出策略、取消和截止时间、
+// 批量提交、并行循环、等待时帮忙执行、阻塞补偿、挂起唤醒、绑核、cached模式的伸缩、车道任务的批量出队以及post抛出的异常
+
+#include "check.h"
+
+#include <algorithm>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// 当前线程所在的CPU，不支持的平台返回-1
+static int currentCpu() {
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+static long long sumRange(long long begin, long long end) {
+    long long sum = 0;
+    for (long long i = begin; i < end; i ++) {
+        sum += i;
+    }
+    return sum;
+}
+
+// 每种模式和队列组合下提交一批任务，结果都正确
+static void testModes() {
+    struct Config {
+        PoolMode mode;
+        QueueType queue;
+    };
+    const Config configs[] = {
+        { PoolMode::MODE_FIXED, QueueType::QUEUE_MUTEX },
+        { PoolMode::MODE_FIXED, QueueType::QUEUE_LOCK_FREE_RING },
+        { PoolMode::MODE_CACHED, QueueType::QUEUE_MUTEX },
+        { PoolMode::MODE_WORK_STEALING, QueueType::QUEUE_MUTEX },
+        { PoolMode::MODE_WORK_STEALING, QueueType::QUEUE_LOCK_FREE_RING },
+    };
+    for (const Config &config : configs) {
+        ThreadPool pool;
+        pool.setMode(config.mode);
+        pool.setQueueType(config.queue);
+        pool.start(4);
+
+        std::vector<Result> results;
+        for (long long i = 0; i < 200; i ++) {
+            results.emplace_back(pool.submitTask(fnTask([i]() { return sumRange(i * 100, (i + 1) * 100); })));
+        }
+        long long total = 0;
+        for (Result &result : results) {
+            total += result.get().cast_<long long>();
+        }
+        CHECK(total == sumRange(0, 20000));
+    }
+}
+
+// 工作窃取模式下任务里提交的子任务进入本地队列，其他线程窃取后一样能执行完
+static void testWorkStealingSpawn() {
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_WORK_STEALING);
+    pool.start(4);
+
+    std::atomic<int> done {0};
+    Result parent = pool.submitTask(fnTask([&pool, &done]() {
+        std::vector<Result> children;
+        for (int i = 0; i < 64; i ++) {
+            children.emplace_back(pool.submitTask(fnTask([&done]() { done ++; })));
+        }
+        for (Result &child : children) {
+            child.get();
+        }
+    }));
+    parent.get();
+    CHECK(done.load() == 64);
+}
+
+// 占住唯一的线程后按车道提交，放开后高优先级车道先执行
+static void testLanePriority() {
+    ThreadPool pool;
+    pool.setPriorityAging(std::chrono::milliseconds(0));
+    pool.start(1);
+
+    std::mutex mtx;
+    std::vector<int> order;
+    auto record = [&](int id) {
+        return fnTask([&mtx, &order, id]() {
+            std::lock_guard<std::mutex> lock(mtx);
+            order.push_back(id);
+        });
+    };
+
+    Gate gate;
+    gate.hold(pool);
+    Result low = pool.submitTask(record(2), TaskPriority::PRIORITY_LOW);
+    Result normal = pool.submitTask(record(1), TaskPriority::PRIORITY_NORMAL);
+    Result high = pool.submitTask(record(0), TaskPriority::PRIORITY_HIGH);
+    CHECK(pool.getLaneDepth(TaskPriority::PRIORITY_LOW) == 1);
+    gate.release();
+    low.get();
+    normal.get();
+    high.get();
+    CHECK((order == std::vector<int> { 0, 1, 2 }));
+}
+
+// 同一车道内按租户权重轮转：权重为2的租户每轮连续执行两个任务
+static void testTenantWeights() {
+    ThreadPool pool;
+    pool.setTenantWeight(1, 2);
+    pool.start(1);
+
+    std::mutex mtx;
+    std::vector<uint32_t> order;
+    Gate gate;
+    gate.hold(pool);
+    std::vector<Result> results;
+    for (int i = 0; i < 3; i ++) {
+        for (uint32_t tenant : { 1u, 2u }) {
+            results.emplace_back(pool.submitTask(fnTask([&mtx, &order, tenant]() {
+                std::lock_guard<std::mutex> lock(mtx);
+                order.push_back(tenant);
+            }), TaskPriority::PRIORITY_NORMAL, tenant));
+        }
+    }
+    gate.release();
+    for (Result &result : results) {
+        result.get();
+    }
+    CHECK((order == std::vector<uint32_t> { 1, 1, 2, 1, 2, 2 }));
+}
+
+// 取空的租户不再占用车道队列里的记录，下标复用之后权重和轮转照常
+static void testTenantReclaim() {
+    LaneQueue<int> queue(1);
+    queue.setWeight(7, 2);
+    for (uint32_t tenant = 100; tenant < 1100; tenant ++) {
+        queue.push(static_cast<int>(tenant), 0, tenant);
+    }
+    CHECK(queue.tenantCount(0) == 1000);
+    int item = 0;
+    // 从轮转中间丢弃的租户同样被回收
+    CHECK(queue.popOldest(item, [](int value) { return value == 500; }));
+    CHECK(queue.tenantCount(0) == 999);
+    while (queue.pop(item)) {
+    }
+    CHECK(queue.empty());
+    CHECK(queue.tenantCount(0) == 0);
+
+    for (int i = 0; i < 4; i ++) {
+        queue.push(7, 0, 7);
+        queue.push(8, 0, 8);
+    }
+    CHECK(queue.tenantCount(0) == 2);
+    std::vector<int> order;
+    while (queue.pop(item)) {
+        order.push_back(item);
+    }
+    CHECK((order == std::vector<int> { 7, 7, 8, 7, 7, 8, 8, 8 }));
+    CHECK(queue.tenantCount(0) == 0);
+}
+
+// 截止时间优先：按截止时间从早到晚执行，没有截止时间的排在最后
+static void testDeadlineOrder() {
+    ThreadPool pool;
+    pool.setQueueOrder(QueueOrder::ORDER_DEADLINE);
+    pool.start(1);
+
+    std::mutex mtx;
+    std::vector<int> order;
+    Gate gate;
+    gate.hold(pool);
+    auto now = std::chrono::steady_clock::now();
+    const int offsets[] = { 30, -1, 10, 20 }; // 单位：秒，-1表示没有截止时间
+    std::vector<Result> results;
+    for (int offset : offsets) {
+        SubmitOptions options;
+        if (offset >= 0) {
+            options.deadline = now + std::chrono::seconds(offset);
+        }
+        results.emplace_back(pool.submitTask(fnTask([&mtx, &order, offset]() {
+            std::lock_guard<std::mutex> lock(mtx);
+            order.push_back(offset);
+        }), options));
+    }
+    gate.release();
+    for (Result &result : results) {
+        result.get();
+    }
+    CHECK((order == std::vector<int> { 10, 20, 30, -1 }));
+}
+
+// 队列阈值为2、唯一的线程被占住时，第三个任务按各个溢出策略处理
+static void testOverflowPolicies() {
+    for (QueueType queue : { QueueType::QUEUE_MUTEX, QueueType::QUEUE_LOCK_FREE_RING }) {
+        {
+            ThreadPool pool;
+            pool.setQueueType(queue);
+            pool.setTaskQueMaxThreshHold(2);
+            pool.setOverflowPolicy(OverflowPolicy::POLICY_FAIL_FAST);
+            pool.start(1);
+            Gate gate;
+            gate.hold(pool);
+            Result a = pool.submitTask(fnTask([]() { return 1; }));
+            Result b = pool.submitTask(fnTask([]() { return 2; }));
+            Result c = pool.submitTask(fnTask([]() { return 3; }));
+            CHECK(c.status() == SubmitStatus::STATUS_QUEUE_FULL);
+            CHECK(!c.isValid());
+            gate.release();
+            CHECK(a.get().cast_<int>() == 1);
+            CHECK(b.get().cast_<int>() == 2);
+        }
+        {
+            ThreadPool pool;
+            pool.setQueueType(queue);
+            pool.setTaskQueMaxThreshHold(2);
+            pool.setOverflowPolicy(OverflowPolicy::POLICY_BLOCK);
+            pool.setSubmitTimeout(std::chrono::milliseconds(50));
+            pool.start(1);
+            Gate gate;
+            gate.hold(pool);
+            Result a = pool.submitTask(fnTask([]() {}));
+            Result b = pool.submitTask(fnTask([]() {}));
+            auto begin = std::chrono::steady_clock::now();
+            Result c = pool.submitTask(fnTask([]() {}));
+            CHECK(c.status() == SubmitStatus::STATUS_QUEUE_FULL);
+            CHECK(std::chrono::steady_clock::now() - begin >= std::chrono::milliseconds(40));
+            gate.release();
+        }
+        {
+            ThreadPool pool;
+            pool.setQueueType(queue);
+            pool.setTaskQueMaxThreshHold(2);
+            pool.setOverflowPolicy(OverflowPolicy::POLICY_CALLER_RUNS);
+            pool.start(1);
+            Gate gate;
+            gate.hold(pool);
+            Result a = pool.submitTask(fnTask([]() {}));
+            Result b = pool.submitTask(fnTask([]() {}));
+            std::thread::id caller = std::this_thread::get_id();
+            Result c = pool.submitTask(fnTask([]() { return std::this_thread::get_id(); }));
+            CHECK(c.status() == SubmitStatus::STATUS_CALLER_RUNS);
+            CHECK(c.get().cast_<std::thread::id>() == caller);
+            gate.release();
+        }
+        {
+            ThreadPool pool;
+            pool.setQueueType(queue);
+            pool.setTaskQueMaxThreshHold(2);
+            pool.setOverflowPolicy(OverflowPolicy::POLICY_DROP_OLDEST);
+            pool.start(1);
+            Gate gate;
+            gate.hold(pool);
+            Result a = pool.submitTask(fnTask([]() { return 1; }));
+            Result b = pool.submitTask(fnTask([]() { return 2; }));
+            Result c = pool.submitTask(fnTask([]() { return 3; }));
+            CHECK(c.status() == SubmitStatus::STATUS_OK);
+            CHECK(pool.getDroppedTaskCount() == 1);
+            gate.release();
+            CHECK_THROWS(a.get(), std::future_error);
+            CHECK(b.get().cast_<int>() == 2);
+            CHECK(c.get().cast_<int>() == 3);
+        }
+    }
+}
+
+// 多个线程同时向很小的环形队列提交：POLICY_DROP_OLDEST不会卡住，每个任务要么执行、要么被丢弃、要么按队列满返回
+static void testDropOldestContention() {
+    std::atomic<size_t> ran {0};
+    std::atomic<size_t> full {0};
+    ThreadPool pool;
+    pool.setQueueType(QueueType::QUEUE_LOCK_FREE_RING);
+    pool.setTaskQueMaxThreshHold(4);
+    pool.setOverflowPolicy(OverflowPolicy::POLICY_DROP_OLDEST);
+    pool.start(2);
+
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < 4; t ++) {
+        submitters.emplace_back([&pool, &ran, &full]() {
+            for (int i = 0; i < 5000; i ++) {
+                Result result = pool.submitTask(fnTask([&ran]() { ran ++; }));
+                if (result.status() == SubmitStatus::STATUS_QUEUE_FULL) {
+                    full ++;
+                }
+            }
+        });
+    }
+    for (std::thread &submitter : submitters) {
+        submitter.join();
+    }
+    CHECK(waitUntil([&pool, &ran, &full]() {
+        return ran.load() + full.load() + pool.getDroppedTaskCount() == 20000;
+    }));
+}
+
+// 出队时已经取消或者超过截止时间的任务不再执行
+static void testCancellationAndDeadline() {
+    ThreadPool pool;
+    pool.start(1);
+
+    std::atomic<int> ran {0};
+    Gate gate;
+    gate.hold(pool);
+    CancellationSource source;
+    SubmitOptions cancelled;
+    cancelled.token = source.token();
+    Result a = pool.submitTask(fnTask([&ran]() { ran ++; }), cancelled);
+    SubmitOptions expired;
+    expired.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+    Result b = pool.submitTask(fnTask([&ran]() { ran ++; }), expired);
+    Result c = pool.submitTask(fnTask([&ran]() { ran ++; }));
+    source.cancel();
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    gate.release();
+
+    CHECK_THROWS(a.get(), TaskCancelled);
+    CHECK_THROWS(b.get(), TaskExpired);
+    c.get();
+    CHECK(ran.load() == 1);
+    CHECK(pool.getCancelledTaskCount() == 1);
+    CHECK(pool.getExpiredTaskCount() == 1);
+}
+
+// 批量提交：整批等待，结果按提交顺序排列
+static void testSubmitBatch() {
+    for (PoolMode mode : { PoolMode::MODE_FIXED, PoolMode::MODE_WORK_STEALING }) {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(4);
+
+        std::vector<std::shared_ptr<Task>> tasks;
+        for (int i = 0; i < 100; i ++) {
+            tasks.push_back(fnTask([i]() { return i * i; }));
+        }
+        BatchResult batch = pool.submitBatch(std::move(tasks));
+        CHECK(batch.size() == 100);
+        CHECK(batch.submittedCount() == 100);
+        batch.waitAll();
+        CHECK(batch.isAllReady());
+        for (size_t i = 0; i < batch.size(); i ++) {
+            CHECK(batch[i].get().cast_<int>() == static_cast<int>(i * i));
+        }
+    }
+}
+
+static void testParallelLoops() {
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_WORK_STEALING);
+    pool.start(4);
+
+    std::vector<int> values(10000, 0);
+    pool.parallelFor(0, static_cast<int>(values.size()), 0, [&values](int i) { values[i] = i; });
+    bool filled = true;
+    for (size_t i = 0; i < values.size(); i ++) {
+        filled = filled && values[i] == static_cast<int>(i);
+    }
+    CHECK(filled);
+
+    long long sum = pool.parallelReduce(0LL, 100000LL, 0LL,
+        [](long long i) { return i; },
+        [](long long a, long long b) { return a + b; });
+    CHECK(sum == sumRange(0, 100000));
+    // 初始值不是单位元时也只加一次，分块再多也一样
+    for (size_t grain : { size_t(0), size_t(7), size_t(100000) }) {
+        long long seeded = pool.parallelReduce(0LL, 100000LL, 1000LL,
+            [](long long i) { return i; },
+            [](long long a, long long b) { return a + b; }, grain);
+        CHECK(seeded == sumRange(0, 100000) + 1000);
+    }
+
+    CHECK_THROWS(pool.parallelFor(0, 100, 1, [](int i) {
+        if (i == 42) {
+            throw std::runtime_error("body");
+        }
+    }), std::runtime_error);
+}
+
+// 只有一个线程的线程池里，任务等待自己提交的子任务不会死锁：等待的线程帮忙执行队列里的任务
+static void testHelpingWait() {
+    for (PoolMode mode : { PoolMode::MODE_FIXED, PoolMode::MODE_WORK_STEALING }) {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(1);
+
+        Result outer = pool.submitTask(fnTask([&pool]() {
+            Result inner = pool.submitTask(fnTask([]() { return 7; }));
+            return inner.get().cast_<int>() + 1;
+        }));
+        CHECK(outer.waitFor(std::chrono::milliseconds(5000)));
+        CHECK(outer.get().cast_<int>() == 8);
+    }
+}
+
+// 阻塞补偿：唯一的线程阻塞在BlockingGuard里时，备用线程接着执行队列里的任务
+static void testBlockingGuard() {
+    ThreadPool pool;
+    pool.start(1);
+
+    std::promise<void> signal;
+    std::shared_future<void> signaled = signal.get_future().share();
+    Result blocked = pool.submitTask(fnTask([signaled]() {
+        ThreadPool::blocking([&signaled]() { signaled.wait(); });
+        return 1;
+    }));
+    Result unblocker = pool.submitTask(fnTask([&signal]() { signal.set_value(); }));
+    CHECK(unblocker.waitFor(std::chrono::milliseconds(5000)));
+    CHECK(blocked.waitFor(std::chrono::milliseconds(5000)));
+    CHECK(blocked.get().cast_<int>() == 1);
+}
+
+// 挂起和唤醒：不自旋时每次提交都要唤醒挂起的线程，多个外部线程反复提交等待，不会丢失唤醒
+static void testParkingWakeup() {
+    for (PoolMode mode : { PoolMode::MODE_FIXED, PoolMode::MODE_WORK_STEALING }) {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.setWorkerSpinTime(std::chrono::microseconds(0));
+        pool.start(4);
+
+        std::atomic<int> done {0};
+        std::vector<std::thread> submitters;
+        for (int t = 0; t < 4; t ++) {
+            submitters.emplace_back([&pool, &done]() {
+                for (int round = 0; round < 200; round ++) {
+                    Result result = pool.submitTask(fnTask([&done]() { done ++; }));
+                    CHECK(result.waitFor(std::chrono::milliseconds(5000)));
+                }
+            });
+        }
+        for (std::thread &submitter : submitters) {
+            submitter.join();
+        }
+        CHECK(done.load() == 800);
+
+        // 线程都挂起之后再来一批任务，每个任务都能被执行
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::vector<Result> results;
+        for (int i = 0; i < 16; i ++) {
+            results.emplace_back(pool.submitTask(fnTask([i]() { return i; })));
+        }
+        for (int i = 0; i < 16; i ++) {
+            CHECK(results[i].waitFor(std::chrono::milliseconds(5000)));
+            CHECK(results[i].get().cast_<int>() == i);
+        }
+    }
+}
+
+// 绑核：拓扑的两种排列都是全部CPU的排列，显式绑核后任务运行在指定的CPU上，越界的节点提示被忽略
+static void testAffinity() {
+    CpuTopology topology = CpuTopology::detect();
+    CHECK(topology.nodeCount() >= 1);
+    CHECK(topology.cpuCount() >= 1);
+    std::vector<int> compact = topology.compactOrder();
+    std::vector<int> scatter = topology.scatterOrder();
+    CHECK(compact.size() == topology.cpuCount());
+    CHECK(std::is_permutation(compact.begin(), compact.end(), scatter.begin(), scatter.end()));
+    size_t nodeCpus = 0;
+    for (size_t node = 0; node < topology.nodeCount(); node ++) {
+        nodeCpus += topology.nodeCpus(node).size();
+        for (int cpu : topology.nodeCpus(node)) {
+            CHECK(topology.nodeOf(cpu) == node);
+        }
+    }
+    CHECK(nodeCpus == topology.cpuCount());
+
+    {
+        int cpu = compact.back();
+        ThreadPool pool;
+        pool.setAffinity(std::vector<int> { cpu });
+        pool.start(2);
+        CHECK(pool.getNodeCount() == 1);
+        std::vector<Result> results;
+        for (int i = 0; i < 8; i ++) {
+            results.emplace_back(pool.submitTask(fnTask([]() { return currentCpu(); })));
+        }
+        for (Result &result : results) {
+            int ran = result.get().cast_<int>();
+            CHECK(ran == -1 || ran == cpu);
+        }
+    }
+    {
+        ThreadPool pool;
+        pool.setAffinity(AffinityPolicy::AFFINITY_COMPACT);
+        pool.start(topology.cpuCount());
+        CHECK(pool.getNodeCount() == topology.nodeCount());
+        for (int node : { 0, static_cast<int>(pool.getNodeCount()) - 1, static_cast<int>(pool.getNodeCount()) + 5 }) {
+            SubmitOptions options;
+            options.node = node;
+            Result result = pool.submitTask(fnTask([]() { return currentCpu(); }), options);
+            int cpu = result.get().cast_<int>();
+            CHECK(cpu == -1 || node >= static_cast<int>(pool.getNodeCount())
+                  || topology.nodeOf(cpu) == static_cast<size_t>(node));
+        }
+    }
+}
+
+// cached模式的伸缩：任务积压时扩容，负载消失、线程空闲超过idleTimeout后收缩到下限
+static void testElasticSizing() {
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_CACHED);
+    pool.setThreadThreshHold(4);
+    ElasticPolicy policy;
+    policy.targetQueueWait = std::chrono::seconds(1);
+    policy.growInterval = std::chrono::microseconds(0);
+    policy.idleTimeout = std::chrono::milliseconds(100);
+    policy.minThreads = 1;
+    pool.setElasticPolicy(policy);
+    pool.start(1);
+    CHECK(pool.getThreadSize() == 1);
+
+    std::vector<Result> results;
+    for (int i = 0; i < 16; i ++) {
+        results.emplace_back(pool.submitTask(fnTask([]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        })));
+    }
+    CHECK(pool.getThreadSize() > 1);
+    CHECK(pool.getThreadSize() <= 4);
+    for (Result &result : results) {
+        result.get();
+    }
+    CHECK(waitUntil([&pool]() { return pool.getThreadSize() == 1; }));
+}
+
+// 批量出队：多个提交者向非默认车道、非默认租户提交的任务在各种模式下都恰好执行一次
+static void testLaneBatchDequeue() {
+    for (PoolMode mode : { PoolMode::MODE_FIXED, PoolMode::MODE_CACHED, PoolMode::MODE_WORK_STEALING }) {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(4);
+
+        std::vector<std::atomic<int>> runs(2000);
+        std::vector<std::thread> submitters;
+        for (int t = 0; t < 4; t ++) {
+            submitters.emplace_back([&pool, &runs, t]() {
+                std::vector<Result> results;
+                for (int i = t; i < static_cast<int>(runs.size()); i += 4) {
+                    TaskPriority priority = i % 3 == 0 ? TaskPriority::PRIORITY_HIGH : TaskPriority::PRIORITY_LOW;
+                    results.emplace_back(pool.submitTask(fnTask([&runs, i]() { runs[i] ++; }), priority, 1 + i % 5));
+                }
+                for (Result &result : results) {
+                    result.get();
+                }
+            });
+        }
+        for (std::thread &submitter : submitters) {
+            submitter.join();
+        }
+        bool once = true;
+        for (std::atomic<int> &run : runs) {
+            once = once && run.load() == 1;
+        }
+        CHECK(once);
+    }
+}
+
+// post的任务抛出异常：不终止进程，在执行它的线程上交给错误处理函数并计数，线程池照常工作
+static void testPostErrors() {
+    std::atomic<int> handled {0};
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1);
+    pool.setErrorHandler([&handled](std::exception_ptr error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (const std::runtime_error&) {
+            handled ++;
+        }
+        // 处理函数抛出的异常被忽略
+        throw std::logic_error("handler");
+    });
+    pool.start(1);
+
+    Gate gate;
+    gate.hold(pool);
+    pool.post([]() { throw std::runtime_error("queued"); });
+    // 队列已满，在当前线程执行
+    pool.post([]() { throw std::runtime_error("caller"); });
+    CHECK(handled.load() == 1);
+    gate.release();
+    CHECK(waitUntil([&handled]() { return handled.load() == 2; }));
+    CHECK(pool.getFailedTaskCount() == 2);
+    CHECK(pool.snapshot().failedTasks == 2);
+    CHECK(pool.submitTask(fnTask([]() { return 1; })).get().cast_<int>() == 1);
+}
+
+int main() {
+    RUN_TEST(testModes);
+    RUN_TEST(testWorkStealingSpawn);
+    RUN_TEST(testLanePriority);
+    RUN_TEST(testTenantWeights);
+    RUN_TEST(testTenantReclaim);
+    RUN_TEST(testDeadlineOrder);
+    RUN_TEST(testOverflowPolicies);
+    RUN_TEST(testDropOldestContention);
+    RUN_TEST(testCancellationAndDeadline);
+    RUN_TEST(testSubmitBatch);
+    RUN_TEST(testParallelLoops);
+    RUN_TEST(testHelpingWait);
+    RUN_TEST(testBlockingGuard);
+    RUN_TEST(testParkingWakeup);
+    RUN_TEST(testAffinity);
+    RUN_TEST(testElasticSizing);
+    RUN_TEST(testLaneBatchDequeue);
+    RUN_TEST(testPostErrors);
+    return checkResult();
+}
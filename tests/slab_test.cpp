@@ -0,0 +1,104 @@
+// SlabAllocator的行为测试：其他线程释放的块攒批还给所属的堆，线程退出或者flushRemote时还回攒着的块，
+// 所属线程再分配时复用这些块，不再向系统申请新的span
+
+#include "check.h"
+
+#include <algorithm>
+#include <vector>
+
+// 每个测试使用自己的大小级别，前一个测试还回来的块不会混进来，线程池内部也不会分配这么大的块
+static constexpr size_t REMOTE_FREE_SIZE = 448;
+static constexpr size_t FLUSH_REMOTE_SIZE = 384;
+
+// 分配n个size字节的块，返回按地址排序的指针
+static std::vector<void*> allocateBlocks(size_t n, size_t size) {
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < n; i ++) {
+        blocks.push_back(SlabAllocator::allocate(size));
+    }
+    std::sort(blocks.begin(), blocks.end());
+    return blocks;
+}
+
+// 在另一个线程上释放，flush为false时不主动还回，靠线程退出时还回攒着的块
+static void freeOnOtherThread(const std::vector<void*> &blocks, size_t size, bool flush) {
+    std::thread([&blocks, size, flush]() {
+        for (void *block : blocks) {
+            SlabAllocator::deallocate(block, size);
+        }
+        if (flush) {
+            SlabAllocator::flushRemote();
+        }
+    }).join();
+}
+
+// 远程释放的块(攒满的整批和线程退出时剩下的零头)全部回到分配线程，再分配时原样复用
+static void testRemoteFree() {
+    // 远程释放每32个块还一次，这里是6个整批加上零头
+    std::vector<void*> blocks = allocateBlocks(32 * 6 + 7, REMOTE_FREE_SIZE);
+    size_t reserved = SlabAllocator::reservedBytes();
+    freeOnOtherThread(blocks, REMOTE_FREE_SIZE, false);
+
+    std::vector<void*> again = allocateBlocks(blocks.size(), REMOTE_FREE_SIZE);
+    CHECK(again == blocks);
+    CHECK(SlabAllocator::reservedBytes() == reserved);
+    freeOnOtherThread(again, REMOTE_FREE_SIZE, false);
+}
+
+// 不足一批的远程释放：线程还在运行时flushRemote立即还回，分配线程马上就能复用
+static void testFlushRemote() {
+    std::vector<void*> blocks = allocateBlocks(5, FLUSH_REMOTE_SIZE);
+    size_t reserved = SlabAllocator::reservedBytes();
+
+    std::atomic<int> step {0};
+    std::thread other([&blocks, &step]() {
+        for (void *block : blocks) {
+            SlabAllocator::deallocate(block, FLUSH_REMOTE_SIZE);
+        }
+        SlabAllocator::flushRemote();
+        step.store(1);
+        // 分配线程复用完之前不退出，确认块是flushRemote还回的
+        while (step.load() != 2) {
+            std::this_thread::yield();
+        }
+    });
+    while (step.load() != 1) {
+        std::this_thread::yield();
+    }
+    std::vector<void*> again = allocateBlocks(blocks.size(), FLUSH_REMOTE_SIZE);
+    step.store(2);
+    other.join();
+    CHECK(again == blocks);
+    CHECK(SlabAllocator::reservedBytes() == reserved);
+    freeOnOtherThread(again, FLUSH_REMOTE_SIZE, true);
+}
+
+// 线程池中执行的任务和Any的值在其他线程上释放，反复提交不会让占用的内存持续增长
+static void testPoolReuse() {
+    ThreadPool pool;
+    pool.start(2);
+    auto round = [&pool]() {
+        std::vector<Result> results;
+        for (int i = 0; i < 1000; i ++) {
+            results.emplace_back(pool.submitTask(fnTask([i]() { return std::vector<int>(8, i); })));
+        }
+        bool correct = true;
+        for (int i = 0; i < 1000; i ++) {
+            correct = correct && results[i].get().cast_<std::vector<int>>()[7] == i;
+        }
+        return correct;
+    };
+    CHECK(round());
+    size_t reserved = SlabAllocator::reservedBytes();
+    for (int i = 0; i < 20; i ++) {
+        CHECK(round());
+    }
+    CHECK(SlabAllocator::reservedBytes() <= reserved + 4 * SlabAllocator::SPAN_SIZE);
+}
+
+int main() {
+    RUN_TEST(testRemoteFree);
+    RUN_TEST(testFlushRemote);
+    RUN_TEST(testPoolReuse);
+    return checkResult();
+}
@@ -1,169 +1,1527 @@
 #include "threadpool.h"
+#include "strand.h"
+#include "wsdeque.h"
+#include "mpmcqueue.h"
 
 #include <functional>
 #include <thread>
-#include <iostream>
+#include <algorithm>
+#include <stdexcept>
 
 const int TASK_MAX_THREASHHOLD = 1024;
-const int THREAD_MAX_IDLE_TIME = 60;
+const int THREAD_MAX_IDLE_TIME = 60; // 单位：秒
+const int PRIORITY_AGING_TIME = 100; // 单位：毫秒
+const int WORKER_SPIN_TIME = 20;     // 单位：微秒
+const int MAX_HELP_DEPTH = 32;       // 等待中帮忙执行的任务最多嵌套这么多层，防止栈溢出
+const int SPARE_THREAD_MAX = 64;     // 阻塞补偿默认最多启用的备用线程数量
+const int SPARE_THREAD_LINGER_TIME = 100; // 单位：毫秒，退下来的备用线程挂起多久没有被重新启用就退出
+const int DEQUEUE_BATCH_MAX = 16;    // 工作线程从车道队列一次最多取走的任务数量
+const int DROP_OLDEST_MAX_RETRY = 64; // 环形队列上POLICY_DROP_OLDEST既放不进也取不出时最多重试的次数
+const unsigned DROP_OLDEST_MAX_BACKOFF = 64; // 重试之间最多自旋等待的次数
+
+// 每个线程私有的状态
+// 工作线程上等待结果时，通过WaitHelper帮线程池执行任务
+struct ThreadPool::Worker final : WaitHelper {
+    Worker(ThreadPool *pool, size_t slot)
+        : pool_(pool),
+          slot_(slot),
+          seed_(slot * 0x9E3779B97F4A7C15ull + 1)
+    {}
+
+    bool helpOnce() override {
+        return pool_->helpOnce(this);
+    }
+
+    // xorshift64 随机数，用于挑选窃取的目标线程
+    uint64_t nextRandom() {
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 7;
+        seed_ ^= seed_ << 17;
+        return seed_;
+    }
+
+    ThreadPool *pool_;
+    size_t slot_;
+    uint64_t seed_;
+    int helpDepth_ = 0;              // 当前嵌套在几层等待中帮忙执行任务
+    int blockingDepth_ = 0;          // 当前嵌套在几层BlockingGuard中
+    uint32_t agingTick_ = 0;         // 取本地任务之前检查老化车道的节拍
+    uint32_t batchLimit_ = 1;        // 从车道队列一次最多取几个任务，锁有竞争时翻倍，没有竞争时减半
+    std::atomic<uint32_t> spareWord_ {0}; // 作为后备的备用线程挂起在这里，被重新启用时置1
+    int cpu_ = -1;                   // 绑定的CPU，-1表示不绑核
+    size_t node_ = 0;                // 所在NUMA节点的下标
+    WorkStealingDeque<Task*> deque_; // 本地任务队列，本线程LIFO取，其他线程FIFO窃取
+    // 挂起用的futex字：每次挂起取一个新的票号写进去，唤醒者把票号+1后唤醒
+    // 过期的唤醒者手里的票号对不上，不会误唤醒这个线程之后的挂起
+    std::atomic<uint32_t> parkWord_ {0};
+    uint32_t parkTicket_ = 0;           // 本次挂起的票号，由parkMtx_保护
+#if THREADPOOL_METRICS
+    WorkerMetrics metrics_;
+#endif
+};
+
+// 一个NUMA节点
+struct ThreadPool::Node {
+    explicit Node(size_t capacity)
+        : queue_(capacity)
+    {}
+
+    BoundedMPMCQueue<Task*> queue_; // 提示到这个节点的任务，本节点的线程优先取
+    std::vector<Worker*> workers_;  // 绑定在这个节点上的线程，窃取时先在它们之间进行
+};
+
+thread_local ThreadPool::Worker *ThreadPool::currentWorker_ = nullptr;
 
 // --------- 实现ThreadPool类
 
 ThreadPool::ThreadPool()
-    : initThreadSize_(0), 
+    : affinity_(AffinityPolicy::AFFINITY_NONE), 
+      initThreadSize_(0), 
       curThreadSize_(0), 
       idleThreadSize_(0), 
       maxThreadSize_(std::thread::hardware_concurrency()), 
+      minThreadSize_(0), 
+      maxSpareThreadSize_(SPARE_THREAD_MAX), 
+      queueType_(QueueType::QUEUE_MUTEX), 
+      queueOrder_(QueueOrder::ORDER_FIFO), 
+      overflowPolicy_(OverflowPolicy::POLICY_BLOCK), 
+      submitTimeout_(std::chrono::seconds(1)), 
       taskSize_(0), 
       taskQueMaxThreshHold_(TASK_MAX_THREASHHOLD), 
       poolMode_(PoolMode::MODE_FIXED), 
       isPoolRunning_(false)
-{}
+{
+    taskQue_.setAgingThreshold(std::chrono::milliseconds(PRIORITY_AGING_TIME));
+    strands_ = std::make_unique<StrandTable>(*this);
+    elastic_.idleTimeout = std::chrono::seconds(THREAD_MAX_IDLE_TIME);
+    // 单核机器上自旋只会推迟提交者的运行，直接挂起
+    spinTime_ = std::thread::hardware_concurrency() > 1
+        ? std::chrono::microseconds(WORKER_SPIN_TIME) : std::chrono::microseconds(0);
+}
+
+// 析构时等待所有任务执行完毕、所有线程退出，否则分离的线程会访问已经销毁的线程池
+ThreadPool::~ThreadPool() {
+    isPoolRunning_ = false;
+    wakeAllWorkers();
+
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    // 后备的备用线程被唤醒后和其他线程一样发现线程池已经结束而退出
+    for (Worker *worker : spareWorkers_) {
+        worker->spareWord_.store(1, std::memory_order_release);
+        futexWakeOne(worker->spareWord_);
+    }
+    spareWorkers_.clear();
+    exitCond_.wait(lock, [&]() -> bool { return threads_.size() == 0; });
+}
+
+// 设置线程池的模式
+void ThreadPool::setMode(PoolMode mode) {
+    if (checkRunningState()) {
+        return;
+    }
+    poolMode_ = mode;
+}
+
+// 设置任务队列最大阈值
+void ThreadPool::setTaskQueMaxThreshHold(size_t Threshhold) {
+    if (checkRunningState()) {
+        return;
+    }
+    taskQueMaxThreshHold_ = Threshhold;
+}
+
+void ThreadPool::setThreadThreshHold(size_t threshhold) {
+    if (checkRunningState()) {
+        return;
+    }
+    if (poolMode_ == PoolMode::MODE_CACHED) {
+        maxThreadSize_ = threshhold;
+    }
+}
+
+void ThreadPool::setElasticPolicy(const ElasticPolicy &policy) {
+    if (checkRunningState()) {
+        return;
+    }
+    elastic_ = policy;
+}
+
+void ThreadPool::setSpareThreadThreshHold(size_t threshhold) {
+    if (checkRunningState()) {
+        return;
+    }
+    maxSpareThreadSize_ = threshhold;
+}
+
+size_t ThreadPool::getThreadSize() const {
+    return static_cast<size_t>(std::max(curThreadSize_.load(), 0));
+}
+
+void ThreadPool::setQueueType(QueueType type) {
+    if (checkRunningState()) {
+        return;
+    }
+    queueType_ = type;
+}
+
+void ThreadPool::setQueueOrder(QueueOrder order) {
+    if (checkRunningState()) {
+        return;
+    }
+    queueOrder_ = order;
+    taskQue_.setDeadlineOrder(order == QueueOrder::ORDER_DEADLINE);
+}
+
+void ThreadPool::setOverflowPolicy(OverflowPolicy policy) {
+    if (checkRunningState()) {
+        return;
+    }
+    overflowPolicy_ = policy;
+}
+
+void ThreadPool::setSubmitTimeout(std::chrono::milliseconds timeout) {
+    if (checkRunningState()) {
+        return;
+    }
+    submitTimeout_ = timeout;
+}
+
+void ThreadPool::setWorkerSpinTime(std::chrono::microseconds spin) {
+    if (checkRunningState()) {
+        return;
+    }
+    spinTime_ = spin;
+}
+
+void ThreadPool::setAffinity(AffinityPolicy policy) {
+    if (checkRunningState()) {
+        return;
+    }
+    affinity_ = policy;
+}
+
+void ThreadPool::setAffinity(std::vector<int> cpus) {
+    if (checkRunningState()) {
+        return;
+    }
+    affinity_ = cpus.empty() ? AffinityPolicy::AFFINITY_NONE : AffinityPolicy::AFFINITY_EXPLICIT;
+    affinityCpus_ = std::move(cpus);
+}
+
+size_t ThreadPool::getNodeCount() const {
+    return std::max<size_t>(nodes_.size(), 1);
+}
+
+size_t ThreadPool::getDroppedTaskCount() const {
+    return droppedTaskSize_;
+}
+
+size_t ThreadPool::getExpiredTaskCount() const {
+    return expiredTaskSize_;
+}
+
+size_t ThreadPool::getCancelledTaskCount() const {
+    return cancelledTaskSize_;
+}
+
+size_t ThreadPool::getFailedTaskCount() const {
+    return failedTaskSize_;
+}
+
+void ThreadPool::setErrorHandler(MoveOnlyFunction<void(std::exception_ptr)> handler) {
+    if (checkRunningState()) {
+        return;
+    }
+    errorHandler_ = std::move(handler);
+}
+
+void ThreadPool::setTenantWeight(uint32_t tenant, uint32_t weight) {
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    taskQue_.setWeight(tenant, weight);
+}
+
+void ThreadPool::setPriorityAging(std::chrono::milliseconds threshold) {
+    if (checkRunningState()) {
+        return;
+    }
+    taskQue_.setAgingThreshold(threshold);
+}
+
+size_t ThreadPool::getLaneDepth(TaskPriority priority) const {
+    size_t depth = taskQue_.laneSize(static_cast<size_t>(priority));
+    if (priority == TaskPriority::PRIORITY_NORMAL) {
+        if (ringQue_ != nullptr) {
+            depth += ringQue_->size();
+        }
+        for (auto &node : nodes_) {
+            depth += node->queue_.size();
+        }
+    }
+    return depth;
+}
+
+// 给线程池提交任务
+Result ThreadPool::submitTask(std::shared_ptr<Task> sp) {
+    // 先建立结果通道再入队，任务可能在submitTask返回之前就已经执行完毕
+    Future<Any> future = sp->makeFuture();
+    SubmitStatus status = enqueueTask(sp, overflowPolicy_);
+    return Result(std::move(future), status, this, sp);
+}
+
+Result ThreadPool::submitTask(std::shared_ptr<Task> sp, const SubmitOptions &options) {
+    Future<Any> future = sp->makeFuture();
+    SubmitStatus status = enqueueTask(sp, overflowPolicy_, options);
+    return Result(std::move(future), status, this, sp);
+}
+
+Result ThreadPool::submitTask(std::shared_ptr<Task> sp, TaskPriority priority, uint32_t tenant) {
+    SubmitOptions options;
+    options.priority = priority;
+    options.tenant = tenant;
+    return submitTask(std::move(sp), options);
+}
+
+Result ThreadPool::submitTask(uint64_t key, std::shared_ptr<Task> sp, const SubmitOptions &options) {
+    Future<Any> future = sp->makeFuture();
+    strands_->submit(key, std::move(sp), options);
+    return Result(std::move(future), SubmitStatus::STATUS_OK, this);
+}
+
+void ThreadPool::post(uint64_t key, MoveOnlyFunction<void()> func) {
+    strands_->submit(key, makeFuncTask(std::move(func)), SubmitOptions());
+}
+
+BatchResult ThreadPool::submitBatch(std::vector<std::shared_ptr<Task>> tasks, const SubmitOptions &options) {
+    size_t n = tasks.size();
+    auto latch = std::allocate_shared<BatchLatch>(SlabStlAllocator<BatchLatch>(), static_cast<uint32_t>(n));
+
+    std::vector<Future<Any>> futures;
+    futures.reserve(n);
+    for (auto &sp : tasks) {
+        futures.emplace_back(sp->makeFuture());
+        sp->latch_ = latch;
+    }
+
+    std::vector<SubmitStatus> status(n, SubmitStatus::STATUS_OK);
+    enqueueBatch(tasks, status, options);
+
+    std::vector<Result> results;
+    results.reserve(n);
+    for (size_t i = 0; i < n; i ++) {
+        // 没有提交成功的任务不会执行，直接从计数中扣除
+        if (status[i] == SubmitStatus::STATUS_QUEUE_FULL) {
+            tasks[i]->latch_.reset();
+            latch->countDown();
+        }
+        results.emplace_back(std::move(futures[i]), status[i], this, tasks[i]);
+    }
+    return BatchResult(std::move(results), std::move(latch));
+}
+
+// 内部组件投递的函数包装成任务
+class FuncTask : public Task {
+public:
+    explicit FuncTask(MoveOnlyFunction<void()> func)
+        : func_(std::move(func))
+    {}
+
+    Any run() override {
+        func_();
+        return Any();
+    }
+
+private:
+    MoveOnlyFunction<void()> func_;
+};
+
+std::shared_ptr<Task> ThreadPool::makeFuncTask(MoveOnlyFunction<void()> func) {
+    return makeTask<FuncTask>(std::move(func));
+}
+
+void ThreadPool::post(MoveOnlyFunction<void()> func) {
+    enqueueTask(makeFuncTask(std::move(func)), OverflowPolicy::POLICY_CALLER_RUNS);
+}
+
+void ThreadPool::execTask(Task &task) {
+    std::exception_ptr error = task.exec();
+    if (error == nullptr) {
+        return;
+    }
+    failedTaskSize_ ++;
+    if (!errorHandler_) {
+        return;
+    }
+    // 处理函数再抛出异常也不能让工作线程退出
+    try {
+        errorHandler_(std::move(error));
+    } catch (...) {
+    }
+}
+
+int ThreadPool::currentNode() const {
+    Worker *self = currentWorker_;
+    if (nodes_.empty() || self == nullptr || self->slot_ >= workers_.size() || workers_[self->slot_].get() != self) {
+        return -1;
+    }
+    return static_cast<int>(self->node_);
+}
+
+void ThreadPool::postInternal(std::shared_ptr<Task> sp, const SubmitOptions &options) {
+    // 内部组件的任务被丢弃后就没有人能恢复或释放它们，在提交者线程上重入执行又会打乱它们自己的状态，
+    // 所以不参与截止时间和取消，入队时也跳过队列阈值和溢出策略
+    SubmitOptions placement = options;
+    placement.deadline = std::chrono::steady_clock::time_point::max();
+    placement.token = CancellationToken();
+    sp->internal_ = true;
+    enqueueTask(std::move(sp), overflowPolicy_, placement);
+}
+
+void ThreadPool::postInternal(Task &task, const SubmitOptions &options) {
+    // 空控制块的别名指针：拷贝和销毁都不涉及引用计数，也不分配内存
+    postInternal(std::shared_ptr<Task>(std::shared_ptr<Task>(), &task), options);
+}
+
+ScheduleAwaiter ThreadPool::schedule(const SubmitOptions &options) {
+    return ScheduleAwaiter(*this, options);
+}
+
+void ScheduleAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    // 入队之后协程可能已经在其他线程上恢复并销毁了本对象，入队过程中用到的参数先拷贝出来
+    SubmitOptions options = options_;
+    pool_.postInternal(*this, options);
+}
+
+// 默认车道、默认租户的任务不需要车道调度，可以走本地队列、节点队列和无锁环形队列
+static bool isDefaultLane(const SubmitOptions &options) {
+    return options.priority == TaskPriority::PRIORITY_NORMAL && options.tenant == 0;
+}
+
+SubmitStatus ThreadPool::enqueueTask(std::shared_ptr<Task> sp, OverflowPolicy policy, const SubmitOptions &options) {
+    // 统计指标和cached模式的扩容需要排队延迟，都不需要时不读时钟
+    if (THREADPOOL_METRICS || poolMode_ == PoolMode::MODE_CACHED) {
+        sp->enqueueTime_ = std::chrono::steady_clock::now();
+    }
+    sp->deadline_ = options.deadline;
+    sp->token_ = options.token;
+    traceSubmit(*sp);
+
+    // 工作窃取模式下，线程池内部线程提交的任务直接放入自己的本地队列，不需要获取任何锁
+    // 指定了其他节点时除外，任务要交给那个节点
+    // 截止时间优先时所有任务都进入车道队列排序
+    Worker *self = currentWorker_;
+    bool defaultLane = isDefaultLane(options) && queueOrder_ == QueueOrder::ORDER_FIFO;
+    bool hinted = defaultLane && options.node >= 0 && static_cast<size_t>(options.node) < nodes_.size();
+    if (defaultLane && poolMode_ == PoolMode::MODE_WORK_STEALING && self != nullptr && workers_[self->slot_].get() == self
+        && (!hinted || self->node_ == static_cast<size_t>(options.node))) {
+        sp->self_ = sp;
+        self->deque_.push(sp.get());
+        taskSize_ ++;
+        wakeWorker();
+        return SubmitStatus::STATUS_OK;
+    }
+
+    if (hinted) {
+        return submitToNodeQueue(sp, policy, options);
+    }
+    if (defaultLane && queueType_ == QueueType::QUEUE_LOCK_FREE_RING) {
+        return submitToRingQueue(sp, policy);
+    }
+    return submitToMutexQueue(sp, policy, options);
+}
+
+void ThreadPool::enqueueBatch(std::vector<std::shared_ptr<Task>> &tasks, std::vector<SubmitStatus> &status,
+                              const SubmitOptions &options) {
+    size_t n = tasks.size();
+    size_t lane = static_cast<size_t>(options.priority);
+    if (THREADPOOL_METRICS || poolMode_ == PoolMode::MODE_CACHED) {
+        auto now = std::chrono::steady_clock::now();
+        for (auto &sp : tasks) {
+            sp->enqueueTime_ = now;
+        }
+    }
+    for (auto &sp : tasks) {
+        sp->deadline_ = options.deadline;
+        sp->token_ = options.token;
+        traceSubmit(*sp);
+    }
+    bool defaultLane = isDefaultLane(options) && queueOrder_ == QueueOrder::ORDER_FIFO;
+    bool hinted = defaultLane && options.node >= 0 && static_cast<size_t>(options.node) < nodes_.size();
+
+    // 工作窃取模式下线程池内部线程提交的整批任务都放入本地队列，其他线程可以从这里窃取
+    Worker *self = currentWorker_;
+    if (defaultLane && poolMode_ == PoolMode::MODE_WORK_STEALING && self != nullptr && workers_[self->slot_].get() == self
+        && (!hinted || self->node_ == static_cast<size_t>(options.node))) {
+        for (auto &sp : tasks) {
+            sp->self_ = sp;
+            self->deque_.push(sp.get());
+        }
+        taskSize_ += static_cast<unsigned>(n);
+        wakeWorkers(n);
+        return;
+    }
+
+    // 指定了节点的任务逐个放入节点队列，每个任务唤醒该节点上的一个线程
+    if (hinted) {
+        for (size_t i = 0; i < n; i ++) {
+            status[i] = submitToNodeQueue(tasks[i], overflowPolicy_, options);
+        }
+        return;
+    }
+
+    if (defaultLane && queueType_ == QueueType::QUEUE_LOCK_FREE_RING) {
+        size_t pushed = 0;
+        for (size_t i = 0; i < n; i ++) {
+            auto &sp = tasks[i];
+            Task *raw = sp.get();
+            sp->self_ = sp;
+            taskSize_ ++;
+            if (ringQue_->tryPush(raw)) {
+                pushed ++;
+                continue;
+            }
+            taskSize_ --;
+            sp->self_.reset();
+            // 队列满了，先唤醒线程消费已经放入的任务，再按策略处理这个任务
+            wakeWorkers(pushed);
+            pushed = 0;
+            status[i] = submitToRingQueue(sp, overflowPolicy_);
+        }
+        wakeWorkers(pushed);
+        maybeGrow();
+        return;
+    }
+
+    // 整批任务只获取一次锁
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    size_t pushed = 0;
+    for (size_t i = 0; i < n; i ++) {
+        if (taskQue_.size() >= static_cast<size_t>(taskQueMaxThreshHold_)) {
+            // 队列满了，先唤醒线程消费已经放入的任务，再走单个任务的提交路径按策略处理
+            lock.unlock();
+            wakeWorkers(pushed);
+            pushed = 0;
+            status[i] = submitToMutexQueue(tasks[i], overflowPolicy_, options);
+            lock.lock();
+            continue;
+        }
+        taskQue_.push(tasks[i], lane, options.tenant, options.deadline);
+        taskSize_ ++;
+        pushed ++;
+    }
+    lock.unlock();
+    wakeWorkers(pushed);
+    maybeGrow();
+}
+
+SubmitStatus ThreadPool::submitToMutexQueue(std::shared_ptr<Task> sp, OverflowPolicy policy, const SubmitOptions &options) {
+    // acquire lock: 在unique_lock构造的时候就已经获取了锁，当析构时也会隐式释放锁
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+
+    auto notFull = [&]() -> bool { return taskQue_.size() < static_cast<size_t>(taskQueMaxThreshHold_); };
+    // 内部任务不受阈值限制，车道队列本身可以扩容
+    if (!sp->internal_ && !notFull()) {
+        switch (policy) {
+        case OverflowPolicy::POLICY_BLOCK: {
+            // 线程通信 若现在的任务数量大于等于阈值，则进行等待 等待时间超过submitTimeout_就返回失败(不能无限阻塞用户线程)
+            // wait: 即一直等待，直到predict条件成立
+            // wait_for: 相较于wait多了时间长度参数，如果条件一直不成立到设定时间长度便停止wait
+            // wait_until: 相较于wait_for多了时间点参数，如果条件一直不成立到设定时间点便停止wait
+            bool stat = true;
+            blockedSubmitterSize_ ++;
+            if (submitTimeout_ == std::chrono::milliseconds::max()) {
+                notFull_.wait(lock, notFull);
+            } else {
+                stat = notFull_.wait_for(lock, submitTimeout_, notFull);
+            }
+            blockedSubmitterSize_ --;
+            if (!stat) {
+                return SubmitStatus::STATUS_QUEUE_FULL;
+            }
+            break;
+        }
+        case OverflowPolicy::POLICY_FAIL_FAST:
+            return SubmitStatus::STATUS_QUEUE_FULL;
+        case OverflowPolicy::POLICY_CALLER_RUNS:
+            lock.unlock();
+            return runInCaller(sp);
+        case OverflowPolicy::POLICY_DROP_OLDEST:
+            // 只丢弃用户任务；队列里只剩内部任务时不再丢弃，新任务照常入队
+            auto droppable = [](const std::shared_ptr<Task> &task) { return !task->internal_; };
+            std::shared_ptr<Task> oldest;
+            while (!notFull() && taskQue_.popOldest(oldest, droppable)) {
+                oldest->abandon();
+                oldest.reset();
+                taskSize_ --;
+                droppedTaskSize_ ++;
+            }
+            break;
+        }
+    }
+
+    // 将任务放入任务队列当中，并更新
+    taskQue_.push(sp, static_cast<size_t>(options.priority), options.tenant, options.deadline);
+    taskSize_ ++;
+    lock.unlock();
+
+    // 线程通信 既然放入了任务，那么任务队列肯定就不为空 只唤醒一个挂起的线程来执行它
+    wakeWorker();
+    maybeGrow();
+
+    return SubmitStatus::STATUS_OK;
+}
+
+SubmitStatus ThreadPool::submitToRingQueue(std::shared_ptr<Task> sp, OverflowPolicy policy) {
+    Task *raw = sp.get();
+    sp->self_ = sp;
+    // 先计数再入队，消费者看到taskSize_为0时队列里一定没有任务
+    taskSize_ ++;
+
+    if (!ringQue_->tryPush(raw)) {
+        if (sp->internal_) {
+            // 环形队列是有界的，放不下的内部任务转入可以扩容的车道队列，消费者取完紧急车道后也会看这里
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            sp->self_.reset();
+            taskQue_.push(std::move(sp), static_cast<size_t>(TaskPriority::PRIORITY_NORMAL), 0);
+            lock.unlock();
+            wakeWorker();
+            return SubmitStatus::STATUS_OK;
+        }
+        switch (policy) {
+        case OverflowPolicy::POLICY_BLOCK: {
+            // 只有队列满的慢路径才会碰锁，消费者取出任务后在notFull_上唤醒
+            std::unique_lock<std::mutex> lock(taskQueMtx_);
+            auto pushed = [&]() -> bool { return ringQue_->tryPush(raw); };
+            bool stat = true;
+            blockedSubmitterSize_ ++;
+            if (submitTimeout_ == std::chrono::milliseconds::max()) {
+                notFull_.wait(lock, pushed);
+            } else {
+                stat = notFull_.wait_for(lock, submitTimeout_, pushed);
+            }
+            blockedSubmitterSize_ --;
+            if (!stat) {
+                taskSize_ --;
+                sp->self_.reset();
+                return SubmitStatus::STATUS_QUEUE_FULL;
+            }
+            break;
+        }
+        case OverflowPolicy::POLICY_FAIL_FAST:
+            taskSize_ --;
+            sp->self_.reset();
+            return SubmitStatus::STATUS_QUEUE_FULL;
+        case OverflowPolicy::POLICY_CALLER_RUNS:
+            taskSize_ --;
+            sp->self_.reset();
+            return runInCaller(sp);
+        case OverflowPolicy::POLICY_DROP_OLDEST: {
+            Task *oldest = nullptr;
+            int retry = 0;
+            unsigned backoff = 1;
+            while (!ringQue_->tryPush(raw)) {
+                if (!ringQue_->tryPop(oldest)) {
+                    // 满了又取不出来：其他线程占住了槽位还没有写完或取完，退避之后再试，一直等不到就按队列满返回
+                    if (++ retry >= DROP_OLDEST_MAX_RETRY) {
+                        taskSize_ --;
+                        sp->self_.reset();
+                        return SubmitStatus::STATUS_QUEUE_FULL;
+                    }
+                    for (unsigned i = 0; i < backoff; i ++) {
+                        cpuRelax();
+                    }
+                    backoff = std::min(backoff * 2, DROP_OLDEST_MAX_BACKOFF);
+                    continue;
+                }
+                if (oldest->internal_) {
+                    // 内部任务不能丢弃，挪到车道队列里给新任务腾出位置
+                    std::lock_guard<std::mutex> lock(taskQueMtx_);
+                    taskQue_.push(std::move(oldest->self_), static_cast<size_t>(TaskPriority::PRIORITY_NORMAL), 0);
+                } else {
+                    oldest->abandon();
+                    oldest->self_.reset();
+                    taskSize_ --;
+                    droppedTaskSize_ ++;
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    wakeWorker();
+
+    maybeGrow();
+    return SubmitStatus::STATUS_OK;
+}
+
+SubmitStatus ThreadPool::submitToNodeQueue(std::shared_ptr<Task> sp, OverflowPolicy policy, const SubmitOptions &options) {
+    size_t node = static_cast<size_t>(options.node);
+    Task *raw = sp.get();
+    sp->self_ = sp;
+    taskSize_ ++;
+
+    if (!nodes_[node]->queue_.tryPush(raw)) {
+        // 节点提示只是建议：节点队列满了就退回到不指定节点的提交路径，由它按溢出策略处理
+        taskSize_ --;
+        sp->self_.reset();
+        SubmitOptions fallback = options;
+        fallback.node = -1;
+        return enqueueTask(std::move(sp), policy, fallback);
+    }
+
+    wakeWorkerOn(node);
+
+    maybeGrow();
+    return SubmitStatus::STATUS_OK;
+}
+
+SubmitStatus ThreadPool::runInCaller(std::shared_ptr<Task> sp) {
+    execTask(*sp);
+    return SubmitStatus::STATUS_CALLER_RUNS;
+}
+
+// 开启线程池
+void ThreadPool::start(size_t initThreadSize) {
+    if (checkRunningState()) {
+        return;
+    }
+    isPoolRunning_ = true;
+    // 赋值初始化线程数量，默认为4
+    initThreadSize_ = initThreadSize;
+    // 至少保留一个线程：它要么挂起着等提交者唤醒，要么正在执行任务，积压的任务总有线程来处理
+    minThreadSize_ = std::max<size_t>(elastic_.minThreads > 0 ? elastic_.minThreads : initThreadSize_, 1);
+    if (poolMode_ == PoolMode::MODE_CACHED) {
+        // cached模式下初始线程数量不能低于下限
+        initThreadSize_ = std::max(initThreadSize_, minThreadSize_);
+    }
+
+    if (queueType_ == QueueType::QUEUE_LOCK_FREE_RING) {
+        ringQue_ = std::make_unique<BoundedMPMCQueue<Task*>>(taskQueMaxThreshHold_);
+    }
+
+    // 每个可能存在的线程(包括备用线程)都预留一个slot，slot在线程退出后复用
+    size_t slotSize = std::max(initThreadSize_, maxThreadSize_) + maxSpareThreadSize_;
+    for (size_t i = 0; i < slotSize; i ++) {
+        workers_.emplace_back(std::make_unique<Worker>(this, i));
+        freeSlots_.push_back(slotSize - 1 - i);
+    }
+    placeWorkers();
+
+    // 创建并启动线程对象
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    for (size_t i = 0; i < initThreadSize_; i ++) {
+        addThread();
+    }
+}
+
+void ThreadPool::addThread() {
+    if (freeSlots_.empty()) {
+        return;
+    }
+    size_t slot = freeSlots_.back();
+    freeSlots_.pop_back();
+
+    // 这里是将ThreadPool类的threadFunc函数绑定到Thread类当中，供后者调用
+    // 因为threadFunc本应该是Thread类的私有成员函数Thread调用的，只是因为需要维护的变量都在ThreadPool当中
+    auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1, slot));
+    size_t id = ptr->getThreadID();
+    threads_.emplace(id, std::move(ptr));
+    threads_[id]->start(); // 启动线程
+    curThreadSize_ ++;
+    idleThreadSize_ ++;    // 记录空闲线程数量
+}
+
+void ThreadPool::placeWorkers() {
+    if (affinity_ == AffinityPolicy::AFFINITY_NONE) {
+        return;
+    }
+    CpuTopology topology = CpuTopology::detect();
+    std::vector<int> order;
+    switch (affinity_) {
+    case AffinityPolicy::AFFINITY_COMPACT:
+        order = topology.compactOrder();
+        break;
+    case AffinityPolicy::AFFINITY_SCATTER:
+        order = topology.scatterOrder();
+        break;
+    default:
+        order = affinityCpus_;
+        break;
+    }
+    if (order.empty()) {
+        return;
+    }
+
+    // 线程比CPU多时循环使用，cached模式下后创建的线程也有确定的位置
+    for (auto &worker : workers_) {
+        worker->cpu_ = order[worker->slot_ % order.size()];
+        worker->node_ = topology.nodeOf(worker->cpu_);
+    }
+
+    // 只有一个节点时不需要节点队列，所有的节点路径都会被跳过
+    if (topology.nodeCount() > 1) {
+        for (size_t i = 0; i < topology.nodeCount(); i ++) {
+            nodes_.emplace_back(std::make_unique<Node>(taskQueMaxThreshHold_));
+        }
+        for (auto &worker : workers_) {
+            nodes_[worker->node_]->workers_.push_back(worker.get());
+        }
+    }
+}
+
+// 因为我们要维护的描述变量都在ThreadPool类当中，所以我们需要一个Helper Function来供Thread来绑定使用
+void ThreadPool::threadFunc(size_t tid, size_t slot) {
+    Worker *self = workers_[slot].get();
+    currentWorker_ = self;
+    WaitHelper::setCurrent(self);
+    // 绑核失败(例如CPU不在本进程允许的范围内)时照常运行，只是不再固定位置
+    if (self->cpu_ >= 0) {
+        CpuTopology::pinCurrentThread(self->cpu_);
+    }
+
+    bool retired = pollLoop(self);
+
+    WaitHelper::setCurrent(nullptr);
+    currentWorker_ = nullptr;
+
+    // 线程退出，把线程对象从线程列表中删除，归还slot
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    threads_.erase(tid);
+    freeSlots_.push_back(slot);
+    // 因为空闲而退出的线程在retireWorker中已经扣除了数量
+    if (!retired) {
+        curThreadSize_ --;
+        idleThreadSize_ --;
+    }
+    exitCond_.notify_all();
+}
+
+bool ThreadPool::pollLoop(Worker *self) {
+    bool cached = poolMode_ == PoolMode::MODE_CACHED;
+    bool timed = THREADPOOL_METRICS || cached;
+    auto lastTime = std::chrono::steady_clock::now();
+    bool backToBack = false; // 上一个任务刚执行完就拿到了这个任务，lastTime可以当作这个任务的开始时间
+
+    for (;;) {
+        // 阻塞的线程已经返回，多出来的备用线程退下来
+        if (spareThreadSize_.load(std::memory_order_relaxed) > blockedThreadSize_.load(std::memory_order_relaxed)
+            && retireSpare(self)) {
+            return true;
+        }
+        std::shared_ptr<Task> task;
+        if (findTask(self, task)) {
+            taskSize_ --;
+            idleThreadSize_ --;
+            // 执行之后任务可能已经被释放(协程、连接)，编号先取出来
+            uint64_t traceId = task->traceId_;
+            trace(TraceEventType::TRACE_DEQUEUE, traceId);
+            // 等待结果的线程已经领走直接执行了，留在队列中的这一份不再记为一次执行
+            if (task->isClaimed()) {
+                idleThreadSize_ ++;
+                backToBack = false;
+                continue;
+            }
+            auto start = lastTime;
+            int64_t wait = 0;
+            if (timed) {
+                // 连续执行任务时省掉一次读时钟，取任务本身的耗时计入排队延迟
+                if (!backToBack) {
+                    start = std::chrono::steady_clock::now();
+                }
+                wait = std::chrono::duration_cast<std::chrono::nanoseconds>(start - task->enqueueTime_).count();
+            }
+            // 调用者已经放弃的任务不再占用线程
+            if ((task->token_.canBeCancelled() || task->deadline_ != std::chrono::steady_clock::time_point::max())
+                && dropIfStale(*task, timed ? start : std::chrono::steady_clock::time_point::min())) {
+                idleThreadSize_ ++;
+                backToBack = false;
+                continue;
+            }
+            if (cached) {
+                // 排队延迟的指数移动平均(权重1/8)，多个线程同时更新时偶尔丢失一个样本，不影响估计
+                int64_t avg = queueWaitNs_.load(std::memory_order_relaxed);
+                queueWaitNs_.store(avg + (wait - avg) / 8, std::memory_order_relaxed);
+            }
+            trace(TraceEventType::TRACE_START, traceId);
+            execTask(*task);
+            trace(TraceEventType::TRACE_END, traceId);
+            idleThreadSize_ ++;
+            auto end = timed ? std::chrono::steady_clock::now() : lastTime;
+#if THREADPOOL_METRICS
+            recordTask(self, wait, start - lastTime, end - start);
+#endif
+            lastTime = end; // 更新时间
+            backToBack = true;
+            // 所有线程都在忙时没有新的提交也要继续评估，积压的任务才能等到扩容
+            if (cached && taskSize_ > 0) {
+                maybeGrow();
+            }
+            continue;
+        }
+
+        // 本地、全局、其他线程都没有任务，先自旋一小段时间，任务很快到来时省掉一次挂起和唤醒
+        backToBack = false;
+        if (spinForTask()) {
+            continue;
+        }
+        // 线程池要结束，并且任务已经全部执行完毕，回收线程资源
+        if (!isPoolRunning_ && taskSize_ == 0) {
+            return false;
+        }
+
+        if (cached) {
+            // 挂起到空闲超时为止，超时返回false
+            auto idle = std::chrono::steady_clock::now() - lastTime;
+            auto timeout = std::max<std::chrono::nanoseconds>(elastic_.idleTimeout - idle, std::chrono::milliseconds(1));
+            if (!parkWorker(self, timeout)) {
+                // 没有任务可做，排队延迟的估计随之衰减，否则一次突发之后永远达不到收缩的条件
+                queueWaitNs_.store(queueWaitNs_.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+                // 如果cached模式下，一个线程超过限定时间没有任务，则销毁该线程
+                if (std::chrono::steady_clock::now() - lastTime >= elastic_.idleTimeout && retireWorker()) {
+                    return true;
+                }
+            }
+        } else {
+            parkWorker(self, std::chrono::nanoseconds::max());
+        }
+    }
+}
+
+bool ThreadPool::helpOnce(Worker *self) {
+    // 嵌套太深时不再帮忙，退回到阻塞等待
+    if (self->helpDepth_ >= MAX_HELP_DEPTH) {
+        return false;
+    }
+    std::shared_ptr<Task> task;
+    if (!findTask(self, task)) {
+        return false;
+    }
+    taskSize_ --;
+    uint64_t traceId = task->traceId_;
+    trace(TraceEventType::TRACE_DEQUEUE, traceId);
+    if (task->isClaimed()) {
+        return true;
+    }
+    if ((task->token_.canBeCancelled() || task->deadline_ != std::chrono::steady_clock::time_point::max())
+        && dropIfStale(*task, std::chrono::steady_clock::time_point::min())) {
+        return true;
+    }
+    // 这个线程在外层任务中已经计为忙碌，空闲线程数量不变
+    self->helpDepth_ ++;
+    trace(TraceEventType::TRACE_START, traceId);
+    execTask(*task);
+    trace(TraceEventType::TRACE_END, traceId);
+    self->helpDepth_ --;
+#if THREADPOOL_METRICS
+    relaxedAdd(self->metrics_.helps_);
+#endif
+    return true;
+}
+
+void ThreadPool::runInline(Task &task) {
+    if (task.isClaimed()) {
+        return;
+    }
+    if ((task.token_.canBeCancelled() || task.deadline_ != std::chrono::steady_clock::time_point::max())
+        && dropIfStale(task, std::chrono::steady_clock::time_point::min())) {
+        return;
+    }
+    // 队列中的那一份仍然占着任务数量，等它出队时再扣除
+    trace(TraceEventType::TRACE_START, task.traceId_);
+    execTask(task);
+    trace(TraceEventType::TRACE_END, task.traceId_);
+#if THREADPOOL_METRICS
+    // 等待者可能是其他线程池的工作线程，计数只由它自己写入
+    if (currentWorker_ != nullptr) {
+        relaxedAdd(currentWorker_->metrics_.helps_);
+    }
+#endif
+}
+
+bool ThreadPool::dropIfStale(Task &task, std::chrono::steady_clock::time_point now) {
+    // 已经被等待结果的工作线程领走，队列中留下的这一份直接丢掉
+    if (task.isClaimed()) {
+        return true;
+    }
+    if (task.token_.isCancelled()) {
+        cancelledTaskSize_ ++;
+        task.abandon(std::make_exception_ptr(TaskCancelled()));
+        return true;
+    }
+    if (task.deadline_ == std::chrono::steady_clock::time_point::max()) {
+        return false;
+    }
+    // 没有统计指标时出队不读时钟，只有带截止时间的任务才在这里读
+    if (now == std::chrono::steady_clock::time_point::min()) {
+        now = std::chrono::steady_clock::now();
+    }
+    if (now > task.deadline_) {
+        expiredTaskSize_ ++;
+        task.abandon(std::make_exception_ptr(TaskExpired()));
+        return true;
+    }
+    return false;
+}
+
+#if THREADPOOL_METRICS
+void ThreadPool::recordTask(Worker *self, int64_t waitNs, std::chrono::nanoseconds idle, std::chrono::nanoseconds run) {
+    WorkerMetrics &m = self->metrics_;
+    relaxedAdd(m.tasks_);
+    relaxedAdd(m.idleNs_, static_cast<uint64_t>(idle.count()));
+    relaxedAdd(m.busyNs_, static_cast<uint64_t>(run.count()));
+    m.queueWait_.record(static_cast<uint64_t>(std::max<int64_t>(waitNs, 0)));
+    m.runTime_.record(static_cast<uint64_t>(run.count()));
+}
+#endif
+
+MetricsSnapshot ThreadPool::snapshot() const {
+    MetricsSnapshot snap;
+    snap.threads = getThreadSize();
+    snap.idleThreads = static_cast<size_t>(std::max(idleThreadSize_.load(), 0));
+    snap.parkedThreads = static_cast<size_t>(std::max(sleepThreadSize_.load(), 0));
+    snap.blockedThreads = static_cast<size_t>(std::max(blockedThreadSize_.load(), 0));
+    snap.spareThreads = static_cast<size_t>(std::max(spareThreadSize_.load(), 0));
+    snap.pendingTasks = taskSize_;
+    for (size_t i = 0; i < TASK_PRIORITY_COUNT; i ++) {
+        snap.laneDepth.push_back(getLaneDepth(static_cast<TaskPriority>(i)));
+    }
+    snap.droppedTasks = droppedTaskSize_;
+    snap.expiredTasks = expiredTaskSize_;
+    snap.cancelledTasks = cancelledTaskSize_;
+    snap.failedTasks = failedTaskSize_;
+
+#if THREADPOOL_METRICS
+    // workers_在start()之后不再变化，可以不加锁遍历
+    for (auto &worker : workers_) {
+        WorkerMetrics &m = worker->metrics_;
+        WorkerStats stats;
+        stats.slot = worker->slot_;
+        stats.tasks = m.tasks_.load(std::memory_order_relaxed);
+        stats.busyNs = m.busyNs_.load(std::memory_order_relaxed);
+        stats.idleNs = m.idleNs_.load(std::memory_order_relaxed);
+        stats.steals = m.steals_.load(std::memory_order_relaxed);
+        stats.parks = m.parks_.load(std::memory_order_relaxed);
+        stats.helped = m.helps_.load(std::memory_order_relaxed);
+        if (stats.tasks == 0 && stats.parks == 0) {
+            continue; // 这个slot还没有运行过线程
+        }
+        snap.workers.push_back(stats);
+        snap.total.tasks += stats.tasks;
+        snap.total.busyNs += stats.busyNs;
+        snap.total.idleNs += stats.idleNs;
+        snap.total.steals += stats.steals;
+        snap.total.parks += stats.parks;
+        snap.total.helped += stats.helped;
+        m.queueWait_.addTo(snap.queueWait);
+        m.runTime_.addTo(snap.runTime);
+    }
+#endif
+    return snap;
+}
+
+void ThreadPool::maybeGrow() {
+    if (poolMode_ != PoolMode::MODE_CACHED || !isPoolRunning_) {
+        return;
+    }
+    // 备用线程顶替的是阻塞中的线程，不占用扩容的额度
+    int cur = curThreadSize_ - spareThreadSize_;
+    if (cur < 0 || static_cast<size_t>(cur) >= maxThreadSize_) {
+        return;
+    }
 
-ThreadPool::~ThreadPool()
-{}
+    // 空闲的线程足够处理积压的任务，不需要扩容
+    size_t backlog = taskSize_;
+    size_t idle = static_cast<size_t>(std::max(idleThreadSize_.load(), 0));
+    if (backlog <= idle) {
+        return;
+    }
+    int64_t target = std::chrono::duration_cast<std::chrono::nanoseconds>(elastic_.targetQueueWait).count();
+    bool slow = queueWaitNs_.load(std::memory_order_relaxed) >= target;
+    bool piled = backlog >= elastic_.backlogRatio * (idle + 1);
+    if (!slow && !piled) {
+        return;
+    }
 
-// 设置线程池的模式
-void ThreadPool::setMode(PoolMode mode) {
-    if (checkRunningState()) {
+    // 限速：同一个间隔内只有一个提交者能创建线程
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t last = lastGrowNs_.load(std::memory_order_relaxed);
+    int64_t interval = std::chrono::duration_cast<std::chrono::nanoseconds>(elastic_.growInterval).count();
+    if (now - last < interval || !lastGrowNs_.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
         return;
     }
-    poolMode_ = mode;
+
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    if (isPoolRunning_ && static_cast<size_t>(curThreadSize_ - spareThreadSize_) < maxThreadSize_) {
+        addThread();
+    }
 }
 
-// 设置任务队列最大阈值
-void ThreadPool::setTaskQueMaxThreshHold(size_t Threshhold) {
-    if (checkRunningState()) {
+bool ThreadPool::retireWorker() {
+    // 排队延迟还没有降到目标的一半以下，说明负载刚刚回落，先不收缩
+    int64_t target = std::chrono::duration_cast<std::chrono::nanoseconds>(elastic_.targetQueueWait).count();
+    if (queueWaitNs_.load(std::memory_order_relaxed) * 2 >= target) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    if (!isPoolRunning_ || curThreadSize_ <= static_cast<int>(minThreadSize_)) {
+        return false;
+    }
+    // 先扣除空闲线程再检查任务计数，和提交者"先增加taskSize_再查看空闲线程"配对：
+    // 要么这里看到新任务不退出，要么提交者看到空闲线程减少而去扩容
+    idleThreadSize_ --;
+    if (taskSize_ > 0) {
+        idleThreadSize_ ++;
+        return false;
+    }
+    curThreadSize_ --;
+    // 有多余的备用线程时，退出的这个线程算作备用线程
+    if (spareThreadSize_ > blockedThreadSize_) {
+        spareThreadSize_ --;
+    }
+    return true;
+}
+
+void ThreadPool::enterBlocking(Worker *self) {
+    if (self->blockingDepth_ ++ > 0) {
         return;
     }
-    taskQueMaxThreshHold_ = Threshhold;
+    // 在锁内增加阻塞计数，和retireSpare的检查互斥，不会出现刚决定不补偿、备用线程又退出的情况
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
+    int blocked = ++ blockedThreadSize_;
+    if (!isPoolRunning_ || spareThreadSize_ >= std::min(blocked, static_cast<int>(maxSpareThreadSize_))) {
+        return;
+    }
+    // 优先重新启用后备的备用线程，没有时才创建新线程
+    if (!spareWorkers_.empty()) {
+        Worker *worker = spareWorkers_.back();
+        spareWorkers_.pop_back();
+        spareThreadSize_ ++;
+        worker->spareWord_.store(1, std::memory_order_release);
+        futexWakeOne(worker->spareWord_);
+    } else if (!freeSlots_.empty()) {
+        spareThreadSize_ ++;
+        addThread();
+    }
 }
 
-void ThreadPool::setThreadThreshHold(size_t threshhold) {
-    if (checkRunningState()) {
+void ThreadPool::leaveBlocking(Worker *self) {
+    if (-- self->blockingDepth_ > 0) {
         return;
     }
-    if (poolMode_ == PoolMode::MODE_CACHED) {
-        maxThreadSize_ = threshhold;
+    int blocked = -- blockedThreadSize_;
+    // 多出来的备用线程可能正挂起着，叫醒一个让它退出
+    if (spareThreadSize_ > blocked && sleepThreadSize_ > 0) {
+        wakeWorker();
     }
 }
 
-// 给线程池提交任务
-Result ThreadPool::submitTask(std::shared_ptr<Task> sp) {
-    // acquire lock: 在unique_lock构造的时候就已经获取了锁，当析构时也会隐式释放锁
+bool ThreadPool::retireSpare(Worker *self) {
+    // 本地队列里还有任务的线程不退出，这些任务只能由它自己或者窃取者取走
+    if (!self->deque_.empty()) {
+        return false;
+    }
+    {
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        if (spareThreadSize_ <= blockedThreadSize_) {
+            return false;
+        }
+        // 退下来作为后备，不再取任务
+        spareThreadSize_ --;
+        idleThreadSize_ --;
+        self->spareWord_.store(0, std::memory_order_relaxed);
+        spareWorkers_.push_back(self);
+    }
+
+    // 挂起一段时间，期间又有线程阻塞时被重新启用，阻塞频繁时省掉反复创建和销毁线程
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SPARE_THREAD_LINGER_TIME);
+    while (self->spareWord_.load(std::memory_order_acquire) == 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            break;
+        }
+        futexWaitFor(self->spareWord_, 0, deadline - now);
+    }
+
     std::unique_lock<std::mutex> lock(taskQueMtx_);
-    
-    // 线程通信 若现在的任务数量大于等于阈值，则进行等待 当等待时间超过1s就会强制停止(不能阻塞用户线程)
-    // wait: 即一直等待，直到predict条件成立
-    // wait_for: 相较于wait多了时间长度参数，如果条件一直不成立到设定时间长度便停止wait
-    // wait_until: 相较于wait_for多了时间点参数，如果条件一直不成立到设定时间点便停止wait
-    auto stat = notFull_.wait_for(lock, std::chrono::seconds(1), [&]() -> bool { return taskQue_.size() < static_cast<size_t>(taskQueMaxThreshHold_); });
-    if (!stat) {
-        std::cerr << "TimeOut: Task Queue is Full, sumbit task failed" << std::endl;
-        return Result(sp, false);
+    if (self->spareWord_.load(std::memory_order_relaxed) == 0) {
+        // 超时，还在后备表中，线程退出
+        spareWorkers_.erase(std::find(spareWorkers_.begin(), spareWorkers_.end(), self));
+        curThreadSize_ --;
+        return true;
     }
+    // 唤醒者已经把它从后备表中取出
+    idleThreadSize_ ++;
+    return false;
+}
 
-    // 将任务放入任务队列当中，并更新
-    taskQue_.emplace(sp);
-    taskSize_ ++;
-    // 线程通信 既然放入了任务，那么任务队列肯定就不为空 通知线程执行任务队列当中的任务
-    // 有wait就有notify_all，就像有constructor就有destructor一样
-    notEmpty_.notify_all();
+bool ThreadPool::spinForTask() {
+    if (spinTime_.count() <= 0) {
+        return false;
+    }
+    auto deadline = std::chrono::steady_clock::now() + spinTime_;
+    for (unsigned i = 1; ; i ++) {
+        if (taskSize_.load(std::memory_order_relaxed) > 0 || !isPoolRunning_) {
+            return taskSize_ > 0;
+        }
+        cpuRelax();
+        // 每自旋一批才读一次时钟
+        if ((i & 63) == 0 && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+}
 
-    // cached模式
-    if (poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && curThreadSize_ < maxThreadSize_) {
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-        size_t id = ptr->getThreadID();
-        threads_.emplace(id, std::move(ptr));
+void ThreadPool::startTracing(size_t eventsPerThread) {
+    std::lock_guard<std::mutex> lock(tracerMtx_);
+    if (!tracerOwner_) {
+        tracerOwner_ = std::make_unique<Tracer>(eventsPerThread);
     }
-    
-    return Result(sp);
+    tracer_.store(tracerOwner_.get(), std::memory_order_release);
 }
 
-// 开启线程池
-void ThreadPool::start(size_t initThreadSize) {
-    if (checkRunningState()) {
-        return;
+void ThreadPool::stopTracing() {
+    // 追踪器本身一直保留到线程池析构，正在记录的线程不会访问到已经释放的缓冲区
+    tracer_.store(nullptr, std::memory_order_release);
+}
+
+void ThreadPool::writeChromeTrace(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(tracerMtx_);
+    if (tracerOwner_) {
+        tracerOwner_->writeChromeTrace(out);
+    } else {
+        out << "{\"traceEvents\":[]}\n";
     }
-    isPoolRunning_ = true;
-    // 赋值初始化线程数量，默认为4
-    initThreadSize_ = initThreadSize;
-    curThreadSize_ = initThreadSize_;
+}
 
-    // 创建线程对象
-    for (size_t i = 0; i < initThreadSize_; i ++) {
-        // 这里是将ThreadPool类的threadFunc函数绑定到Thread类当中，供后者调用
-        // 因为threadFunc本应该是Thread类的私有成员函数Thread调用的，只是因为需要维护的变量都在ThreadPool当中
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-        size_t id = ptr->getThreadID();
-        threads_.emplace(id, std::move(ptr));
-        // threads_.emplace_back(std::move(ptr));
+TraceBuffer& ThreadPool::traceBuffer(Tracer &tracer) const {
+    // 其他线程池的工作线程在这里也算外部线程
+    Worker *self = currentWorker_;
+    bool own = self != nullptr && self->slot_ < workers_.size() && workers_[self->slot_].get() == self;
+    return tracer.local(own ? static_cast<int>(self->slot_) : -1);
+}
+
+void ThreadPool::trace(TraceEventType type, uint64_t arg) {
+    if (Tracer *tracer = tracer_.load(std::memory_order_acquire)) {
+        traceBuffer(*tracer).record(type, arg);
     }
+}
 
-    for (size_t i = 0; i < initThreadSize_; i ++) {
-        threads_[i]->start(); // 启动线程
-        idleThreadSize_ ++;   // 记录空闲线程数量
+void ThreadPool::traceSubmit(Task &task) {
+    if (Tracer *tracer = tracer_.load(std::memory_order_acquire)) {
+        task.traceId_ = tracer->nextTaskId();
+        traceBuffer(*tracer).record(TraceEventType::TRACE_SUBMIT, task.traceId_);
     }
 }
 
-// 因为我们要维护的描述变量都在ThreadPool类当中，所以我们需要一个Helper Function来供Thread来绑定使用
-void ThreadPool::threadFunc(size_t tid) {
-    auto lastTime = std::chrono::high_resolution_clock::now();
+bool ThreadPool::parkWorker(Worker *self, std::chrono::nanoseconds timeout) {
+    // 先登记到空闲线程表，再检查一次任务计数，和提交者"先增加taskSize_再查看登记"配对，不会丢失唤醒
+    uint32_t ticket = 0;
+    {
+        std::lock_guard<std::mutex> lock(parkMtx_);
+        ticket = self->parkWord_.load(std::memory_order_relaxed) + 1;
+        self->parkWord_.store(ticket, std::memory_order_relaxed);
+        self->parkTicket_ = ticket;
+        parkedWorkers_.push_back(self);
+        sleepThreadSize_ ++;
+    }
+    if (taskSize_ > 0 || !isPoolRunning_) {
+        cancelPark(self, ticket);
+        return true;
+    }
+#if THREADPOOL_METRICS
+    relaxedAdd(self->metrics_.parks_);
+#endif
+    trace(TraceEventType::TRACE_PARK);
+    // 攒着的要还给其他线程的内存块不能跟着本线程一起睡
+    SlabAllocator::flushRemote();
 
-    for (;;) {
-        // acquire lock 创建一个unique_lock对象来管理互斥量taskQueMtx_
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
+    bool forever = timeout == std::chrono::nanoseconds::max();
+    auto deadline = forever ? std::chrono::steady_clock::time_point::max() : std::chrono::steady_clock::now() + timeout;
+    while (self->parkWord_.load(std::memory_order_acquire) == ticket) {
+        if (forever) {
+            futexWait(self->parkWord_, ticket);
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline || !futexWaitFor(self->parkWord_, ticket, deadline - now)) {
+            trace(TraceEventType::TRACE_UNPARK);
+            // 超时；如果这时恰好已经被唤醒者领走，就当作被唤醒
+            return !cancelPark(self, ticket);
+        }
+    }
+    trace(TraceEventType::TRACE_UNPARK);
+    return true;
+}
 
-        if (poolMode_ == PoolMode::MODE_CACHED) {
-            while (taskQue_.size() > 0) {
-                // 条件变量超时返回
-                if (std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1))) {
-                    auto nowTime = std::chrono::high_resolution_clock::now();
-                    auto duration = std::chrono::duration_cast<std::chrono::seconds>(nowTime - lastTime).count();
-                    if (duration >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_) {
-                        // 如果cached模式下，一个被新创建的线程超过限定时间没有任务，则销毁该线程
-                        // 将线程从线程池中移除，并销毁
+bool ThreadPool::cancelPark(Worker *self, uint32_t ticket) {
+    std::lock_guard<std::mutex> lock(parkMtx_);
+    bool registered = false;
+    auto it = std::find(parkedWorkers_.begin(), parkedWorkers_.end(), self);
+    if (it != parkedWorkers_.end()) {
+        parkedWorkers_.erase(it);
+        sleepThreadSize_ --;
+        registered = true;
+    }
+    // 作废这张票号，还没来得及唤醒的唤醒者会发现票号对不上
+    self->parkWord_.compare_exchange_strong(ticket, ticket + 1, std::memory_order_acq_rel);
+    return registered;
+}
 
-                    }
-                }
-            }
+bool ThreadPool::findTask(Worker *self, std::shared_ptr<Task> &task) {
+    // 其他模式下本地队列里只有从车道队列批量取来的任务
+    bool local = poolMode_ == PoolMode::MODE_WORK_STEALING || !self->deque_.empty();
+
+    // 0. 最高优先级车道、或者等待太久的车道中的任务，先于本地队列
+    // 最高优先级车道是否有任务不加锁就能看到；车道是否老化要加锁才知道，每取DEQUEUE_BATCH_MAX次本地任务才检查一次
+    if (local && hasLaneTask()
+        && (taskQue_.laneSize(0) > 0 || ++ self->agingTick_ % DEQUEUE_BATCH_MAX == 0)
+        && popLaneTask(task, true)) {
+        return true;
+    }
+
+    // 1. 本地队列，后进先出
+    Task *raw = nullptr;
+    if (local && self->deque_.pop(raw)) {
+        task = std::move(raw->self_);
+        return true;
+    }
+
+    // 2. 提示到本节点的任务
+    if (!nodes_.empty() && popNodeTask(self->node_, task)) {
+        return true;
+    }
+
+    // 3. 外部线程提交的全局注入队列
+    if (popSharedTask(self, task)) {
+        return true;
+    }
+
+    // 4. 先在本节点内窃取，再跨节点
+    if (stealTask(self, task)) {
+#if THREADPOOL_METRICS
+        relaxedAdd(self->metrics_.steals_);
+#endif
+        trace(TraceEventType::TRACE_STEAL, task->traceId_);
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::popSharedTask(Worker *self, std::shared_ptr<Task> &task) {
+    if (queueType_ == QueueType::QUEUE_LOCK_FREE_RING) {
+        // 环形队列里都是默认车道的任务：紧急车道先于它，其他车道排在它后面
+        bool lanes = hasLaneTask();
+        if (lanes && popLaneTask(task, true)) {
+            return true;
+        }
+        Task *raw = nullptr;
+        if (ringQue_->tryPop(raw)) {
+            task = std::move(raw->self_);
+            wakeSubmitter();
+            return true;
+        }
+        return lanes && popLaneTask(task, false, self);
+    }
+    return popLaneTask(task, false, self);
+}
+
+bool ThreadPool::hasLaneTask() const {
+    for (size_t i = 0; i < TASK_PRIORITY_COUNT; i ++) {
+        if (taskQue_.laneSize(i) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::popLaneTask(std::shared_ptr<Task> &task, bool urgentOnly, Worker *self) {
+    Task *batch[DEQUEUE_BATCH_MAX - 1];
+    size_t n = 0;
+    {
+        // 截止时间优先要求全局有序，不批量取
+        bool batching = self != nullptr && queueOrder_ == QueueOrder::ORDER_FIFO;
+        std::unique_lock<std::mutex> lock(taskQueMtx_, std::defer_lock);
+        if (!batching) {
+            lock.lock();
+        } else if (lock.try_lock()) {
+            // 没有竞争时一次取一个就够了，批量取反而多了进出本地队列的开销
+            self->batchLimit_ = std::max<uint32_t>(self->batchLimit_ / 2, 1);
         } else {
-            notEmpty_.wait(lock, [&]() -> bool { return taskQue_.size() > 0; });
+            self->batchLimit_ = std::min<uint32_t>(self->batchLimit_ * 2, DEQUEUE_BATCH_MAX);
+            lock.lock();
+        }
+        bool popped = urgentOnly ? taskQue_.popUrgent(task) : taskQue_.pop(task);
+        if (!popped) {
+            return false;
         }
+        if (batching && self->batchLimit_ > 1) {
+            // 队列越深一次取得越多，但不超过平均每个线程的份额，剩下的留给其他线程
+            size_t threads = static_cast<size_t>(std::max(curThreadSize_.load(), 1));
+            size_t extra = std::min<size_t>(taskQue_.size() / threads, self->batchLimit_ - 1);
+            std::shared_ptr<Task> sp;
+            while (n < extra && taskQue_.pop(sp)) {
+                batch[n] = sp.get();
+                batch[n ++]->self_ = std::move(sp);
+            }
+        }
+        // 提交者在锁内登记后才等待，没有等待者时不需要通知
+        if (blockedSubmitterSize_ > 0) {
+            notFull_.notify_all();
+        }
+    }
+
+    // 倒序压入本地队列，本线程后进先出地取出时仍然是车道队列的出队顺序
+    // 这些任务还计在taskSize_中：其他线程看到有任务就不会挂起，会来窃取；线程也不会在本地队列非空时退出
+    while (n > 0) {
+        self->deque_.push(batch[-- n]);
+    }
+    return true;
+}
+
+bool ThreadPool::popNodeTask(size_t node, std::shared_ptr<Task> &task) {
+    Task *raw = nullptr;
+    if (nodes_[node]->queue_.tryPop(raw)) {
+        task = std::move(raw->self_);
+        return true;
+    }
+    return false;
+}
 
-        // wait notEmpty 当任务队列为空，则等待任务出现再执行
-        notEmpty_.wait(lock, [&]() -> bool { return taskSize_ > 0; });
+bool ThreadPool::stealTask(Worker *self, std::shared_ptr<Task> &task) {
+    // 其他模式下只有批量取来的任务在本地队列里，共享队列都空了还有任务没有开始执行时才去窃取
+    bool stealing = poolMode_ == PoolMode::MODE_WORK_STEALING || taskSize_ > 0;
+    if (nodes_.empty()) {
+        return stealing && stealFrom(self, workers_, task);
+    }
 
-        idleThreadSize_ --; // 任务被取出，所以空闲线程数量应该减少
+    // 跨节点访问内存代价高：先在本节点的线程之间窃取，再取其他节点的节点队列，最后才窃取其他节点的线程
+    if (stealing && stealFrom(self, nodes_[self->node_]->workers_, task)) {
+        return true;
+    }
+    size_t n = nodes_.size();
+    for (size_t i = 1; i < n; i ++) {
+        if (popNodeTask((self->node_ + i) % n, task)) {
+            return true;
+        }
+    }
+    for (size_t i = 1; stealing && i < n; i ++) {
+        if (stealFrom(self, nodes_[(self->node_ + i) % n]->workers_, task)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-        // 从任务队列取出一个任务
-        std::cout << "pop a task and run it" << std::endl;
-        auto task = taskQue_.front();
-        taskQue_.pop();
-        taskSize_ --;
+template<typename Victims>
+bool ThreadPool::stealFrom(Worker *self, const Victims &victims, std::shared_ptr<Task> &task) {
+    size_t n = victims.size();
+    if (n == 0 || (n == 1 && &*victims[0] == self)) {
+        return false;
+    }
 
-        // 线程通信 通知线程池当前任务队列不空，消费者可以继续消费任务
-        if (taskSize_ > 0) {
-            notEmpty_.notify_all();
+    // 从一个随机的线程开始依次尝试，避免所有空闲线程都盯着同一个受害者
+    size_t start = self->nextRandom() % n;
+    for (size_t i = 0; i < n; i ++) {
+        Worker *victim = &*victims[(start + i) % n];
+        if (victim == self) {
+            continue;
+        }
+        Task *raw = nullptr;
+        if (victim->deque_.steal(raw)) {
+            task = std::move(raw->self_);
+            return true;
         }
+    }
+    return false;
+}
 
-        // 线程通信 通知线程池当前任务队列不满，生产者可以继续生产任务
-        notFull_.notify_all();
+void ThreadPool::wakeWorker() {
+    wakeWorkers(1);
+}
 
-        // release lock 否则当一个线程在执行任务的时候，其他任务队列中的任务都不会被取出并执行
-        lock.unlock();
+void ThreadPool::wakeWorkers(size_t n) {
+    // 调用者已经增加了taskSize_；没有挂起的线程时不需要碰锁，正在自旋的线程自己会看到任务
+    for (; n > 0 && sleepThreadSize_ > 0; n --) {
+        Worker *worker = nullptr;
+        uint32_t ticket = 0;
+        {
+            std::lock_guard<std::mutex> lock(parkMtx_);
+            if (parkedWorkers_.empty()) {
+                return;
+            }
+            // 唤醒最近挂起的线程，它的缓存还是热的，长时间空闲的线程继续睡
+            worker = parkedWorkers_.back();
+            ticket = worker->parkTicket_;
+            parkedWorkers_.pop_back();
+            sleepThreadSize_ --;
+        }
+        unparkWorker(worker, ticket);
+    }
+}
 
-        // 调用线程执行任务
-        if (task != nullptr) {
-            task->exec();
+void ThreadPool::wakeWorkerOn(size_t node) {
+    if (sleepThreadSize_ == 0) {
+        return;
+    }
+    Worker *worker = nullptr;
+    uint32_t ticket = 0;
+    {
+        std::lock_guard<std::mutex> lock(parkMtx_);
+        if (parkedWorkers_.empty()) {
+            return;
         }
+        // 从最近挂起的线程开始找本节点的线程；找不到就唤醒最近挂起的线程，它会跨节点来取
+        auto it = std::find_if(parkedWorkers_.rbegin(), parkedWorkers_.rend(),
+                               [&](Worker *w) { return w->node_ == node; });
+        if (it == parkedWorkers_.rend()) {
+            it = parkedWorkers_.rbegin();
+        }
+        worker = *it;
+        ticket = worker->parkTicket_;
+        parkedWorkers_.erase(std::next(it).base());
+        sleepThreadSize_ --;
+    }
+    unparkWorker(worker, ticket);
+}
+
+void ThreadPool::unparkWorker(Worker *worker, uint32_t ticket) {
+    // 票号对不上说明这个线程已经因为超时或者看到任务而自己醒来了
+    if (worker->parkWord_.compare_exchange_strong(ticket, ticket + 1, std::memory_order_acq_rel)) {
+        futexWakeOne(worker->parkWord_);
+        trace(TraceEventType::TRACE_WAKE, worker->slot_);
+    }
+}
 
-        idleThreadSize_ ++; // 任务执行完毕，空闲线程数量应该增加
-        lastTime = std::chrono::high_resolution_clock::now(); // 更新时间
+void ThreadPool::wakeAllWorkers() {
+    std::lock_guard<std::mutex> lock(parkMtx_);
+    for (Worker *worker : parkedWorkers_) {
+        unparkWorker(worker, worker->parkTicket_);
+    }
+    parkedWorkers_.clear();
+    sleepThreadSize_ = 0;
+}
+
+void ThreadPool::wakeSubmitter() {
+    // 和提交者"先登记再重试入队"配对，保证不会丢失唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (blockedSubmitterSize_ > 0) {
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        notFull_.notify_all();
     }
-    // std::cout << "begin threadFunc" << " tid: " << std::this_thread::get_id() << std::endl;
+}
 
-    // std::cout << "end threadFunc"   << " tid: " << std::this_thread::get_id() << std::endl;
+size_t ThreadPool::chunkSizeFor(size_t n, size_t grain) const {
+    if (grain == 0) {
+        // 每个线程大约分到8个分块，既能在线程之间平衡负载，又不会因为分块太小而频繁领取
+        size_t threads = std::max<size_t>(static_cast<size_t>(std::max(curThreadSize_.load(), 0)), 1) + 1;
+        grain = std::max<size_t>(n / (threads * 8), 1);
+    }
+    // 分块数量要放得进uint32_t
+    size_t minChunk = n / (UINT32_MAX - 1) + 1;
+    return std::max(grain, minChunk);
 }
 
 bool ThreadPool::checkRunningState() const {
@@ -196,37 +1554,305 @@ size_t Thread::getThreadID() const {
 
 // --------- 实现Task类
 Task::Task()
-    : result_(nullptr)
 {}
 
-void Task::exec() {
-    if (result_ != nullptr) {
-        result_->setVal(run());
+std::exception_ptr Task::exec() {
+    // 等待结果的工作线程已经把任务领走直接执行了，队列中留下的这一份不再执行
+    if (!claim()) {
+        return nullptr;
+    }
+    // 任务一旦出队就必须执行，run()的返回值或抛出的异常写入结果通道
+    if (!promise_.valid()) {
+        try {
+            run();
+        } catch (...) {
+            return std::current_exception();
+        }
+        return nullptr;
+    }
+    try {
+        Any any = run();
+        promise_.setValue(std::move(any));
+    } catch (...) {
+        promise_.setException(std::current_exception());
     }
+    // 结果写入之后再计数，waitAll返回时整批的结果都已经可以取出
+    if (latch_ != nullptr) {
+        std::shared_ptr<BatchLatch> latch = std::move(latch_);
+        latch->countDown();
+    }
+    return nullptr;
+}
+
+Future<Any> Task::makeFuture() {
+    promise_ = Promise<Any>();
+    claim_.store(CLAIM_OPEN, std::memory_order_relaxed);
+    return promise_.getFuture();
 }
 
-void Task::setResult(Result *res) {
-    result_ = res;
+void Task::abandon(std::exception_ptr error) {
+    if (!claim()) {
+        return;
+    }
+    if (error != nullptr && promise_.valid()) {
+        promise_.setException(std::move(error));
+    } else {
+        promise_.abandon();
+    }
+    if (latch_ != nullptr) {
+        std::shared_ptr<BatchLatch> latch = std::move(latch_);
+        latch->countDown();
+    }
 }
 
 
 // --------- 实现Result类
-Result::Result(std::shared_ptr<Task> task, bool isValid)
-    : task_(task),
-      isValid_(isValid) {
-    task_->setResult(this);
+Result::Result(Future<Any> future, SubmitStatus status, ThreadPool *pool, const std::shared_ptr<Task> &task)
+    : future_(std::move(future)),
+      status_(status),
+      pool_(pool)
+{
+    // 提交失败或者已经由提交者执行完毕的任务不需要再领取
+    if (status == SubmitStatus::STATUS_OK) {
+        task_ = task;
+    }
+}
+
+void Result::tryRunInline() {
+    if (pool_ == nullptr || WaitHelper::current() == nullptr || future_.isReady()) {
+        return;
+    }
+    if (std::shared_ptr<Task> task = task_.lock()) {
+        pool_->runInline(*task);
+    }
+}
+
+SubmitStatus Result::status() const {
+    return status_;
+}
+
+bool Result::isValid() const {
+    return status_ != SubmitStatus::STATUS_QUEUE_FULL;
 }
 
 Any Result::get() {
-    if (!isValid_) {
+    if (!isValid()) {
         return "";
     }
 
-    sem_.wait(); // task任务如果没有被执行完毕，则等待其返回输出再捕获
+    // task任务如果没有被执行完毕，则等待其返回输出再捕获
+    tryRunInline();
+    return future_.get();
+}
+
+void Result::wait() {
+    if (isValid()) {
+        tryRunInline();
+        future_.wait();
+    }
+}
+
+bool Result::waitFor(std::chrono::milliseconds timeout) {
+    if (!isValid()) {
+        return true;
+    }
+    tryRunInline();
+    return future_.wait_for(timeout) == std::future_status::ready;
+}
+
+bool Result::isReady() const {
+    return !isValid() || future_.isReady();
+}
+
+void Result::onReady(MoveOnlyFunction<void()> func) {
+    arm();
+    // 提交失败的任务没有执行，它的结果通道可能一直不会写入；结果已经被取走时也没有可以等的了
+    if (!isValid() || !future_.valid()) {
+        func();
+        return;
+    }
+    future_.onReady(std::move(func));
+}
+
+void Result::arm() {
+    // 结果只有一个通知位置，再挂一次会覆盖前一个通知，等它的一方永远等不到
+    if (armed_) {
+        throw std::logic_error("Result: completion notification already attached");
+    }
+    armed_ = true;
+}
+
+
+// --------- 实现BlockingGuard类
+BlockingGuard::BlockingGuard() {
+    ThreadPool::Worker *self = ThreadPool::currentWorker_;
+    if (self != nullptr) {
+        pool_ = self->pool_;
+        pool_->enterBlocking(self);
+    }
+}
+
+BlockingGuard::~BlockingGuard() {
+    if (pool_ != nullptr) {
+        pool_->leaveBlocking(ThreadPool::currentWorker_);
+    }
+}
+
+
+// --------- 实现BatchLatch类
+BatchLatch::BatchLatch(uint32_t count)
+    : count_(count)
+{}
+
+void BatchLatch::countDown(uint32_t n) {
+    if (count_.fetch_sub(n, std::memory_order_acq_rel) == n) {
+        futexWakeAll(count_);
+    }
+}
+
+bool BatchLatch::isDone() const {
+    return count_.load(std::memory_order_acquire) == 0;
+}
+
+void BatchLatch::wait() {
+    if (count_.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    if (WaitHelper *helper = WaitHelper::current()) {
+        helper->helpUntil(std::chrono::steady_clock::time_point::max(), [this]() { return isDone(); },
+                          [this](std::chrono::steady_clock::time_point until) { blockUntil(until); });
+        return;
+    }
+    while (uint32_t c = count_.load(std::memory_order_acquire)) {
+        futexWait(count_, c);
+    }
+}
+
+bool BatchLatch::waitUntil(std::chrono::steady_clock::time_point deadline) {
+    if (WaitHelper *helper = WaitHelper::current()) {
+        return helper->helpUntil(deadline, [this]() { return isDone(); },
+                                 [this](std::chrono::steady_clock::time_point until) { blockUntil(until); });
+    }
+    return blockUntil(deadline);
+}
+
+bool BatchLatch::blockUntil(std::chrono::steady_clock::time_point deadline) {
+    while (uint32_t c = count_.load(std::memory_order_acquire)) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        futexWaitFor(count_, c, deadline - now);
+    }
+    return true;
+}
+
+
+// --------- 实现BatchResult类
+BatchResult::BatchResult(std::vector<Result> results, std::shared_ptr<BatchLatch> latch)
+    : results_(std::move(results)),
+      latch_(std::move(latch))
+{}
+
+size_t BatchResult::size() const {
+    return results_.size();
+}
+
+Result& BatchResult::operator[](size_t index) {
+    return results_[index];
+}
+
+std::vector<Result>::iterator BatchResult::begin() {
+    return results_.begin();
+}
+
+std::vector<Result>::iterator BatchResult::end() {
+    return results_.end();
+}
+
+size_t BatchResult::submittedCount() const {
+    size_t count = 0;
+    for (const Result &result : results_) {
+        if (result.isValid()) {
+            count ++;
+        }
+    }
+    return count;
+}
+
+void BatchResult::waitAll() {
+    if (latch_ != nullptr) {
+        runInline();
+        latch_->wait();
+    }
+}
+
+bool BatchResult::waitAllFor(std::chrono::milliseconds timeout) {
+    if (latch_ == nullptr) {
+        return true;
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    runInline();
+    return latch_->waitUntil(deadline);
+}
+
+void BatchResult::runInline() {
+    // 在工作线程上等待时，还在队列中的任务按提交顺序直接执行
+    if (WaitHelper::current() == nullptr) {
+        return;
+    }
+    for (Result &result : results_) {
+        result.tryRunInline();
+    }
+}
+
+bool BatchResult::isAllReady() const {
+    return latch_ == nullptr || latch_->isDone();
+}
+
+
+// --------- 实现ParallelState类
+ParallelState::ParallelState(uint32_t chunks, Participate participate, void *ctx)
+    : participate_(participate),
+      ctx_(ctx),
+      chunks_(chunks),
+      remaining_(chunks)
+{}
+
+bool ParallelState::claim(uint32_t &chunk) {
+    uint64_t next = next_.fetch_add(1, std::memory_order_relaxed);
+    if (next >= chunks_) {
+        return false;
+    }
+    chunk = static_cast<uint32_t>(next);
+    return true;
+}
+
+void ParallelState::finish(uint32_t done) {
+    if (remaining_.fetch_sub(done, std::memory_order_acq_rel) == done) {
+        futexWakeAll(remaining_);
+    }
+}
+
+void ParallelState::participate() {
+    uint32_t chunk = 0;
+    if (claim(chunk)) {
+        participate_(*this, ctx_, chunk);
+    }
+}
 
-    return std::move(any_);
+void ParallelState::wait() {
+    while (uint32_t r = remaining_.load(std::memory_order_acquire)) {
+        futexWait(remaining_, r);
+    }
+    if (error_ != nullptr) {
+        std::rethrow_exception(error_);
+    }
 }
 
-void Result::setVal(Any any) {
-    return;
-}
\ No newline at end of file
+void ParallelState::fail(std::exception_ptr error) {
+    bool expected = false;
+    if (failed_.compare_exchange_strong(expected, true)) {
+        error_ = std::move(error);
+    }
+}
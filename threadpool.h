@@ -2,16 +2,37 @@
 #define THREADPOOL_H
 
 #include <vector>
-#include <queue>
+#include <algorithm>
 #include <memory>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <unordered_map>
+#include <typeinfo>
+#include <type_traits>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <chrono>
+#include <coroutine>
+#include <optional>
+
+#include "cancellation.h"
+#include "future.h"
+#include "function.h"
+#include "lanequeue.h"
+#include "slab.h"
+#include "topology.h"
+#include "trace.h"
+#include "metrics.h"
 
 class Task;
 class Result;
+class ThreadPool;
+class StrandTable;
+template<typename T> class BoundedMPMCQueue;
 
 /*
 example:
@@ -25,124 +46,534 @@ public:
     }
 };
 
-std::shared_ptr<Task> sp = std::make_shared<MyTask>();
+std::shared_ptr<Task> sp = makeTask<MyTask>(); // 和std::make_shared一样，只是从SlabAllocator分配
 pool.submitTask(sp);
 */
 
+// Any::cast_类型不匹配时抛出的异常
+class BadAnyCast : public std::bad_cast {
+public:
+    const char* what() const noexcept override {
+        return "Any: type unmatch!";
+    }
+};
+
+// 任务出队时已经被取消，没有执行，Result::get()抛出
+class TaskCancelled : public std::exception {
+public:
+    const char* what() const noexcept override {
+        return "Task: cancelled before it started";
+    }
+};
+
+// 任务出队时已经超过截止时间，没有执行，Result::get()抛出
+class TaskExpired : public std::exception {
+public:
+    const char* what() const noexcept override {
+        return "Task: deadline expired before it started";
+    }
+};
+
 // 因为虚函数和模板不相容，所以我们无法在子类进行重载能够接收任意类型的参数，这里手写C++-17引入的Any类型
 // 模板类的函数都需写在头文件当中，这样才能在编译期间进行类型检查
+// 小对象优化：不超过INLINE_SIZE字节、并且移动不抛异常的值直接存放在Any内部，不需要堆分配，放不下的从SlabAllocator分配
+// 类型识别：每个类型对应一个静态变量的地址作为标签，比较指针即可，不需要RTTI和dynamic_cast
 class Any {
 public:
     // 默认无参数的constructor and destructor
     Any() = default;
-    ~Any() = default;
-    // 禁用copy constructor and copy assignment 因为成员base_是unique_ptr
+    ~Any() {
+        reset();
+    }
+    // 禁用copy constructor and copy assignment 因为存放的值可能是只能移动的类型
     Any (const Any&) = delete;
     Any& operator=(const Any&) = delete;
     // 启用右值构造和赋值
-    Any (Any&&) = default;
-    Any& operator=(Any&&) = default;
+    Any (Any &&other) noexcept {
+        moveFrom(other);
+    }
+    Any& operator=(Any &&other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
 
-    // 重载构造函数，使得Any类可以接收任意类型的参数
-    template<typename T>
-    Any(T data) : base_(std::make_unique<Derive<T>>(data)) {}
+    // 重载构造函数，使得Any类可以接收任意类型的参数，包括只能移动的类型
+    template<typename T, typename U = std::decay_t<T>,
+             typename = std::enable_if_t<!std::is_same_v<U, Any>>>
+    Any(T &&data) {
+        if constexpr (isInline<U>) {
+            ::new (static_cast<void*>(storage_.buf_)) U(std::forward<T>(data));
+        } else {
+            storage_.heap_ = SlabAllocator::create<U>(std::forward<T>(data));
+        }
+        ops_ = &opsOf<U>;
+    }
 
     // 重载类型转换运算符，使得Any类可以转换为任意类型的参数
-    // 通过base_成员变量访问派生类当中的成员变量data_
+    // 可拷贝的类型返回一份拷贝，只能移动的类型会把值移动出来
     template<typename T>
     T cast_() {
-        // 智能指针的get方法返回裸指针，需要用dynamic_cast转换为派生类指针
-        Derive<T> *ptr = dynamic_cast<Derive<T>*>(base_.get());
+        T *ptr = tryCast<T>();
         if (ptr == nullptr) {
-            throw "type unmatch!";
+            throw BadAnyCast();
+        }
+        if constexpr (std::is_copy_constructible_v<T>) {
+            return *ptr;
+        } else {
+            return std::move(*ptr);
+        }
+    }
+
+    // 类型匹配时返回指向内部值的指针，否则返回nullptr
+    template<typename T>
+    T* tryCast() {
+        if (ops_ == nullptr || ops_->type_ != &typeTag<T>) {
+            return nullptr;
+        }
+        return static_cast<T*>(data());
+    }
+
+    bool hasValue() const {
+        return ops_ != nullptr;
+    }
+
+    // 销毁存放的值
+    void reset() {
+        if (ops_ != nullptr) {
+            ops_->destroy_(*this);
+            ops_ = nullptr;
         }
-        return ptr->data_;
     }
 
 private:
-    // 基类实现
-    class Base {
-    public:
-        // 虚析构函数
-        virtual ~Base() = default;
-    };
+    static constexpr size_t INLINE_SIZE = 4 * sizeof(void*);
+
+    // 能否直接存放在Any内部
+    template<typename T>
+    static constexpr bool isInline = sizeof(T) <= INLINE_SIZE
+                                  && alignof(std::max_align_t) % alignof(T) == 0
+                                  && std::is_nothrow_move_constructible_v<T>;
 
-    // 派生类实现
+    // 每个类型独有的标签，取地址用作类型的唯一标识
     template<typename T>
-    class Derive : public Base {
-    public:
-        Derive(T data) : data_(data) {}
-        T data_;
+    static constexpr char typeTag = 0;
+
+    // 每个类型对应一张操作表，相当于手写的虚函数表
+    struct Ops {
+        const void *type_;
+        bool inline_;
+        void (*move_)(Any &dst, Any &src) noexcept;
+        void (*destroy_)(Any &self) noexcept;
     };
 
-    // 基类指针
-    std::unique_ptr<Base> base_;
-};
+    template<typename T>
+    static void moveImpl(Any &dst, Any &src) noexcept {
+        if constexpr (isInline<T>) {
+            T *from = reinterpret_cast<T*>(src.storage_.buf_);
+            ::new (static_cast<void*>(dst.storage_.buf_)) T(std::move(*from));
+            from->~T();
+        } else {
+            // 堆上的值直接转移指针
+            dst.storage_.heap_ = src.storage_.heap_;
+        }
+    }
 
-class Semaphore {
-public:
-    Semaphore(int cnt = 0)
-        : cnt_(cnt)
-    {}
-    ~Semaphore() = default;
+    template<typename T>
+    static void destroyImpl(Any &self) noexcept {
+        if constexpr (isInline<T>) {
+            reinterpret_cast<T*>(self.storage_.buf_)->~T();
+        } else {
+            SlabAllocator::destroy(static_cast<T*>(self.storage_.heap_));
+        }
+    }
+
+    template<typename T>
+    static constexpr Ops opsOf = { &typeTag<T>, isInline<T>, &moveImpl<T>, &destroyImpl<T> };
 
-    // 等待，信号量资源被使用而减少
-    void wait() {
-        std::unique_lock<std::mutex> lock(mtx_);
-        // 等待条件变量cv_，直到resLimit_大于0
-        cv_.wait(lock, [&]() -> bool { return cnt_ > 0; });
-        cnt_ --;
+    void* data() {
+        return ops_->inline_ ? static_cast<void*>(storage_.buf_) : storage_.heap_;
     }
 
-    // 通知，返还一个信号量资源
-    void post() {
-        std::unique_lock<std::mutex> lock(mtx_);
-        cnt_ ++;
-        // 通知条件变量cv_，使得等待线程得以继续执行
-        cv_.notify_all();
+    void moveFrom(Any &other) noexcept {
+        if (other.ops_ != nullptr) {
+            other.ops_->move_(*this, other);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
     }
 
-private:
-    int cnt_; // 信号量资源数量
-    std::mutex mtx_;
-    std::condition_variable cv_;
+    union Storage {
+        alignas(std::max_align_t) unsigned char buf_[INLINE_SIZE];
+        void *heap_;
+    };
+
+    Storage storage_;
+    const Ops *ops_ = nullptr;
 };
 
+// 提交任务的结果状态
+enum class SubmitStatus {
+    STATUS_OK,          // 任务已经进入队列
+    STATUS_QUEUE_FULL,  // 队列已满，任务没有被提交(FAIL_FAST策略，或BLOCK策略等待超时)
+    STATUS_CALLER_RUNS, // 队列已满，任务已经在提交者线程中执行完毕(CALLER_RUNS策略)
+};
+
+// submitTask的返回值，内部是一个Future<Any>，可以安全地移动
+// 任务被丢弃(例如POLICY_DROP_OLDEST)而没有执行时，get()抛出std::future_error(broken_promise)
 class Result {
 public:
     Result() = default;
-    Result(std::shared_ptr<Task> task, bool isValid = true);
+    // task是已经入队的任务，在工作线程上等待它时如果它还没有开始执行，就直接在等待的线程上执行
+    Result(Future<Any> future, SubmitStatus status = SubmitStatus::STATUS_OK, ThreadPool *pool = nullptr,
+           const std::shared_ptr<Task> &task = nullptr);
     ~Result() = default;
 
-    // get方法 用于获取任务的结果
+    Result(Result&&) = default;
+    Result& operator=(Result&&) = default;
+
+    // get方法 用于获取任务的结果，任务没有执行完毕时等待，任务抛出的异常在这里重新抛出
     Any get();
 
-    // setVal方法
-    void setVal(Any any);
+    // 等待任务执行完毕
+    void wait();
+    // 最多等待timeout，任务已经执行完毕返回true
+    bool waitFor(std::chrono::milliseconds timeout);
+    bool isReady() const;
+
+    // 任务执行完毕后，把func(Any)投递到线程池中执行，不占用任何等待的线程，返回func结果的Result
+    // 提交失败、没有关联线程池或者结果已经被取走时返回无效的Result；已经挂过完成通知时抛出std::logic_error
+    template<typename F>
+    Result then(F &&func) {
+        arm();
+        if (!isValid() || pool_ == nullptr || !future_.valid()) {
+            return Result(Future<Any>(), SubmitStatus::STATUS_QUEUE_FULL);
+        }
+        Future<Any> next = future_.then(*pool_, [func = std::forward<F>(func)](Any value) mutable -> Any {
+            if constexpr (std::is_void_v<std::invoke_result_t<std::decay_t<F>&, Any>>) {
+                func(std::move(value));
+                return Any();
+            } else {
+                return func(std::move(value));
+            }
+        });
+        return Result(std::move(next), SubmitStatus::STATUS_OK, pool_);
+    }
+
+    // 任务提交的状态，提交失败时isValid()为false
+    SubmitStatus status() const;
+    bool isValid() const;
+
+private:
+    friend class BatchResult;
+    friend class CompletionQueue;
+    friend Future<void> whenAll(std::vector<Result> &results);
+    friend Future<size_t> whenAny(std::vector<Result> &results);
+
+    // 在工作线程上等待时，任务还在队列里就领走直接执行
+    void tryRunInline();
+    // 结果确定(执行完毕、被丢弃或者提交失败)后在确定它的线程上执行func，func不应该阻塞
+    // 每个结果只能挂一次，和then不能同时使用；结果已经确定时立即在当前线程执行
+    void onReady(MoveOnlyFunction<void()> func);
+    // 登记完成通知，已经登记过时抛出std::logic_error
+    void arm();
+
+    Future<Any> future_; // 任务的结果
+    SubmitStatus status_ = SubmitStatus::STATUS_OK; // 提交状态
+    ThreadPool *pool_ = nullptr; // then的后续操作投递到这个线程池
+    bool armed_ = false;         // 已经挂了完成通知(onReady或then)
+    std::weak_ptr<Task> task_;   // 入队的任务，不延长任务的生命周期
+};
+
+// 批量提交共用的完成计数，最后一个完成的任务唤醒waitAll的等待者
+// 整批任务只需要一次唤醒，而不是每个任务的结果各自唤醒一次
+class BatchLatch {
+public:
+    explicit BatchLatch(uint32_t count);
+
+    void countDown(uint32_t n = 1);
+    bool isDone() const;
+    void wait();
+    // 等到计数归零或超时，返回计数是否已经归零
+    bool waitUntil(std::chrono::steady_clock::time_point deadline);
+
+private:
+    // 在计数上睡眠，直到归零或超时
+    bool blockUntil(std::chrono::steady_clock::time_point deadline);
+
+    std::atomic<uint32_t> count_; // 还没有完成的任务数量，同时作为futex等待的变量
+};
+
+// submitBatch的返回值，每个任务的Result按提交顺序排列
+class BatchResult {
+public:
+    BatchResult() = default;
+    BatchResult(std::vector<Result> results, std::shared_ptr<BatchLatch> latch);
+
+    BatchResult(BatchResult&&) = default;
+    BatchResult& operator=(BatchResult&&) = default;
+
+    size_t size() const;
+    Result& operator[](size_t index);
+    std::vector<Result>::iterator begin();
+    std::vector<Result>::iterator end();
+
+    // 提交成功(包括STATUS_CALLER_RUNS)的任务数量
+    size_t submittedCount() const;
+
+    // 等待整批任务执行完毕(提交失败的任务不计入)，之后每个Result::get()都不会阻塞
+    void waitAll();
+    // 最多等待timeout，整批任务都已执行完毕返回true
+    bool waitAllFor(std::chrono::milliseconds timeout);
+    bool isAllReady() const;
+
 private:
-    Any any_; // 存储任务的结果
-    Semaphore sem_; // 信号量，用于通知线程池任务完成
-    std::shared_ptr<Task> task_; // 任务的共享指针
-    std::atomic_bool isValid_; // 标记返回值是否有效
+    void runInline();
+
+    std::vector<Result> results_;
+    std::shared_ptr<BatchLatch> latch_;
+};
+
+/*
+parallelFor/parallelReduce的共享状态，由调用者和所有帮忙的线程共同持有
+区间被切成若干个分块，参与者用一个原子计数领取分块，先做完的线程自然多领，不需要预先均分
+帮忙的线程可能在调用者返回之后才开始运行，这时它领不到分块，只会访问这个状态本身
+*/
+class ParallelState {
+public:
+    // participate在领取到第一个分块后被调用，负责执行这个分块并继续领取，最后调用finish
+    using Participate = void (*)(ParallelState &state, void *ctx, uint32_t chunk);
+
+    ParallelState(uint32_t chunks, Participate participate, void *ctx);
+
+    // 领取一个分块，分块已经领完时返回false
+    bool claim(uint32_t &chunk);
+
+    // 执行一个分块，记录第一个异常，之后的分块领取后不再执行
+    template<typename F>
+    void runChunk(F &func, uint32_t chunk) {
+        if (failed_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        try {
+            func(chunk);
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }
+
+    // 报告本线程完成了done个分块，最后一个分块完成时唤醒调用者
+    void finish(uint32_t done);
+
+    // 领取分块并参与执行，领不到分块时直接返回
+    void participate();
+
+    // 等待所有分块完成，分块中抛出的第一个异常在这里重新抛出
+    void wait();
+
+    std::mutex mtx_; // parallelReduce合并各个线程的部分结果
+
+private:
+    void fail(std::exception_ptr error);
+
+    Participate participate_;
+    void *ctx_;                             // 调用者栈上的参与函数，只有领到分块的线程才会访问
+    uint32_t chunks_;                       // 分块总数
+    std::atomic<uint64_t> next_ {0};        // 下一个要领取的分块
+    std::atomic<uint32_t> remaining_;       // 还没有完成的分块数量，同时作为futex等待的变量
+    std::atomic_bool failed_ {false};
+    std::exception_ptr error_;
 };
 
 class Task {
 public:
     Task();
-    ~Task() = default;
+    virtual ~Task() = default;
+    // 执行任务，run()的返回值或抛出的异常写入结果通道
+    // 没有结果通道的任务(post)抛出的异常没有人接收，作为返回值交给调用者，正常结束时返回空
+    std::exception_ptr exec();
     // 可自定义重载run类型
-    void exec();
-    void setResult(Result *res);
     virtual Any run() = 0;
 
+protected:
+    // 供run()中的长循环检查是否应该提前结束：提交时的token是否已经被取消，只是一次原子读
+    bool isCancelled() const {
+        return token_.isCancelled();
+    }
+    // 是否已经超过提交时指定的截止时间，没有指定时不读时钟
+    bool isExpired() const {
+        return deadline_ != std::chrono::steady_clock::time_point::max()
+            && std::chrono::steady_clock::now() > deadline_;
+    }
+
 private:
-    // 为什么用裸指针？因为智能指针不能相互调用(Result类有Task智能指针，Task类如果也用Result智能指针)，不然会造成死锁内存泄露
-    Result *result_; // 指向Result类的指针
+    friend class ThreadPool;
+    friend class StrandCore;
+    friend class Strand;
+
+    // 为本次提交创建新的结果通道
+    Future<Any> makeFuture();
+    // 任务不会再执行了，通知等待结果的一方；error为空时等待方得到broken_promise
+    void abandon(std::exception_ptr error = nullptr);
+    // 领取本次提交的执行权，队列中的执行者和在工作线程上等待结果的一方(Result::get)只有一个能领到
+    // 没有结果通道的任务(post)不会被等待，不需要原子交换
+    bool claim() {
+        return claim_.load(std::memory_order_relaxed) == CLAIM_NONE
+            || claim_.exchange(CLAIM_TAKEN, std::memory_order_acq_rel) != CLAIM_TAKEN;
+    }
+    bool isClaimed() const {
+        return claim_.load(std::memory_order_acquire) == CLAIM_TAKEN;
+    }
+
+    static constexpr uint8_t CLAIM_NONE = 0;  // 没有结果通道，只会从队列中执行
+    static constexpr uint8_t CLAIM_OPEN = 1;  // 还没有被领取
+    static constexpr uint8_t CLAIM_TAKEN = 2; // 已经被领走执行(或丢弃)
+
+    Promise<Any> promise_ { nullptr }; // run()的返回值写到这里，和Result中的Future<Any>共享状态
+    std::shared_ptr<BatchLatch> latch_; // 批量提交时，任务执行完毕(或被丢弃)后在这里计数
+    std::chrono::steady_clock::time_point enqueueTime_; // 入队时间，用来统计排队延迟(cached模式下还用来决定扩容)
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max(); // 本次提交的截止时间
+    CancellationToken token_;                           // 本次提交的取消标记
+    uint64_t traceId_ = 0;                              // 开启追踪时提交分配的编号，把提交和执行连起来
+    std::atomic<uint8_t> claim_ {CLAIM_NONE};           // 本次提交的执行权，makeFuture时打开
+    Task *strandNext_ = nullptr;                        // 在strand的收件箱中排队时指向下一个任务
+    bool internal_ = false;                             // 线程池内部组件(strand、协程、流水线等)的任务，一定入队，不会被丢弃
+    // 工作窃取队列里只能存放裸指针，任务在队列中时由自身持有一份引用，出队时再交还给执行线程
+    std::shared_ptr<Task> self_;
 };
 
+// 创建任务，任务对象和shared_ptr的控制块一起从SlabAllocator分配
+// 任务通常在提交者线程上创建、在工作线程上释放，比std::make_shared少了malloc跨线程释放的开销
+template<typename T, typename... Args>
+std::shared_ptr<T> makeTask(Args&&... args) {
+    return std::allocate_shared<T>(SlabStlAllocator<T>(), std::forward<Args>(args)...);
+}
+
 enum class PoolMode {
     MODE_FIXED, 
     MODE_CACHED, 
+    MODE_WORK_STEALING, // 每个线程有自己的任务队列，空闲时去其他线程那里窃取任务
+};
+
+// 共享任务队列的实现方式
+enum class QueueType {
+    QUEUE_MUTEX,          // 环形缓冲区 + 互斥锁
+    QUEUE_LOCK_FREE_RING, // 有界无锁环形队列，容量为任务队列阈值向上取整到2的幂
+};
+
+// 车道队列内的出队顺序
+enum class QueueOrder {
+    ORDER_FIFO,     // 先进先出，同一车道内按租户权重轮转
+    ORDER_DEADLINE, // 截止时间优先(EDF)，没有截止时间的任务排在最后；
+                    // 为了保证全局顺序，所有任务都进入带锁的车道队列，不再使用无锁环形队列、节点队列和本地队列
+};
+
+// 任务队列满时submitTask的处理策略
+enum class OverflowPolicy {
+    POLICY_BLOCK,       // 阻塞等待，最长等待setSubmitTimeout设置的时长，超时返回STATUS_QUEUE_FULL
+    POLICY_FAIL_FAST,   // 立即返回STATUS_QUEUE_FULL
+    POLICY_CALLER_RUNS, // 在提交者线程中直接执行该任务
+    POLICY_DROP_OLDEST, // 丢弃队列中最早的任务，为新任务腾出位置；strand、协程等内部组件的任务不会被丢弃
+                        // 无锁环形队列上其他线程长时间占住槽位、腾不出位置时返回STATUS_QUEUE_FULL
+};
+
+// 线程绑核的方式
+// 绑核之后，机器有多个NUMA节点时每个节点有一个自己的任务队列，线程先从本节点的队列和本节点的其他线程那里取任务
+enum class AffinityPolicy {
+    AFFINITY_NONE,     // 不绑核，由操作系统调度
+    AFFINITY_COMPACT,  // 先占满一个NUMA节点的所有CPU，再使用下一个节点
+    AFFINITY_SCATTER,  // 在各个NUMA节点之间轮流分配CPU
+    AFFINITY_EXPLICIT, // 按照setAffinity给出的CPU列表依次绑定
+};
+
+// 任务的优先级车道，车道之间严格按优先级出队(有老化，低优先级车道不会被饿死)
+enum class TaskPriority {
+    PRIORITY_HIGH,   // 延迟敏感的请求
+    PRIORITY_NORMAL, // 默认车道
+    PRIORITY_LOW,    // 批处理等后台任务
+};
+const size_t TASK_PRIORITY_COUNT = 3;
+
+// submitTask的可选参数
+struct SubmitOptions {
+    TaskPriority priority = TaskPriority::PRIORITY_NORMAL;
+    uint32_t tenant = 0; // 租户(或分组)id，同一车道内按照租户的权重轮转
+    int node = -1;       // NUMA节点提示，取值[0, getNodeCount())，-1表示不指定；只对默认车道、默认租户的任务生效
+    // 截止时间：出队时已经超过截止时间的任务不再执行，Result::get()抛出TaskExpired；默认没有截止时间
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // 取消标记：出队时已经取消的任务不再执行，Result::get()抛出TaskCancelled；执行中的任务通过Task::isCancelled()检查
+    CancellationToken token;
+};
+
+// cached模式下线程数量的伸缩策略
+// 扩容：积压的任务比空闲线程多，并且 排队延迟达到targetQueueWait 或者 积压达到backlogRatio倍的(空闲线程数+1)，
+//      两次创建线程至少间隔growInterval；在提交任务和线程执行完任务时评估
+// 收缩：线程空闲超过idleTimeout，并且排队延迟已经降到targetQueueWait的一半以下(滞回，避免刚扩容就收缩)，线程退出
+// 线程数量始终在[minThreads, setThreadThreshHold设置的上限]之间
+struct ElasticPolicy {
+    std::chrono::microseconds targetQueueWait { 1000 }; // 任务从入队到开始执行的平均等待时间的目标
+    size_t backlogRatio = 2;                              // 为1时只要有任务没有空闲线程处理就扩容
+    std::chrono::microseconds growInterval { 1000 };    // 两次创建线程的最小间隔
+    std::chrono::milliseconds idleTimeout { 60000 };    // 线程空闲多久后退出
+    size_t minThreads = 0;                                // 线程数量下限，0表示使用start的初始线程数量
+};
+
+/*
+告诉线程池当前的工作线程即将阻塞(睡眠、阻塞的系统调用、数据库调用)，阻塞期间临时启用一个备用线程顶替它
+example:
+Any run() override {
+    std::string row;
+    {
+        BlockingGuard guard;   // 或者 ThreadPool::blocking([&]() { row = db.query(sql); });
+        row = db.query(sql);
+    }
+    return parse(row);
+}
+
+- 只在线程池的工作线程上生效，其他线程上构造什么也不做；嵌套的BlockingGuard只计一次
+- 正在阻塞的线程数量超过已有的备用线程时创建一个新线程，备用线程总数不超过setSpareThreadThreshHold设置的上限
+- 阻塞的线程返回后多出来的备用线程(不一定是当初创建的那一个)在取下一个任务之前退下来，正在干活的线程数量回到原来的水平；
+  退下来的线程挂起一小段时间，期间又有线程阻塞就直接重新启用它，否则退出
+*/
+class BlockingGuard {
+public:
+    BlockingGuard();
+    ~BlockingGuard();
+
+    BlockingGuard(const BlockingGuard&) = delete;
+    BlockingGuard& operator=(const BlockingGuard&) = delete;
+
+private:
+    ThreadPool *pool_ = nullptr; // 当前线程所属的线程池，不是工作线程时为nullptr
+};
+
+// co_await pool.schedule()的等待体：挂起当前协程，由线程池中的线程恢复执行
+// 它本身就是投递给线程池的任务，存放在协程帧里，线程池不接管它的生命周期，每次co_await不分配内存
+class ScheduleAwaiter : public Task {
+public:
+    ScheduleAwaiter(ThreadPool &pool, const SubmitOptions &options)
+        : pool_(pool),
+          options_(options)
+    {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {}
+
+    // 恢复协程之后本对象随协程中的co_await表达式一起销毁，之后不能再访问成员
+    Any run() override {
+        handle_.resume();
+        return Any();
+    }
+
+private:
+    ThreadPool &pool_;
+    SubmitOptions options_;
+    std::coroutine_handle<> handle_;
 };
 
 class Thread {
@@ -178,9 +609,121 @@ public:
 
     // 设置cached模式下，线程数量阈值
     void setThreadThreshHold(size_t threshhold);
+
+    // 设置cached模式下线程数量的伸缩策略
+    void setElasticPolicy(const ElasticPolicy &policy);
+
+    // 设置工作线程阻塞(BlockingGuard)时最多临时启用多少个备用线程，0表示不补偿，默认为64
+    void setSpareThreadThreshHold(size_t threshhold);
+
+    // 当前的线程数量
+    size_t getThreadSize() const;
+
+    // 设置共享任务队列的实现方式
+    void setQueueType(QueueType type);
+
+    // 设置车道队列内的出队顺序
+    void setQueueOrder(QueueOrder order);
+
+    // 设置任务队列满时的处理策略
+    void setOverflowPolicy(OverflowPolicy policy);
+
+    // 设置线程找不到任务时挂起前自旋等待的时长，0表示不自旋(单核机器上默认不自旋)
+    void setWorkerSpinTime(std::chrono::microseconds spin);
+
+    // 设置线程绑核的方式，线程数量超过可用的CPU数量时循环使用
+    void setAffinity(AffinityPolicy policy);
+    // 按照给出的CPU编号依次绑定线程(AFFINITY_EXPLICIT)，空列表表示不绑核
+    void setAffinity(std::vector<int> cpus);
+
+    // 线程池使用的NUMA节点数量，没有绑核或者只有一个节点时为1
+    size_t getNodeCount() const;
+
+    // 设置POLICY_BLOCK策略下的最长等待时间，std::chrono::milliseconds::max()表示一直等待
+    void setSubmitTimeout(std::chrono::milliseconds timeout);
+
+    // 因为POLICY_DROP_OLDEST被丢弃的任务数量
+    size_t getDroppedTaskCount() const;
+    // 出队时因为超过截止时间而没有执行的任务数量
+    size_t getExpiredTaskCount() const;
+    // 出队时因为已经取消而没有执行的任务数量
+    size_t getCancelledTaskCount() const;
+    // 没有结果通道的任务(post)抛出异常的次数
+    size_t getFailedTaskCount() const;
+
+    // 设置没有结果通道的任务(post)抛出异常时的处理函数，在执行任务的线程上调用，处理函数抛出的异常被忽略
+    // 不设置时异常只计入getFailedTaskCount()
+    void setErrorHandler(MoveOnlyFunction<void(std::exception_ptr)> handler);
+
+    // 线程池的运行指标：各个线程的计数、排队延迟和执行时长的分布、队列深度和线程数量
+    // snapshot().toPrometheus()得到Prometheus的文本格式
+    // 编译时定义THREADPOOL_METRICS=0可以去掉热路径上的所有计数，这时只有瞬时值
+    MetricsSnapshot snapshot() const;
+
+    // 开启调度事件追踪(提交、出队、开始、结束、窃取、挂起、唤醒)，每个线程保存最近eventsPerThread个事件
+    // 缓冲区在第一次开启时创建，之后再开启沿用原来的缓冲区；没有开启时热路径上只有一次原子读
+    void startTracing(size_t eventsPerThread = 65536);
+    // 停止记录，已经记录的事件保留
+    void stopTracing();
+    // 把记录的事件写成Chrome trace / Perfetto的JSON，运行期间也可以调用
+    void writeChromeTrace(std::ostream &out) const;
     
     // 给线程池提交任务
     Result submitTask(std::shared_ptr<Task> sp);
+    // 指定优先级车道和租户提交任务
+    // 注意：无锁环形队列只承载默认车道、默认租户的任务，其他任务进入带锁的车道队列
+    Result submitTask(std::shared_ptr<Task> sp, const SubmitOptions &options);
+    Result submitTask(std::shared_ptr<Task> sp, TaskPriority priority, uint32_t tenant = 0);
+
+    // 按键串行提交(见strand.h)：键相同的任务按提交顺序逐个执行，从不并发，键不同的任务并行
+    // 串行任务不占用任务队列，不受队列上限和溢出策略的约束；options中的车道、租户和节点在键空闲后的第一次提交时生效
+    Result submitTask(uint64_t key, std::shared_ptr<Task> sp, const SubmitOptions &options = SubmitOptions());
+    void post(uint64_t key, MoveOnlyFunction<void()> func);
+
+    // 设置租户在车道内轮转时的权重(默认为1)，权重为w的租户每轮连续出队w个任务，可以在运行时调整
+    void setTenantWeight(uint32_t tenant, uint32_t weight);
+
+    // 设置老化阈值：非空车道超过threshold没有被服务就优先服务一次，zero表示严格按优先级
+    void setPriorityAging(std::chrono::milliseconds threshold);
+
+    // 某个车道中等待执行的任务数量(默认车道包括无锁环形队列中的任务，不包括工作窃取的本地队列)
+    size_t getLaneDepth(TaskPriority priority) const;
+
+    // 批量提交任务：整批任务只获取一次锁，只唤醒min(任务数量, 等待中的线程数量)个线程
+    // 队列满时剩余的任务逐个按照溢出策略处理
+    BatchResult submitBatch(std::vector<std::shared_ptr<Task>> tasks, const SubmitOptions &options = SubmitOptions());
+    template<typename InputIt>
+    BatchResult submitBatch(InputIt first, InputIt last, const SubmitOptions &options = SubmitOptions()) {
+        return submitBatch(std::vector<std::shared_ptr<Task>>(first, last), options);
+    }
+
+    // 并行执行body(i)，i取遍[begin, end)
+    // 区间按grain切成分块(grain为0时自动选择)，调用者线程也参与执行，空闲线程越多参与的线程越多
+    // 分块内部是一个简单的计数循环，body内联之后编译器可以自动向量化
+    template<typename Index, typename Body>
+    void parallelFor(Index begin, std::type_identity_t<Index> end, size_t grain, Body &&body);
+
+    // 并行归约：返回combine(identity, map(begin), ..., map(end - 1))
+    // combine需要满足结合律和交换律，各分块的部分结果合并的顺序不固定；identity只参与一次合并，可以是任意初始值
+    template<typename Index, typename T, typename Map, typename Combine>
+    T parallelReduce(Index begin, std::type_identity_t<Index> end, T identity, Map &&map, Combine &&combine,
+                     size_t grain = 0);
+
+    // 提交一个不需要返回值的函数，Future::then等内部组件也通过它把后续操作投递到线程池
+    // 队列满时不会阻塞也不会失败，而是在当前线程直接执行
+    // func抛出的异常没有调用者接收，交给setErrorHandler设置的处理函数并计入getFailedTaskCount()，不会终止进程
+    void post(MoveOnlyFunction<void()> func);
+
+    // 让协程切换到线程池中执行：co_await pool.schedule()之后的代码由线程池中的线程继续执行
+    // 和post一样，队列满时在当前线程直接恢复协程；options中的截止时间和取消标记不生效，协程一定会被恢复
+    ScheduleAwaiter schedule(const SubmitOptions &options = SubmitOptions());
+
+    // 在BlockingGuard的保护下执行func并返回它的返回值，在工作线程上执行会阻塞的操作时使用
+    template<typename F>
+    static decltype(auto) blocking(F &&func) {
+        BlockingGuard guard;
+        return std::forward<F>(func)();
+    }
 
     // 禁用(copy construct)拷贝构造，如`ThreadPool a = ThreadPool()`
     ThreadPool(const ThreadPool&) = delete;
@@ -188,21 +731,160 @@ public:
     ThreadPool& operator=(const ThreadPool&) = delete;
 
 private:
+    friend class TaskGraph;
+    friend class Pipeline;
+    friend class ScheduleAwaiter;
+    friend class IoReactor;
+    friend class StrandCore;
+    friend class Strand;
+    friend class Result;
+    friend class BlockingGuard;
+
     // Thread类当中的method并不能操作ThreadPool当中维护的变量，这个threadFunc相当于是个桥梁
     // 因为我们要维护的描述变量都在ThreadPool类当中，所以我们需要一个Helper Function来供Thread来绑定使用
-    void threadFunc(size_t tid);
+    // slot是线程在workers_中的下标，线程退出后会被新创建的线程复用
+    void threadFunc(size_t tid, size_t slot);
+
+    // 按照绑核方式给每个slot分配CPU和NUMA节点，有多个节点时创建节点队列
+    void placeWorkers();
+
+    struct Worker;
+    struct Node;
+
+    // 创建并启动一个线程，调用者需持有taskQueMtx_
+    void addThread();
+    // 线程的消费循环：找任务执行，找不到就先自旋，再挂起等待唤醒
+    // cached模式下线程因为空闲太久而退出时返回true，这时线程数量已经扣除
+    bool pollLoop(Worker *self);
+#if THREADPOOL_METRICS
+    // 记录一个任务的排队延迟、执行前的空闲时长和执行时长
+    void recordTask(Worker *self, int64_t waitNs, std::chrono::nanoseconds idle, std::chrono::nanoseconds run);
+#endif
+    // 记录一个追踪事件，没有开启追踪时只是一次原子读
+    void trace(TraceEventType type, uint64_t arg = 0);
+    // 给提交的任务分配追踪编号并记录提交事件
+    void traceSubmit(Task &task);
+    // 当前线程在追踪器中的缓冲区
+    TraceBuffer& traceBuffer(Tracer &tracer) const;
+
+    // cached模式下按照伸缩策略判断是否需要再创建一个线程
+    void maybeGrow();
+    // 空闲太久的线程尝试退出，线程数量不会低于下限，还有任务时不退出
+    bool retireWorker();
+    // 工作线程进入/离开阻塞区，进入时按需启用备用线程
+    void enterBlocking(Worker *self);
+    void leaveBlocking(Worker *self);
+    // 备用线程比阻塞中的线程多时，当前线程退下来作为后备挂起，一段时间没有被重新启用就退出并返回true，这时线程数量已经扣除
+    bool retireSpare(Worker *self);
+    // 在spinTime_内自旋等待任务出现，出现返回true
+    bool spinForTask();
+    // 登记到空闲线程表并挂起，被唤醒返回true，超时返回false
+    bool parkWorker(Worker *self, std::chrono::nanoseconds timeout);
+    // 从空闲线程表中撤销本次挂起，返回撤销前是否还在表中(不在说明已经被唤醒者领走)
+    bool cancelPark(Worker *self, uint32_t ticket);
+    // 依次尝试本地队列、本节点队列、全局注入队列、窃取，拿到任务返回true
+    bool findTask(Worker *self, std::shared_ptr<Task> &task);
+    // 从全局队列(车道队列或无锁环形队列)中取一个任务，self不为空时从车道队列中顺带多取几个放入它的本地队列
+    bool popSharedTask(Worker *self, std::shared_ptr<Task> &task);
+    // 车道队列中是否有任务，不加锁
+    bool hasLaneTask() const;
+    // 从车道队列中取一个任务，urgentOnly时只取最高优先级车道或已经老化的车道中的任务
+    // self不为空时按队列深度在同一次加锁中多取几个任务，按出队顺序放入self的本地队列，其他线程可以窃取
+    bool popLaneTask(std::shared_ptr<Task> &task, bool urgentOnly, Worker *self = nullptr);
+    // 工作线程等待结果时帮忙执行一个任务，没有任务或者嵌套太深时返回false
+    bool helpOnce(Worker *self);
+    // 在等待结果的工作线程上直接执行还在队列中的任务，任务已经被领走时什么也不做
+    void runInline(Task &task);
+    // 任务已经取消或者超过截止时间时丢弃它并返回true，now是出队的时间，time_point::min()表示还没有读时钟
+    bool dropIfStale(Task &task, std::chrono::steady_clock::time_point now);
+    // 从节点队列中取一个任务
+    bool popNodeTask(size_t node, std::shared_ptr<Task> &task);
+    // 先在本节点内窃取，再去其他节点的节点队列和线程那里取
+    bool stealTask(Worker *self, std::shared_ptr<Task> &task);
+    // 从victims中随机挑选一个起点依次窃取
+    template<typename Victims>
+    bool stealFrom(Worker *self, const Victims &victims, std::shared_ptr<Task> &task);
+    // 唤醒一个挂起的线程
+    void wakeWorker();
+    // 唤醒至多n个挂起的线程，每个线程单独唤醒，没有被唤醒的线程不受打扰
+    void wakeWorkers(size_t n);
+    // 优先唤醒一个挂起在node节点上的线程，节点上没有挂起的线程时唤醒任意一个
+    void wakeWorkerOn(size_t node);
+    // 唤醒已经从空闲线程表中取出的线程
+    void unparkWorker(Worker *worker, uint32_t ticket);
+    // 线程池析构时唤醒所有挂起的线程
+    void wakeAllWorkers();
+    // 唤醒因为队列满而阻塞的提交者
+    void wakeSubmitter();
+
+    // 把任务放入队列，队列满时按policy处理
+    SubmitStatus enqueueTask(std::shared_ptr<Task> sp, OverflowPolicy policy, const SubmitOptions &options = SubmitOptions());
+    // 把一批任务放入队列，每个任务的提交状态写入status
+    void enqueueBatch(std::vector<std::shared_ptr<Task>> &tasks, std::vector<SubmitStatus> &status, const SubmitOptions &options);
+    // 各个队列的提交路径
+    SubmitStatus submitToMutexQueue(std::shared_ptr<Task> sp, OverflowPolicy policy, const SubmitOptions &options);
+    SubmitStatus submitToRingQueue(std::shared_ptr<Task> sp, OverflowPolicy policy);
+    SubmitStatus submitToNodeQueue(std::shared_ptr<Task> sp, OverflowPolicy policy, const SubmitOptions &options);
+    // POLICY_CALLER_RUNS：在当前线程执行任务
+    SubmitStatus runInCaller(std::shared_ptr<Task> sp);
+    // 投递内部组件的任务：不受队列阈值和溢出策略限制，不会被POLICY_DROP_OLDEST丢弃，也不会在提交者线程上执行
+    // options中的截止时间和取消标记被忽略，这类任务一定会执行
+    void postInternal(std::shared_ptr<Task> sp, const SubmitOptions &options);
+    // 投递调用者持有的内部任务，线程池不接管它的生命周期，调用者保证任务执行完毕前一直有效
+    void postInternal(Task &task, const SubmitOptions &options);
+
+    // 把函数包装成任务
+    static std::shared_ptr<Task> makeFuncTask(MoveOnlyFunction<void()> func);
+    // 执行任务，没有结果通道的任务抛出的异常交给错误处理函数
+    void execTask(Task &task);
+    // 当前线程所在的NUMA节点，不是本线程池的线程或者只有一个节点时为-1
+    int currentNode() const;
+
+    // 按元素数量和粒度计算分块大小，保证分块数量不超过uint32_t
+    size_t chunkSizeFor(size_t n, size_t grain) const;
+    // 调用者和空闲线程一起执行chunks个分块，participate的签名为void(ParallelState&, uint32_t firstChunk)
+    template<typename F>
+    void runParallel(uint32_t chunks, F &participate);
 
     bool checkRunningState() const; // 检查线程池是否正在运行，因为如果不封装，每个Threadpool库中的方法都要调用一遍
 private:
     // 使用智能指针，使得当threads_在析构时，自动释放指针的资源
     // std::vector<std::unique_ptr<Thread>> threads_;      // 线程池本身
     std::unordered_map<size_t, std::unique_ptr<Thread>> threads_;       // 线程池本身
+    std::vector<std::unique_ptr<Worker>> workers_;                      // 每个线程的私有状态(工作窃取队列等)，按slot下标访问
+    std::vector<size_t> freeSlots_;                                     // 尚未被线程占用的slot
+    std::vector<std::unique_ptr<Node>> nodes_;                          // 每个NUMA节点的任务队列和线程，只有一个节点时为空
+    AffinityPolicy affinity_;                                           // 线程绑核的方式
+    std::vector<int> affinityCpus_;                                     // AFFINITY_EXPLICIT的CPU列表
+    static thread_local Worker *currentWorker_;                         // 当前线程对应的Worker，非线程池线程为nullptr
     size_t initThreadSize_;                                             // 初始线程数量
     std::atomic_int curThreadSize_;                                     // 当前线程数量
     std::atomic_int idleThreadSize_;                                    // 空闲线程的数量
     size_t maxThreadSize_;                                              // 最大线程数量上限阈值
-
-    std::queue<std::shared_ptr<Task>> taskQue_;                         // 任务队列
+    size_t minThreadSize_;                                              // cached模式下线程数量的下限
+    ElasticPolicy elastic_;                                             // cached模式下线程数量的伸缩策略
+    std::atomic<int64_t> queueWaitNs_ {0};                              // 排队延迟的指数移动平均，单位：纳秒
+    std::atomic<int64_t> lastGrowNs_ {0};                               // 上一次扩容的时间(steady_clock)，单位：纳秒
+    size_t maxSpareThreadSize_;                                         // 阻塞补偿的备用线程数量上限
+    std::atomic_int blockedThreadSize_ {};                              // 处于BlockingGuard中的工作线程数量
+    std::atomic_int spareThreadSize_ {};                                // 为了补偿阻塞而启用的备用线程数量，由taskQueMtx_保护修改
+    std::vector<Worker*> spareWorkers_;                                 // 退下来的备用线程，挂起等待被重新启用，由taskQueMtx_保护
+
+    LaneQueue<std::shared_ptr<Task>> taskQue_ { TASK_PRIORITY_COUNT };  // 任务队列，按优先级车道和租户组织，工作窃取模式下作为外部提交者的全局注入队列
+    std::unique_ptr<BoundedMPMCQueue<Task*>> ringQue_;                  // QUEUE_LOCK_FREE_RING时代替taskQue_承载默认车道、默认租户的任务
+    QueueType queueType_;                                               // 共享任务队列的实现方式
+    QueueOrder queueOrder_;                                             // 车道队列内的出队顺序
+    OverflowPolicy overflowPolicy_;                                     // 队列满时的处理策略
+    std::chrono::milliseconds submitTimeout_;                           // POLICY_BLOCK的最长等待时间
+    std::atomic_size_t droppedTaskSize_ {};                             // 被丢弃的任务数量
+    std::atomic_size_t expiredTaskSize_ {};                             // 出队时超过截止时间的任务数量
+    std::atomic_size_t cancelledTaskSize_ {};                           // 出队时已经取消的任务数量
+    std::atomic_size_t failedTaskSize_ {};                              // 没有结果通道的任务抛出异常的次数
+    MoveOnlyFunction<void(std::exception_ptr)> errorHandler_;           // 没有结果通道的任务抛出异常时调用
+    mutable std::mutex tracerMtx_;                                      // 保护tracerOwner_的创建和导出
+    std::unique_ptr<Tracer> tracerOwner_;                               // 第一次开启追踪时创建，线程池析构时释放
+    std::atomic<Tracer*> tracer_ {nullptr};                             // 正在追踪时指向tracerOwner_，否则为空
+    std::unique_ptr<StrandTable> strands_;                              // 按键串行提交的strand
     
     // 原子操作 保证线程安全 轻量的锁 适用于计数器
     std::atomic_uint taskSize_ {};                                      // 记录任务的数量
@@ -211,10 +893,115 @@ private:
     // 线程安全
     std::mutex taskQueMtx_;                                             // 任务队列的互斥锁
     std::condition_variable notFull_ {};                                // 任务队列不满
-    std::condition_variable notEmpty_ {};                               // 任务队列不空
+    std::condition_variable exitCond_ {};                               // 等待线程资源全部回收
+    std::mutex parkMtx_;                                                // 保护空闲线程表
+    std::vector<Worker*> parkedWorkers_;                                // 已经挂起的线程，后挂起的先被唤醒
+    std::atomic_int sleepThreadSize_ {};                                // 已经挂起的线程数量
+    std::chrono::microseconds spinTime_;                                // 挂起前自旋的时长
+    std::atomic_int blockedSubmitterSize_ {};                           // 正在notFull_上等待的提交者数量
 
     PoolMode poolMode_;                                                 // 当前线程池的工作模式
     std::atomic_bool isPoolRunning_ {};                                 // 标记线程池是否正在运行
 };
 
+template<typename F>
+void ThreadPool::runParallel(uint32_t chunks, F &participate) {
+    ParallelState::Participate invoke = [](ParallelState &state, void *ctx, uint32_t chunk) {
+        (*static_cast<F*>(ctx))(state, chunk);
+    };
+    auto state = std::allocate_shared<ParallelState>(SlabStlAllocator<ParallelState>(), chunks, invoke, &participate);
+
+    // 只请空闲的线程帮忙，其余的分块由调用者自己完成，线程池很忙时不会因为等待帮手而阻塞
+    int idle = idleThreadSize_;
+    size_t helpers = idle > 0 ? std::min<size_t>(static_cast<size_t>(idle), chunks - 1) : 0;
+    for (size_t i = 0; i < helpers; i ++) {
+        post([state]() { state->participate(); });
+    }
+
+    state->participate();
+    state->wait();
+}
+
+template<typename Index, typename Body>
+void ThreadPool::parallelFor(Index begin, std::type_identity_t<Index> end, size_t grain, Body &&body) {
+    static_assert(std::is_integral_v<Index>, "parallelFor requires an integral index type");
+    if (!(begin < end)) {
+        return;
+    }
+    size_t n = static_cast<size_t>(end - begin);
+    size_t chunkSize = chunkSizeFor(n, grain);
+    uint32_t chunks = static_cast<uint32_t>((n + chunkSize - 1) / chunkSize);
+
+    auto runChunk = [&](uint32_t chunk) {
+        Index lo = static_cast<Index>(begin + static_cast<Index>(chunk * chunkSize));
+        Index hi = chunk + 1 == chunks ? end : static_cast<Index>(lo + static_cast<Index>(chunkSize));
+        for (Index i = lo; i < hi; i ++) {
+            body(i);
+        }
+    };
+    if (chunks == 1) {
+        runChunk(0);
+        return;
+    }
+
+    auto participate = [&](ParallelState &state, uint32_t chunk) {
+        uint32_t done = 0;
+        do {
+            state.runChunk(runChunk, chunk);
+            done ++;
+        } while (state.claim(chunk));
+        state.finish(done);
+    };
+    runParallel(chunks, participate);
+}
+
+template<typename Index, typename T, typename Map, typename Combine>
+T ThreadPool::parallelReduce(Index begin, std::type_identity_t<Index> end, T identity, Map &&map, Combine &&combine,
+                             size_t grain) {
+    static_assert(std::is_integral_v<Index>, "parallelReduce requires an integral index type");
+    if (!(begin < end)) {
+        return identity;
+    }
+    size_t n = static_cast<size_t>(end - begin);
+    size_t chunkSize = chunkSizeFor(n, grain);
+    uint32_t chunks = static_cast<uint32_t>((n + chunkSize - 1) / chunkSize);
+
+    // 分块内部累加到局部变量，循环里没有共享状态，编译器可以把它向量化
+    auto reduceChunk = [&](uint32_t chunk) -> T {
+        Index lo = static_cast<Index>(begin + static_cast<Index>(chunk * chunkSize));
+        Index hi = chunk + 1 == chunks ? end : static_cast<Index>(lo + static_cast<Index>(chunkSize));
+        // 从分块的第一个值开始累加，identity只在最后合并一次，不要求它是真正的单位元
+        T acc = map(lo);
+        for (Index i = lo + 1; i < hi; i ++) {
+            acc = combine(acc, map(i));
+        }
+        return acc;
+    };
+    if (chunks == 1) {
+        return combine(identity, reduceChunk(0));
+    }
+
+    // 每个参与的线程先在本地合并自己领到的分块，最后只加一次锁合并到result
+    T result = identity;
+    auto participate = [&](ParallelState &state, uint32_t chunk) {
+        std::optional<T> local;
+        auto runChunk = [&](uint32_t c) {
+            local = local.has_value() ? combine(std::move(*local), reduceChunk(c)) : reduceChunk(c);
+        };
+        uint32_t done = 0;
+        do {
+            state.runChunk(runChunk, chunk);
+            done ++;
+        } while (state.claim(chunk));
+        // 分块抛出异常时可能一个部分结果都没有
+        if (local.has_value()) {
+            std::lock_guard<std::mutex> lock(state.mtx_);
+            result = combine(result, std::move(*local));
+        }
+        state.finish(done);
+    };
+    runParallel(chunks, participate);
+    return result;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef __linux__
+// 解析"0-3,8-11"格式的CPU列表
+static std::vector<int> parseCpuList(const std::string &text) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t dash = item.find('-');
+        try {
+            int lo = std::stoi(item.substr(0, dash));
+            int hi = dash == std::string::npos ? lo : std::stoi(item.substr(dash + 1));
+            for (int cpu = lo; cpu <= hi; cpu ++) {
+                cpus.push_back(cpu);
+            }
+        } catch (...) {
+            // 空项(例如没有CPU的节点)或者格式不对，跳过
+        }
+    }
+    return cpus;
+}
+
+// 内核的NUMA节点编号，从小到大
+static std::vector<int> listNodeIds() {
+    std::vector<int> ids;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir == nullptr) {
+        return ids;
+    }
+    while (dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0
+            && std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            ids.push_back(std::stoi(name.substr(4)));
+        }
+    }
+    closedir(dir);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+#endif
+
+CpuTopology CpuTopology::detect() {
+    CpuTopology topo;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool hasMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    auto isAllowed = [&](int cpu) {
+        return !hasMask || (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed));
+    };
+
+    for (int id : listNodeIds()) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+        std::string text;
+        std::getline(in, text);
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(text)) {
+            if (isAllowed(cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            topo.nodes_.push_back(std::move(cpus));
+        }
+    }
+
+    if (topo.nodes_.empty() && hasMask) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu ++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {
+            topo.nodes_.push_back(std::move(cpus));
+        }
+    }
+#endif
+    if (topo.nodes_.empty()) {
+        std::vector<int> cpus(std::max(std::thread::hardware_concurrency(), 1u));
+        for (size_t i = 0; i < cpus.size(); i ++) {
+            cpus[i] = static_cast<int>(i);
+        }
+        topo.nodes_.push_back(std::move(cpus));
+    }
+    return topo;
+}
+
+size_t CpuTopology::nodeCount() const {
+    return nodes_.size();
+}
+
+size_t CpuTopology::cpuCount() const {
+    size_t count = 0;
+    for (auto &cpus : nodes_) {
+        count += cpus.size();
+    }
+    return count;
+}
+
+const std::vector<int>& CpuTopology::nodeCpus(size_t node) const {
+    return nodes_[node];
+}
+
+size_t CpuTopology::nodeOf(int cpu) const {
+    for (size_t i = 0; i < nodes_.size(); i ++) {
+        if (std::binary_search(nodes_[i].begin(), nodes_[i].end(), cpu)) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+std::vector<int> CpuTopology::compactOrder() const {
+    std::vector<int> order;
+    for (auto &cpus : nodes_) {
+        order.insert(order.end(), cpus.begin(), cpus.end());
+    }
+    return order;
+}
+
+std::vector<int> CpuTopology::scatterOrder() const {
+    std::vector<int> order;
+    for (size_t i = 0; order.size() < cpuCount(); i ++) {
+        for (auto &cpus : nodes_) {
+            if (i < cpus.size()) {
+                order.push_back(cpus[i]);
+            }
+        }
+    }
+    return order;
+}
+
+bool CpuTopology::pinCurrentThread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
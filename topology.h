@@ -0,0 +1,38 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+本进程可用的CPU和NUMA节点
+- Linux下从/sys/devices/system/node/nodeN/cpulist读取每个节点的CPU列表，并和sched_getaffinity允许的CPU取交集，
+  没有可用CPU的节点(例如被cgroup的cpuset排除)不计入
+- 读不到sysfs或者不是Linux时，把所有CPU当作一个节点
+- 节点按编号从小到大排列，节点下标(而不是内核的节点编号)就是submitTask的节点提示
+*/
+class CpuTopology {
+public:
+    // 探测当前机器的拓扑
+    static CpuTopology detect();
+
+    size_t nodeCount() const;
+    size_t cpuCount() const;
+    // 某个节点上可用的CPU编号，从小到大
+    const std::vector<int>& nodeCpus(size_t node) const;
+    // CPU所在节点的下标，不在任何节点上返回0
+    size_t nodeOf(int cpu) const;
+
+    // 紧凑排列：先排满第一个节点的所有CPU，再排下一个节点
+    std::vector<int> compactOrder() const;
+    // 分散排列：在各个节点之间轮流取CPU
+    std::vector<int> scatterOrder() const;
+
+    // 把调用线程绑定到一个CPU上，不支持或者失败时返回false
+    static bool pinCurrentThread(int cpu);
+
+private:
+    std::vector<std::vector<int>> nodes_; // 每个节点上可用的CPU编号
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+uint64_t traceTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+static int64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// --------- 实现TraceBuffer类
+TraceBuffer::TraceBuffer(size_t capacity, std::string name, int sortIndex)
+    : name_(std::move(name)),
+      sortIndex_(sortIndex)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots_ = std::make_unique<Slot[]>(size);
+    mask_ = size - 1;
+}
+
+std::vector<TraceEvent> TraceBuffer::collect() const {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t size = mask_ + 1;
+    uint64_t first = head > size ? head - size : 0;
+
+    std::vector<TraceEvent> events;
+    events.reserve(static_cast<size_t>(head - first));
+    for (uint64_t i = first; i < head; i ++) {
+        const Slot &slot = slots_[i & mask_];
+        uint64_t word = slot.word.load(std::memory_order_relaxed);
+        events.push_back(TraceEvent { slot.ticks.load(std::memory_order_relaxed),
+                                      static_cast<TraceEventType>(word >> 56), word & ARG_MASK });
+    }
+
+    // 读的过程中写者又前进了，开头这部分槽位可能已经被新事件覆盖
+    // 写者在推进head_之前就开始写第newHead个事件，它占用的槽位(newHead - size)也可能已经被改写
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t newHead = head_.load(std::memory_order_relaxed);
+    uint64_t valid = newHead + 1 > size ? newHead + 1 - size : 0;
+    if (valid > first) {
+        events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(std::min(valid - first, head - first)));
+    }
+    return events;
+}
+
+// --------- 实现Tracer类
+thread_local Tracer::LocalCache Tracer::localCache_;
+std::atomic<uint64_t> Tracer::nextTracerId_ {1};
+
+Tracer::Tracer(size_t capacity)
+    : id_(nextTracerId_.fetch_add(1, std::memory_order_relaxed)),
+      capacity_(std::max<size_t>(capacity, 2)),
+      startTicks_(traceTicks()),
+      startNs_(steadyNs())
+{}
+
+TraceBuffer& Tracer::registerThread(int workerSlot) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    // 线程交替使用多个追踪器时缓存会失效，先找回之前给它创建的缓冲区
+    std::thread::id tid = std::this_thread::get_id();
+    for (size_t i = 0; i < owners_.size(); i ++) {
+        if (owners_[i] == tid) {
+            localCache_.tracerId = id_;
+            localCache_.buffer = buffers_[i].get();
+            return *localCache_.buffer;
+        }
+    }
+
+    std::string name;
+    int sortIndex = 0;
+    if (workerSlot >= 0) {
+        name = "worker " + std::to_string(workerSlot);
+        sortIndex = workerSlot;
+    } else {
+        name = "thread " + std::to_string(externalThreads_);
+        // 外部线程排在所有工作线程之后
+        sortIndex = 1000000 + externalThreads_ ++;
+    }
+    buffers_.push_back(std::make_unique<TraceBuffer>(capacity_, std::move(name), sortIndex));
+    owners_.push_back(tid);
+    localCache_.tracerId = id_;
+    localCache_.buffer = buffers_.back().get();
+    return *localCache_.buffer;
+}
+
+namespace {
+
+// 按照Chrome trace的格式逐个写出事件，第一个之外的事件前面加逗号
+class TraceWriter {
+public:
+    explicit TraceWriter(std::ostream &out)
+        : out_(out)
+    {}
+
+    void begin(const char *ph, const char *name, size_t tid, double ts) {
+        char buf[160];
+        std::snprintf(buf, sizeof(buf), "%s\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f",
+                      first_ ? "" : ",", ph, name, tid, ts);
+        out_ << buf;
+        first_ = false;
+    }
+
+private:
+    std::ostream &out_;
+    bool first_ = true;
+};
+
+}
+
+void Tracer::writeChromeTrace(std::ostream &out) const {
+    // 开启追踪以来的时间戳和steady_clock对照，换算出每个时间戳对应多少纳秒
+    uint64_t endTicks = traceTicks();
+    int64_t endNs = steadyNs();
+    double nsPerTick = endTicks > startTicks_ ? static_cast<double>(endNs - startNs_) / (endTicks - startTicks_) : 1.0;
+    auto toUs = [&](uint64_t ticks) {
+        return ticks > startTicks_ ? (ticks - startTicks_) * nsPerTick / 1000.0 : 0.0;
+    };
+
+    std::vector<std::vector<TraceEvent>> events;
+    std::vector<std::string> names;
+    std::vector<int> sortIndices;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto &buffer : buffers_) {
+            events.push_back(buffer->collect());
+            names.push_back(buffer->name());
+            sortIndices.push_back(buffer->sortIndex());
+        }
+    }
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    TraceWriter w(out);
+    for (size_t b = 0; b < events.size(); b ++) {
+        size_t tid = b + 1;
+        w.begin("M", "thread_name", tid, 0);
+        out << ",\"args\":{\"name\":\"" << names[b] << "\"}}";
+        w.begin("M", "thread_sort_index", tid, 0);
+        out << ",\"args\":{\"sort_index\":" << sortIndices[b] << "}}";
+
+        // 任务的开始和结束、挂起和醒来都在同一个线程上成对出现，配成一段时间
+        // 等待结果时帮忙执行的任务嵌套在外层任务里，开始事件按栈保存，结束事件和最近一个未结束的开始配对
+        std::vector<TraceEvent> running;
+        bool parked = false;
+        TraceEvent park {};
+        for (const TraceEvent &e : events[b]) {
+            double ts = toUs(e.ticks);
+            switch (e.type) {
+            case TraceEventType::TRACE_SUBMIT:
+                w.begin("i", "submit", tid, ts);
+                out << ",\"s\":\"t\",\"args\":{\"task\":" << e.arg << "}}";
+                // 提交到开始执行之间的箭头，看得出任务在队列里等了多久
+                w.begin("s", "queued", tid, ts);
+                out << ",\"cat\":\"task\",\"id\":" << e.arg << "}";
+                break;
+            case TraceEventType::TRACE_DEQUEUE:
+                w.begin("i", "dequeue", tid, ts);
+                out << ",\"s\":\"t\",\"args\":{\"task\":" << e.arg << "}}";
+                break;
+            case TraceEventType::TRACE_START:
+                running.push_back(e);
+                w.begin("f", "queued", tid, ts);
+                out << ",\"cat\":\"task\",\"bp\":\"e\",\"id\":" << e.arg << "}";
+                break;
+            case TraceEventType::TRACE_END: {
+                // 开始事件已经被覆盖的结束事件找不到配对，丢弃
+                auto it = std::find_if(running.rbegin(), running.rend(),
+                                       [&e](const TraceEvent &start) { return start.arg == e.arg; });
+                if (it == running.rend()) {
+                    break;
+                }
+                TraceEvent start = *it;
+                running.erase(std::next(it).base(), running.end());
+                w.begin("X", "task", tid, toUs(start.ticks));
+                out << ",\"dur\":" << std::max(ts - toUs(start.ticks), 0.0)
+                    << ",\"args\":{\"task\":" << e.arg << "}}";
+                break;
+            }
+            case TraceEventType::TRACE_STEAL:
+                w.begin("i", "steal", tid, ts);
+                out << ",\"s\":\"t\",\"args\":{\"task\":" << e.arg << "}}";
+                break;
+            case TraceEventType::TRACE_PARK:
+                parked = true;
+                park = e;
+                break;
+            case TraceEventType::TRACE_UNPARK:
+                if (parked) {
+                    w.begin("X", "parked", tid, toUs(park.ticks));
+                    out << ",\"dur\":" << std::max(ts - toUs(park.ticks), 0.0) << "}";
+                }
+                parked = false;
+                break;
+            case TraceEventType::TRACE_WAKE:
+                w.begin("i", "wake", tid, ts);
+                out << ",\"s\":\"t\",\"args\":{\"slot\":" << e.arg << "}}";
+                break;
+            }
+        }
+        // 导出时还没有结束的任务和挂起
+        for (const TraceEvent &start : running) {
+            w.begin("B", "task", tid, toUs(start.ticks));
+            out << ",\"args\":{\"task\":" << start.arg << "}}";
+        }
+        if (parked) {
+            w.begin("B", "parked", tid, toUs(park.ticks));
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+}
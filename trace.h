@@ -0,0 +1,130 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+调度事件追踪，导出为Chrome trace / Perfetto的JSON格式(chrome://tracing 或 ui.perfetto.dev 打开)
+- 每个线程(工作线程和外部提交者)写自己的定长环形缓冲区，只有一个写者，不加锁，满了覆盖最早的事件
+- 时间戳在x86上是rdtsc，导出时按照开启追踪以来的steady_clock换算成微秒；其他平台直接读steady_clock
+- 导出可以在线程池运行期间进行，正在被覆盖的那部分事件会被丢弃
+*/
+
+enum class TraceEventType : uint8_t {
+    TRACE_SUBMIT,  // 提交任务，参数为任务编号
+    TRACE_DEQUEUE, // 工作线程取到任务，参数为任务编号
+    TRACE_START,   // 开始执行任务，参数为任务编号
+    TRACE_END,     // 任务执行完毕，参数为任务编号
+    TRACE_STEAL,   // 从其他线程或其他节点取得任务，参数为任务编号
+    TRACE_PARK,    // 工作线程挂起
+    TRACE_UNPARK,  // 工作线程从挂起中醒来(被唤醒或超时)
+    TRACE_WAKE,    // 唤醒一个挂起的线程，参数为被唤醒线程的slot
+};
+
+struct TraceEvent {
+    uint64_t ticks;       // 时间戳，单位见traceTicks()
+    TraceEventType type;
+    uint64_t arg;
+};
+
+// 读取时间戳，开销只有几个周期
+uint64_t traceTicks();
+
+// 一个线程的环形缓冲区
+class TraceBuffer {
+public:
+    TraceBuffer(size_t capacity, std::string name, int sortIndex);
+
+    // 只由所属线程调用
+    void record(TraceEventType type, uint64_t arg) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        Slot &slot = slots_[head & mask_];
+        slot.ticks.store(traceTicks(), std::memory_order_relaxed);
+        slot.word.store(static_cast<uint64_t>(type) << 56 | (arg & ARG_MASK), std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // 取出缓冲区中还没有被覆盖的事件，按时间顺序，可以在其他线程上调用
+    std::vector<TraceEvent> collect() const;
+
+    const std::string& name() const {
+        return name_;
+    }
+    int sortIndex() const {
+        return sortIndex_;
+    }
+
+private:
+    static constexpr uint64_t ARG_MASK = (uint64_t(1) << 56) - 1;
+
+    // 字段都是原子变量，导出时读到正在写的槽位不构成数据竞争，读完后再根据head_丢弃可能被覆盖的部分
+    struct Slot {
+        std::atomic<uint64_t> ticks {0};
+        std::atomic<uint64_t> word {0}; // 高8位事件类型，低56位参数
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    uint64_t mask_;
+    std::atomic<uint64_t> head_ {0}; // 写过的事件总数
+    std::string name_;
+    int sortIndex_;
+};
+
+class Tracer {
+public:
+    // 每个线程的缓冲区可以保存capacity个事件(向上取整到2的幂)
+    explicit Tracer(size_t capacity);
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // 当前线程的缓冲区，第一次调用时创建；workerSlot为线程池中的slot，外部线程为-1，只用于命名
+    TraceBuffer& local(int workerSlot) {
+        LocalCache &cache = localCache_;
+        if (cache.tracerId == id_) {
+            return *cache.buffer;
+        }
+        return registerThread(workerSlot);
+    }
+
+    // 给提交的任务分配编号，用来把提交和执行连起来，从1开始
+    uint64_t nextTaskId() {
+        return nextTaskId_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 导出所有线程的事件
+    void writeChromeTrace(std::ostream &out) const;
+
+private:
+    struct LocalCache {
+        uint64_t tracerId = 0;
+        TraceBuffer *buffer = nullptr;
+    };
+
+    TraceBuffer& registerThread(int workerSlot);
+
+    // 线程上一次使用的缓冲区，追踪器的编号全局唯一，旧追踪器释放后同一地址上的新追踪器不会误用旧缓冲区
+    static thread_local LocalCache localCache_;
+    static std::atomic<uint64_t> nextTracerId_;
+
+    uint64_t id_;
+    size_t capacity_;
+    std::atomic<uint64_t> nextTaskId_ {1};
+    uint64_t startTicks_;     // 开启追踪时的时间戳，导出时用来换算
+    int64_t startNs_;         // 同一时刻的steady_clock
+
+    mutable std::mutex mtx_;  // 保护buffers_和owners_
+    std::vector<std::unique_ptr<TraceBuffer>> buffers_;
+    std::vector<std::thread::id> owners_;  // buffers_中每个缓冲区所属的线程
+    int externalThreads_ = 0;
+};
+
+#endif
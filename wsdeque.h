@@ -0,0 +1,140 @@
+#ifndef WSDEQUE_H
+#define WSDEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+/*
+Chase-Lev 工作窃取双端队列 (参考 Lê et al. "Correct and Efficient Work-Stealing for Weak Memory Models")
+- 只有拥有者线程可以调用 push / pop，从底部(bottom)进出，后进先出，缓存更热
+- 任意线程都可以调用 steal，从顶部(top)取走最早放入的元素，先进先出
+- 容量不足时由拥有者扩容，旧数组要等到整个队列析构时才释放，因为窃取者可能还在读取它
+*/
+template<typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque only holds trivially copyable values");
+
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256)
+        : top_(0),
+          bottom_(0) {
+        // 容量必须为2的幂，这样下标可以直接用位与取模
+        int64_t cap = 1;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        arrays_.emplace_back(std::make_unique<Array>(cap));
+        array_.store(arrays_.back().get(), std::memory_order_relaxed);
+    }
+    ~WorkStealingDeque() = default;
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // 拥有者线程：从底部放入一个元素
+    void push(T item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array *a = array_.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = grow(a, b, t);
+        }
+        a->put(b, item);
+        bottom_.store(b + 1, std::memory_order_release);
+    }
+
+    // 拥有者线程：从底部取出最近放入的元素，队列为空时返回false
+    bool pop(T &item) {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array *a = array_.load(std::memory_order_relaxed);
+        // 先发布bottom再读取top，两者都用seq_cst，和steal中的读取构成全序
+        bottom_.store(b, std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_seq_cst);
+
+        if (t > b) {
+            // 队列本来就是空的，恢复bottom
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = a->get(b);
+        if (t == b) {
+            // 只剩最后一个元素，需要和窃取者竞争top
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 任意线程：从顶部窃取最早放入的元素，失败(为空或竞争失败)时返回false
+    bool steal(T &item) {
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_seq_cst);
+        if (t >= b) {
+            return false;
+        }
+
+        Array *a = array_.load(std::memory_order_acquire);
+        T x = a->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        item = x;
+        return true;
+    }
+
+    // 近似的元素数量，仅作为调度参考
+    int64_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    struct Array {
+        explicit Array(int64_t cap)
+            : capacity(cap),
+              mask(cap - 1),
+              slots(new std::atomic<T>[cap]) {}
+
+        T get(int64_t i) const {
+            return slots[i & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T item) {
+            slots[i & mask].store(item, std::memory_order_relaxed);
+        }
+
+        int64_t capacity;
+        int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> slots;
+    };
+
+    // 容量翻倍，把[t, b)之间的元素拷贝到新数组
+    Array* grow(Array *old, int64_t b, int64_t t) {
+        arrays_.emplace_back(std::make_unique<Array>(old->capacity * 2));
+        Array *a = arrays_.back().get();
+        for (int64_t i = t; i < b; i ++) {
+            a->put(i, old->get(i));
+        }
+        array_.store(a, std::memory_order_release);
+        return a;
+    }
+
+private:
+    // top_和bottom_分别由窃取者和拥有者频繁修改，放在不同的缓存行避免伪共享
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    alignas(64) std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> arrays_;  // 所有分配过的数组，只有拥有者修改
+};
+
+#endif
@@ -9,6 +9,7 @@
 using namespace std;
 
 #include "线程池项目-最终版.h"
+using namespace final_version;
 
 
 /*
@@ -33,6 +34,8 @@ int sum2(int a, int b, int c)
     this_thread::sleep_for(chrono::seconds(2));
     return a + b + c;
 }
+// 下面两个桩函数想做的网络服务见reactor.h中的IoReactor：reactor线程负责epoll和accept，
+// 连接可读时交给threadpool.h的线程池处理，bench/reactor_bench.cpp是回环上的echo/HTTP-lite压测
 // io线程 
 void io_thread(int listenfd)
 {
@@ -71,11 +74,18 @@ int main()
         }, 1, 100);
     //future<int> r4 = pool.submitTask(sum1, 1, 2);
 
-    cout << r1.get() << endl;
-    cout << r2.get() << endl;
-    cout << r3.get() << endl;
-    cout << r4.get() << endl;
-    cout << r5.get() << endl;
+    // 队列满时提交失败的任务不会执行，它的future抛出future_error(broken_promise)
+    for (future<int>* r : { &r1, &r2, &r3, &r4, &r5 })
+    {
+        try
+        {
+            cout << r->get() << endl;
+        }
+        catch (const future_error&)
+        {
+            cerr << "task queue is full, submit task fail." << endl;
+        }
+    }
 
     //packaged_task<int(int, int)> task(sum1);
     //// future <=> Result
@@ -1,7 +1,6 @@
-#ifndef THREADPOOL_H
-#define THREADPOOL_H
+#ifndef THREADPOOL_FINAL_H
+#define THREADPOOL_FINAL_H
 
-#include <iostream>
 #include <vector>
 #include <queue>
 #include <memory>
@@ -12,6 +11,16 @@
 #include <unordered_map>
 #include <thread>
 #include <future>
+#include <latch>
+#include <tuple>
+#include <type_traits>
+
+#include "function.h"
+#include "ringbuffer.h"
+
+// 和threadpool.h中的ThreadPool、Thread等类同名，放在自己的命名空间里，两个线程池可以链接进同一个程序
+namespace final_version
+{
 
 const int TASK_MAX_THRESHHOLD = 2; // INT32_MAX;
 const int THREAD_MAX_THRESHHOLD = 1024;
@@ -61,6 +70,32 @@ private:
 
 int Thread::generateId_ = 0;
 
+// submitBatch的返回值，future按提交顺序排列
+// 整批任务共用一个计数，waitAll只在最后一个任务完成时被唤醒一次
+template<typename RType>
+class BatchFuture
+{
+public:
+	BatchFuture(std::vector<std::future<RType>> futures, std::shared_ptr<std::latch> latch)
+		: futures_(std::move(futures))
+		, latch_(std::move(latch))
+	{}
+
+	size_t size() const { return futures_.size(); }
+	std::future<RType>& operator[](size_t index) { return futures_[index]; }
+	typename std::vector<std::future<RType>>::iterator begin() { return futures_.begin(); }
+	typename std::vector<std::future<RType>>::iterator end() { return futures_.end(); }
+
+	// 等待整批任务执行完毕，之后每个future的get()都不会阻塞
+	// 没有提交成功的任务不会执行，它们的future抛出std::future_error(broken_promise)
+	void waitAll() { latch_->wait(); }
+	bool isAllReady() const { return latch_->try_wait(); }
+
+private:
+	std::vector<std::future<RType>> futures_;
+	std::shared_ptr<std::latch> latch_;
+};
+
 // 线程池类型
 class ThreadPool
 {
@@ -118,59 +153,117 @@ public:
 	// 给线程池提交任务
 	// 使用可变参模板编程，让submitTask可以接收任意任务函数和任意数量的参数
 	// pool.submitTask(sum1, 10, 20);   csdn  大秦坑王  右值引用+引用折叠原理
-	// 返回值future<>
+	// 返回值future<>，队列满且等待超过1s时提交失败，任务不会执行，future抛出std::future_error(broken_promise)
+	// 任务函数和参数直接保存在lambda中，lambda存放在MoveOnlyFunction的内部缓冲区里，
+	// 不再需要packaged_task、bind和std::function各自的堆分配；promise的共享状态从SlabAllocator中分配
 	template<typename Func, typename... Args>
 	auto submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>
 	{
 		// 打包任务，放入任务队列里面
 		using RType = decltype(func(args...));
-		auto task = std::make_shared<std::packaged_task<RType()>>(
-			std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
-		std::future<RType> result = task->get_future();
+		std::promise<RType> promise(std::allocator_arg, SlabStlAllocator<RType>());
+		std::future<RType> result = promise.get_future();
 
-		// 获取锁
-		std::unique_lock<std::mutex> lock(taskQueMtx_);
-		// 用户提交任务，最长不能阻塞超过1s，否则判断提交任务失败，返回
-		if (!notFull_.wait_for(lock, std::chrono::seconds(1),
-			[&]()->bool { return taskQue_.size() < (size_t)taskQueMaxThreshHold_; }))
+		Task task([promise = std::move(promise),
+			func = std::forward<Func>(func),
+			args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+		{
+			try
+			{
+				// 和std::bind一样，参数以左值的形式传给任务函数
+				if constexpr (std::is_void_v<RType>)
+				{
+					std::apply(func, args);
+					promise.set_value();
+				}
+				else
+				{
+					promise.set_value(std::apply(func, args));
+				}
+			}
+			catch (...)
+			{
+				promise.set_exception(std::current_exception());
+			}
+		});
+
+		if (!enqueue(std::move(task)))
 		{
 			// 表示notFull_等待1s种，条件依然没有满足
-			std::cerr << "task queue is full, submit task fail." << std::endl;
-			auto task = std::make_shared<std::packaged_task<RType()>>(
-				[]()->RType { return RType(); });
-			(*task)();
-			return task->get_future();
+			// 没有放入的任务在这里析构，它的promise给future写入broken_promise，由调用者决定如何处理
+			task = nullptr;
 		}
 
-		// 如果有空余，把任务放入任务队列中
-		// taskQue_.emplace(sp);  
-		// using Task = std::function<void()>;
-		taskQue_.emplace([task]() {(*task)();});
-		taskSize_++;
-
-		// 因为新放了任务，任务队列肯定不空了，在notEmpty_上进行通知，赶快分配线程执行任务
-		notEmpty_.notify_all();
+		// 返回任务的Result对象
+		return result;
+	}
 
-		// cached模式 任务处理比较紧急 场景：小而快的任务 需要根据任务数量和空闲线程的数量，判断是否需要创建新的线程出来
-		if (poolMode_ == PoolMode::MODE_CACHED
-			&& taskSize_ > idleThreadSize_
-			&& curThreadSize_ < threadSizeThreshHold_)
+	// 批量提交任务，funcs是一组不带参数的函数对象(参数可以在lambda中捕获)
+	// 整批任务只获取一次锁，只唤醒min(任务数量, 空闲线程数量)个线程
+	// funcs是右值时函数对象被移动进任务，否则被拷贝
+	template<typename Range>
+	auto submitBatch(Range&& funcs) -> BatchFuture<std::invoke_result_t<std::decay_t<decltype(*std::begin(funcs))>&>>
+	{
+		using Func = std::decay_t<decltype(*std::begin(funcs))>;
+		using RType = std::invoke_result_t<Func&>;
+
+		size_t n = static_cast<size_t>(std::distance(std::begin(funcs), std::end(funcs)));
+		auto latch = std::make_shared<std::latch>(static_cast<std::ptrdiff_t>(n));
+		std::vector<std::future<RType>> futures;
+		std::vector<Task> tasks;
+		futures.reserve(n);
+		tasks.reserve(n);
+
+		// 在锁外把所有任务打包好
+		for (auto& f : funcs)
 		{
-			std::cout << ">>> create new thread..." << std::endl;
+			std::promise<RType> promise(std::allocator_arg, SlabStlAllocator<RType>());
+			futures.push_back(promise.get_future());
 
-			// 创建新的线程对象
-			auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-			int threadId = ptr->getId();
-			threads_.emplace(threadId, std::move(ptr));
-			// 启动线程
-			threads_[threadId]->start();
-			// 修改线程个数相关的变量
-			curThreadSize_++;
-			idleThreadSize_++;
+			using Elem = std::conditional_t<std::is_lvalue_reference_v<Range>,
+				decltype(f), std::remove_reference_t<decltype(f)>&&>;
+			tasks.emplace_back([promise = std::move(promise), func = Func(static_cast<Elem>(f)), latch]() mutable
+			{
+				try
+				{
+					if constexpr (std::is_void_v<RType>)
+					{
+						func();
+						promise.set_value();
+					}
+					else
+					{
+						promise.set_value(func());
+					}
+				}
+				catch (...)
+				{
+					promise.set_exception(std::current_exception());
+				}
+				latch->count_down();
+			});
 		}
 
-		// 返回任务的Result对象
-		return result;
+		size_t accepted = enqueueBatch(tasks);
+		if (accepted < n)
+		{
+			// 剩下的任务随tasks一起析构，它们的promise会给future写入broken_promise
+			latch->count_down(static_cast<std::ptrdiff_t>(n - accepted));
+		}
+		return BatchFuture<RType>(std::move(futures), std::move(latch));
+	}
+
+	// 提交不关心返回值的任务，不创建future
+	// 任务函数和参数足够小时(不超过MoveOnlyFunction的内部缓冲区)，整个提交过程没有任何堆分配
+	// 注意：任务抛出的异常没有人接收，任务函数自己负责处理异常
+	template<typename Func, typename... Args>
+	bool post(Func&& func, Args&&... args)
+	{
+		return enqueue(Task([func = std::forward<Func>(func),
+			args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+		{
+			std::apply(func, args);
+		}));
 	}
 
 	// 开启线程池
@@ -193,11 +286,11 @@ public:
 			// threads_.emplace_back(std::move(ptr));
 		}
 
-		// 启动所有线程  std::vector<Thread*> threads_;
-		for (int i = 0; i < initThreadSize_; i++)
+		// 启动所有线程  线程id是全局递增的，同一进程中的第二个线程池不是从0开始，所以按map遍历而不是按下标
+		for (auto& [threadId, thread] : threads_)
 		{
-			threads_[i]->start(); // 需要去执行一个线程函数
-			idleThreadSize_++;    // 记录初始空闲线程的数量
+			thread->start();   // 需要去执行一个线程函数
+			idleThreadSize_++; // 记录初始空闲线程的数量
 		}
 	}
 
@@ -205,6 +298,105 @@ public:
 	ThreadPool& operator=(const ThreadPool&) = delete;
 
 private:
+	// Task任务 =》 函数对象
+	using Task = MoveOnlyFunction<void()>;
+
+	// 把任务放入任务队列，队列满且等待超过1s时返回false，此时task不会被移动
+	bool enqueue(Task&& task)
+	{
+		// 获取锁
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		// 用户提交任务，最长不能阻塞超过1s，否则判断提交任务失败，返回
+		if (!notFull_.wait_for(lock, std::chrono::seconds(1),
+			[&]()->bool { return taskQue_.size() < (size_t)taskQueMaxThreshHold_; }))
+		{
+			return false;
+		}
+
+		// 如果有空余，把任务放入任务队列中
+		taskQue_.emplace(std::move(task));
+		taskSize_++;
+
+		// 因为新放了任务，任务队列肯定不空了，在notEmpty_上进行通知，赶快分配线程执行任务
+		notEmpty_.notify_all();
+
+		// cached模式 任务处理比较紧急 场景：小而快的任务 需要根据任务数量和空闲线程的数量，判断是否需要创建新的线程出来
+		if (poolMode_ == PoolMode::MODE_CACHED
+			&& taskSize_ > idleThreadSize_
+			&& curThreadSize_ < threadSizeThreshHold_)
+		{
+			addThread();
+		}
+		return true;
+	}
+
+	// 把一批任务放入任务队列，整批只获取一次锁，返回放入的任务数量
+	// 队列满时和enqueue一样最多等待1s，超时后剩余的任务不再放入(也不会被移动)
+	size_t enqueueBatch(std::vector<Task>& tasks)
+	{
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		auto notFull = [&]()->bool { return taskQue_.size() < (size_t)taskQueMaxThreshHold_; };
+
+		size_t accepted = 0;
+		size_t pending = 0; // 已经放入但还没有唤醒线程的任务数量
+		for (Task& task : tasks)
+		{
+			if (!notFull())
+			{
+				// 先唤醒线程消费已经放入的任务，否则等待notFull_永远不会成功
+				notifyWorkers(pending);
+				pending = 0;
+				if (!notFull_.wait_for(lock, std::chrono::seconds(1), notFull))
+				{
+					break;
+				}
+			}
+			taskQue_.emplace(std::move(task));
+			taskSize_++;
+			accepted++;
+			pending++;
+		}
+		notifyWorkers(pending);
+
+		// cached模式 按照积压的任务数量一次性补足线程
+		while (poolMode_ == PoolMode::MODE_CACHED
+			&& taskSize_ > idleThreadSize_
+			&& curThreadSize_ < threadSizeThreshHold_)
+		{
+			addThread();
+		}
+		return accepted;
+	}
+
+	// 在notEmpty_上唤醒至多n个空闲线程，调用者需持有taskQueMtx_
+	void notifyWorkers(size_t n)
+	{
+		int idle = idleThreadSize_;
+		if (n == 0 || idle <= 0)
+			return;
+		if (n >= (size_t)idle)
+		{
+			notEmpty_.notify_all();
+			return;
+		}
+		for (size_t i = 0; i < n; i++)
+			notEmpty_.notify_one();
+	}
+
+	// 创建并启动一个新线程，调用者需持有taskQueMtx_
+	void addThread()
+	{
+		// 创建新的线程对象
+		auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
+		int threadId = ptr->getId();
+		threads_.emplace(threadId, std::move(ptr));
+		// 启动线程
+		threads_[threadId]->start();
+		// 修改线程个数相关的变量
+		curThreadSize_++;
+		idleThreadSize_++;
+	}
+
 	// 定义线程函数
 	void threadFunc(int threadid)
 	{
@@ -218,9 +410,6 @@ private:
 				// 先获取锁
 				std::unique_lock<std::mutex> lock(taskQueMtx_);
 
-				std::cout << "tid:" << std::this_thread::get_id()
-					<< "尝试获取任务..." << std::endl;
-
 				// cached模式下，有可能已经创建了很多的线程，但是空闲时间超过60s，应该把多余的线程
 				// 结束回收掉（超过initThreadSize_数量的线程要进行回收）
 				// 当前时间 - 上一次线程执行的时间 > 60s
@@ -233,8 +422,6 @@ private:
 					if (!isPoolRunning_)
 					{
 						threads_.erase(threadid); // std::this_thread::getid()
-						std::cout << "threadid:" << std::this_thread::get_id() << " exit!"
-							<< std::endl;
 						exitCond_.notify_all();
 						return; // 线程函数结束，线程结束
 					}
@@ -258,8 +445,6 @@ private:
 								curThreadSize_--;
 								idleThreadSize_--;
 
-								std::cout << "threadid:" << std::this_thread::get_id() << " exit!"
-									<< std::endl;
 								return;
 							}
 						}
@@ -273,18 +458,16 @@ private:
 
 				idleThreadSize_--;
 
-				std::cout << "tid:" << std::this_thread::get_id()
-					<< "获取任务成功..." << std::endl;
-
 				// 从任务队列种取一个任务出来
-				task = taskQue_.front();
+				task = std::move(taskQue_.front());
 				taskQue_.pop();
 				taskSize_--;
 
-				// 如果依然有剩余任务，继续通知其它得线程执行任务
+				// 如果依然有剩余任务，接力通知一个线程执行任务
+				// 提交者已经按任务数量唤醒过线程，这里不再唤醒所有空闲线程去抢同一个锁
 				if (taskQue_.size() > 0)
 				{
-					notEmpty_.notify_all();
+					notEmpty_.notify_one();
 				}
 
 				// 取出一个任务，进行通知，通知可以继续提交生产任务
@@ -294,7 +477,7 @@ private:
 			// 当前线程负责执行这个任务
 			if (task != nullptr)
 			{
-				task(); // 执行function<void()> 
+				task(); // 执行MoveOnlyFunction<void()>
 			}
 
 			idleThreadSize_++;
@@ -316,9 +499,7 @@ private:
 	std::atomic_int curThreadSize_;	// 记录当前线程池里面线程的总数量
 	std::atomic_int idleThreadSize_; // 记录空闲线程的数量
 
-	// Task任务 =》 函数对象
-	using Task = std::function<void()>;
-	std::queue<Task> taskQue_; // 任务队列
+	RingBuffer<Task> taskQue_; // 任务队列
 	std::atomic_int taskSize_; // 任务的数量
 	int taskQueMaxThreshHold_;  // 任务队列数量上限阈值
 
@@ -331,4 +512,6 @@ private:
 	std::atomic_bool isPoolRunning_; // 表示当前线程池的启动状态
 };
 
+} // namespace final_version
+
 #endif